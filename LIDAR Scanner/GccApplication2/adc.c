@@ -49,6 +49,32 @@ uint16_t adc_read(){
 	return ADCW;
 }
 
+/**********************************************************************************************//**
+ * @fn	void adc_start()
+ *
+ * @brief	Starts a conversion and returns immediately. adc_result() returns the value.
+ **************************************************************************************************/
+
+void adc_start(){
+	ADCSRA |= (1<<ADSC);
+}
+
+/**********************************************************************************************//**
+ * @fn	uint16_t adc_result()
+ *
+ * @brief	Returns the value of the conversion started by adc_start().
+ *
+ * @return	Value, 0xFFFF if the conversion is still running.
+ **************************************************************************************************/
+
+uint16_t adc_result(){
+	if (ADCSRA & (1<<ADSC))
+	{
+		return 0xFFFF;
+	}
+	return ADCW;
+}
+
 /**********************************************************************************************//**
  * @fn	uint16_t adc_read_avg(char x)
  *
@@ -31,6 +31,24 @@ void adc_init();
 
 uint16_t adc_read();
 
+/**********************************************************************************************//**
+ * @fn	void adc_start()
+ *
+ * @brief	Starts a conversion and returns immediately. adc_result() returns the value.
+ **************************************************************************************************/
+
+void adc_start();
+
+/**********************************************************************************************//**
+ * @fn	uint16_t adc_result()
+ *
+ * @brief	Returns the value of the conversion started by adc_start().
+ *
+ * @return	Value, 0xFFFF if the conversion is still running.
+ **************************************************************************************************/
+
+uint16_t adc_result();
+
 /**********************************************************************************************//**
  * @fn	uint16_t adc_read_avg(char x)
  *
@@ -0,0 +1,153 @@
+/*
+ * command.c
+ *
+ * Created: 17.10.2026
+ */
+
+#include "command.h"
+#include "serial.h"
+
+
+/*! \brief State of the decoder */
+enum {
+	COMMAND_IDLE,		/*!< Waiting for SERIAL_COMMAND_START */
+	COMMAND_CODE,		/*!< Waiting for the code */
+	COMMAND_ARGS		/*!< Reading arguments */
+};
+
+static uint8_t command_state = COMMAND_IDLE;
+
+/*! \brief Command which is decoded at the moment */
+static command_t command_current;
+
+/*! \brief Number of arguments of command_current */
+static uint8_t command_expected;
+
+/*! \brief Value of the argument which is decoded at the moment */
+static int16_t command_value;
+
+/*! \brief Sign of the argument which is decoded at the moment */
+static int8_t command_sign;
+
+/*! \brief Set when the argument has at least one digit */
+static uint8_t command_digits;
+
+
+/*! \brief Number of arguments
+ *
+ *  \param code Code of the command
+ *  \return Number of arguments the command expects
+ */
+uint8_t command_argCount(char code){
+	switch (code)
+	{
+		case '3': return 2;
+		case '6': return 1;
+		case '9': return 1;
+		case '0': return 1;
+		case 'b': return 1;
+		case 'i': return 1;
+		case 'e': return 1;
+		case 'f': return 1;
+		case 't': return 1;
+		case 'w': return 6;
+		case 'o': return 1;
+		case 'u': return 1;
+		case 'm': return 1;
+		case 'v': return 1;
+		case 'c': return 1;
+		case 'h': return 1;
+		default: return 0;
+	}
+}
+
+//Start a new argument
+static void command_resetValue(void){
+	command_value = 0;
+	command_sign = 1;
+	command_digits = 0;
+}
+
+//Decode one character, returns 1 if command_current is complete
+static uint8_t command_feed(char c){
+	if (c == SERIAL_COMMAND_START)
+	{
+		//A new command discards an incomplete one
+		command_state = COMMAND_CODE;
+		return 0;
+	}
+
+	switch (command_state)
+	{
+		case COMMAND_CODE:
+		command_current.code = c;
+		command_current.argc = 0;
+		command_expected = command_argCount(c);
+		command_resetValue();
+		if (command_expected == 0)
+		{
+			command_state = COMMAND_IDLE;
+			return 1;
+		}
+		command_state = COMMAND_ARGS;
+		return 0;
+
+		case COMMAND_ARGS:
+		if (c >= '0' && c <= '9')
+		{
+			if (command_value <= (COMMAND_MAX_VALUE - (c - '0')) / 10)
+			{
+				command_value = command_value * 10 + (c - '0');
+			}
+			else
+			{
+				command_value = COMMAND_MAX_VALUE;
+			}
+			command_digits = 1;
+		}
+		else if (c == '-' && !command_digits)
+		{
+			command_sign = -1;
+		}
+		else if (command_digits)
+		{
+			//Any other character ends the argument
+			command_current.args[command_current.argc++] = command_value * command_sign;
+			command_resetValue();
+			if (command_current.argc == command_expected)
+			{
+				command_state = COMMAND_IDLE;
+				return 1;
+			}
+		}
+		else
+		{
+			command_sign = 1;
+		}
+		return 0;
+
+		default:
+		//Characters outside of a command are ignored
+		return 0;
+	}
+}
+
+/*! \brief Poll for a command
+ *
+ *  Decode all received characters. The decoder keeps its state between calls,
+ *  so a command may arrive in several parts. An argument ends with the first character which is not a digit,
+ *  e.g. "#3 100 45\r\n".
+ *  \param command Filled with the decoded command
+ *  \return 1 if a complete command was decoded, else 0
+ */
+uint8_t command_poll(command_t *command){
+	while (serial_available())
+	{
+		if (command_feed(serial_read_char()))
+		{
+			*command = command_current;
+			return 1;
+		}
+	}
+	return 0;
+}
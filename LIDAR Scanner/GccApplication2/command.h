@@ -0,0 +1,41 @@
+/*
+ * command.h
+ *
+ * Created: 17.10.2026
+ */ 
+
+
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+/*! \def COMMAND_MAX_ARGS
+ *
+ *  Define the maximum number of arguments of a command
+ */
+#define COMMAND_MAX_ARGS	6
+
+/*! \def COMMAND_MAX_VALUE
+ *
+ *  Define the maximum value of an argument. Bigger values are limited to this value.
+ */
+#define COMMAND_MAX_VALUE	32767
+
+
+#include <avr/io.h>
+
+/*! \brief Decoded command
+ *
+ *  A command has the format "#N args". The arguments are integers separated by any other character.
+ */
+typedef struct {
+	char code;							/*!< Character after the '#' */
+	uint8_t argc;						/*!< Number of arguments */
+	int16_t args[COMMAND_MAX_ARGS];		/*!< Arguments */
+} command_t;
+
+
+uint8_t command_argCount(char code);
+uint8_t command_poll(command_t *command);
+
+
+#endif /* COMMAND_H_ */
@@ -0,0 +1,156 @@
+/*
+ * config.c
+ *
+ * Created: 17.10.2026
+ *
+ * Settings in the EEPROM, so the scanner comes up with the settings of the last session.
+ */ 
+
+#include "config.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stddef.h>
+#include "motor.h"
+#include "servo.h"
+#include "lidar.h"
+#include "serial.h"
+
+
+//CRC16 of the record without the CRC itself
+static uint16_t config_crc(const config_t *config){
+	uint16_t crc = 0xFFFF;
+	const uint8_t *data = (const uint8_t*)config;
+	for (uint8_t i = 0; i < offsetof(config_t, crc); i++)
+	{
+		crc = _crc16_update(crc, data[i]);
+	}
+	return crc;
+}
+
+/*! \brief Default settings
+ *
+ *	These are the settings of the modules after power up.
+ *
+ *	\param config Filled with the defaults
+ */
+void config_defaults(config_t *config){
+	config->version = CONFIG_VERSION;
+	config->avg = 10;
+	config->offset = 0;
+	config->speed = T_STEP;
+	config->power = POWER;
+	config->stepMode = MOTOR_MODE_FULL;
+	config->baud = 0;
+	config->twiSpeed = TWI_SPEED_STANDARD;
+	config->burst = 0;
+	config->threshold = 0;
+	config->filter = LIDAR_FILTER_MEAN;
+	config->format = SCAN_FORMAT_ASCII;
+	config->timestamp = 0;
+	config->order = SCAN_ORDER_AUTO;
+	config->monitor = SCAN_MONITOR_THRESHOLD;
+	config->window.mstart = 0;
+	config->window.mend = MOTOR_MAX_STEPS/2;
+	config->window.mstride = 1;
+	config->window.sstart = 0;
+	config->window.send = SERVO_MAX_DEG/2;
+	config->window.sstride = 1;
+}
+
+/*! \brief Load the settings from the EEPROM
+ *
+ *	\param config Filled with the settings, the defaults if the EEPROM holds no valid settings
+ *	\return 1 if valid settings were loaded, 0 if the defaults are used
+ */
+uint8_t config_load(config_t *config){
+	eeprom_read_block(config, (const void*)CONFIG_EEPROM, sizeof(config_t));
+	if (config->version != CONFIG_VERSION || config->crc != config_crc(config))
+	{
+		config_defaults(config);
+		return 0;
+	}
+	return 1;
+}
+
+/*! \brief Save the settings to the EEPROM
+ *
+ *	Only the bytes which changed are written, every byte takes 3.4 ms.
+ *
+ *	\param config Settings, the version and the CRC are set
+ */
+void config_save(config_t *config){
+	config->version = CONFIG_VERSION;
+	config->crc = config_crc(config);
+	eeprom_update_block(config, (void*)CONFIG_EEPROM, sizeof(config_t));
+}
+
+/*! \brief Erase the settings in the EEPROM
+ *
+ *	The scanner uses the defaults after the next power up.
+ */
+void config_erase(void){
+	eeprom_update_byte((uint8_t*)CONFIG_EEPROM, 0xFF);
+}
+
+/*! \brief Read the settings of the modules
+ *
+ *	\param config Filled with the settings
+ *	\param avg Values per measure, this one is kept by main()
+ */
+void config_read(config_t *config, uint16_t avg){
+	const scan_window_t *window = scan_getWindow();
+	config->version = CONFIG_VERSION;
+	config->avg = avg;
+	config->offset = lidar_getDistanceCalibration();
+	config->speed = motor_get_speed();
+	config->power = motor_get_power();
+	config->stepMode = motor_get_mode();
+	config->baud = 0;
+	for (uint8_t i = 0; serial_baudRate(i) != 0; i++)
+	{
+		if (serial_baudRate(i) == serial_getBaud())
+		{
+			config->baud = i;
+		}
+	}
+	config->twiSpeed = twi_getSpeed();
+	config->burst = lidar_getBurst();
+	config->threshold = lidar_getThreshold();
+	config->filter = lidar_getFilter();
+	config->format = scan_getFormat();
+	config->timestamp = scan_getTimestamp();
+	config->order = scan_getOrder();
+	config->monitor = scan_getMonitorThreshold();
+	config->window = *window;
+}
+
+/*! \brief Apply the settings to the modules
+ *
+ *	The number of values per measure and the baud rate are applied by the caller,
+ *	the host has to follow the switch of the baud rate.
+ *
+ *	\param config Settings
+ */
+void config_apply(const config_t *config){
+	int16_t window[6] = {
+		config->window.mstart, config->window.mend, config->window.mstride,
+		config->window.sstart, config->window.send, config->window.sstride
+	};
+	//Only write the sensor if the offset is not the power up value
+	if (config->offset != lidar_getDistanceCalibration())
+	{
+		lidar_setDistanceCalibration(config->offset);
+	}
+	motor_set_speed(config->speed);
+	motor_set_power(config->power);
+	motor_set_mode(config->stepMode);
+	twi_setSpeed(config->twiSpeed);
+	lidar_setBurst(config->burst);
+	lidar_setThreshold(config->threshold);
+	lidar_setFilter(config->filter);
+	scan_setFormat(config->format);
+	scan_setTimestamp(config->timestamp);
+	scan_setOrder(config->order);
+	scan_setMonitorThreshold(config->monitor);
+	scan_setWindow(window);
+}
@@ -0,0 +1,68 @@
+/*
+ * config.h
+ *
+ * Created: 17.10.2026
+ */ 
+
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <avr/io.h>
+#include "scan.h"
+
+/*! \def CONFIG_EEPROM
+ *
+ *  Define the EEPROM address of the configuration, behind the homing record of the motor
+ */
+#define CONFIG_EEPROM	0x010
+
+/*! \def CONFIG_VERSION
+ *
+ *  Define the version of the configuration. A configuration of another version is not loaded,
+ *  so it has to be increased whenever config_t changes.
+ */
+#define CONFIG_VERSION	2
+
+/*! \def CONFIG_...
+ *
+ *  Define the actions of the command #c
+ */
+#define CONFIG_LOAD		0
+#define CONFIG_SAVE		1
+#define CONFIG_RESET	2
+
+/*! \brief Settings which are kept in the EEPROM
+ *
+ *  The record ends with the CRC16 of all bytes before.
+ */
+typedef struct {
+	uint8_t version;		/*!< CONFIG_VERSION */
+	uint16_t avg;			/*!< Values per measure (#6) */
+	int8_t offset;			/*!< Offset of the LIDAR-Lite in cm (#9) */
+	uint8_t speed;			/*!< Time between steps at standstill in ms */
+	uint8_t power;			/*!< Power of the stepper in % */
+	uint8_t stepMode;		/*!< Step mode of the stepper (#h) */
+	uint8_t baud;			/*!< Index of the baud rate (#u) */
+	uint8_t twiSpeed;		/*!< I2C speed (#i) */
+	uint8_t burst;			/*!< Burst delay (#b) */
+	uint8_t threshold;		/*!< Early exit of averages in cm (#e) */
+	uint8_t filter;			/*!< Filter (#f) */
+	uint8_t format;			/*!< Output format (#0) */
+	uint8_t timestamp;		/*!< Timestamp of the points (#t) */
+	uint8_t order;			/*!< Order of the 3D scan (#o) */
+	uint16_t monitor;		/*!< Threshold of the monitor mode in cm (#m) */
+	scan_window_t window;	/*!< Scan window (#w) */
+	uint16_t crc;			/*!< CRC16 */
+} config_t;
+
+
+void config_defaults(config_t *config);
+uint8_t config_load(config_t *config);
+void config_save(config_t *config);
+void config_erase(void);
+void config_read(config_t *config, uint16_t avg);
+void config_apply(const config_t *config);
+
+
+#endif /* CONFIG_H_ */
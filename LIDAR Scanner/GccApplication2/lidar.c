@@ -7,58 +7,726 @@
 
 #include "lidar.h"
 #include "avr/interrupt.h"
+#include "timer.h"
 
 
+/*! \brief State of a LIDAR-Lite unit on the bus */
+typedef struct {
+	uint8_t address;					/*!< TWI address */
+	uint16_t remaining;					/*!< Samples still to take */
+	uint32_t sum;						/*!< Sum of the taken samples */
+	uint16_t taken;						/*!< Number of the taken samples */
+	float mean;							/*!< Running mean of the taken samples (Welford) */
+	float m2;							/*!< Sum of the squared deviations from mean (Welford) */
+	uint16_t sorted[LIDAR_FILTER_SIZE];	/*!< Taken samples in ascending order, used by all filters except LIDAR_FILTER_MEAN */
+	uint8_t waiting;					/*!< Set while a sample is triggered and not read yet */
+	uint32_t stamp;						/*!< Time of the trigger or the last value in us */
+	volatile uint16_t result;			/*!< Result of the last background measure */
+	volatile uint16_t samples;			/*!< Samples of the last finished measure */
+} lidar_unit_t;
+
+/*! \brief Units on the bus, unit 0 is used by the functions for a single sensor */
+static lidar_unit_t lidar_units[LIDAR_UNITS_MAX] = {{LIDARLite_ADDRESS}};
+
+/*! \brief Number of units found at the boot */
+static uint8_t lidar_unitCount = 1;
+
+/*! \brief Unit of the running transaction of the background measure */
+static uint8_t lidar_current;
+
+/*! \brief Enable pins of the units 1 and up */
+static const uint8_t lidar_enablePins[LIDAR_UNITS_MAX - 1] = {LIDAR_ENABLE_1, LIDAR_ENABLE_2, LIDAR_ENABLE_3};
+
+//Give the unit at LIDARLite_ADDRESS a new address. The serial number unlocks the address register,
+//then the default address is disabled until the next power up.
+static uint8_t lidar_readdress(uint8_t address){
+	uint8_t serial[2];
+	if (twi_readReg(LIDARLite_ADDRESS, REGISTER_SERIAL, serial, 2) != TWI_OK
+		|| twi_writeReg(LIDARLite_ADDRESS, REGISTER_SERIAL_LOW, serial[0]) != TWI_OK
+		|| twi_writeReg(LIDARLite_ADDRESS, REGISTER_SERIAL_HIGH, serial[1]) != TWI_OK
+		|| twi_writeReg(LIDARLite_ADDRESS, REGISTER_ADDRESS, address) != TWI_OK
+		|| twi_writeReg(LIDARLite_ADDRESS, REGISTER_ADDRESS_CONTROL, 0) != TWI_OK
+		|| twi_writeReg(address, REGISTER_ADDRESS_CONTROL, ADDRESS_DISABLE_DEFAULT) != TWI_OK)
+	{
+		return TWI_CONNECTION_ERROR;
+	}
+	return TWI_OK;
+}
+
+//Switch the units on one after the other and give each one its own address.
+//A unit which keeps the default address is the last one, the next one would answer at the same address.
+//After a reset of the MCU alone a unit which stayed powered still answers at its own address only, it is kept.
+static void lidar_findUnits(){
+	uint8_t status;
+	LIDAR_ENABLE_PORT &= ~LIDAR_ENABLE_MASK;
+	LIDAR_ENABLE_DDR |= LIDAR_ENABLE_MASK;
+	for (uint8_t n = 0; n < LIDAR_UNITS_MAX; n++)
+	{
+		uint8_t address = LIDAR_UNIT_ADDRESS + n;
+		if (n > 0)
+		{
+			LIDAR_ENABLE_PORT |= (1 << lidar_enablePins[n - 1]);
+			_delay_ms(LIDAR_POWER_UP_MS);
+		}
+		if (twi_readReg(address, REGISTER_STATUS, &status, 1) == TWI_OK)
+		{
+			lidar_unitCount = n + 1;
+			lidar_units[n].address = address;
+			continue;
+		}
+		if (n > 0 && twi_readReg(LIDARLite_ADDRESS, REGISTER_STATUS, &status, 1) != TWI_OK)
+		{
+			LIDAR_ENABLE_PORT &= ~(1 << lidar_enablePins[n - 1]);
+			return;
+		}
+		lidar_unitCount = n + 1;
+		if (lidar_readdress(address) != TWI_OK)
+		{
+			lidar_units[n].address = LIDARLite_ADDRESS;
+			return;
+		}
+		lidar_units[n].address = address;
+	}
+}
 
 /*! \brief Initialize the LIDAR-Lite
  *
- *  This function inizialize the TWI-communication and set the default calibration value.
+ *  This function inizialize the TWI-communication, gives every unit on the bus its own address
+ *  and set the default calibration value.
  */
 void lidar_init(){
 	twi_init();
+	lidar_findUnits();
 	lidar_setDistanceCalibration(CALIBRATION_BOOT);
 }
 
-/*! \brief Get value of distance measure
- *
- *  This function start a new distance measure.
- *  \return Distance measure
- */
-uint16_t lidar_getValue(){
-	uint16_t convert;
-	uint8_t data[2];
-	uint8_t *dp = &data[0];
-	uint8_t errorW = 100;
-	uint8_t errorR = 100;
-	cli();
-	while (errorW != 0)
+/*! \brief Transaction of the background measure */
+static twi_transaction_t lidar_transaction;
+
+/*! \brief Command written to REGISTER_MEASURE for every sample */
+static uint8_t lidar_command;
+
+/*! \brief Buffer for the distance registers */
+static uint8_t lidar_data[2];
+
+/*! \brief NACKed transactions of the current sample */
+static uint16_t lidar_retries;
+
+/*! \brief Standard error in cm which ends an average early, 0 takes all samples */
+static uint8_t lidar_threshold = 0;
+
+/*! \brief Selected filter of the samples */
+static uint8_t lidar_filter = LIDAR_FILTER_MEAN;
+
+/*! \brief Set if the background measure is finished */
+static volatile uint8_t lidar_ready = 1;
+
+/*! \brief Delay between the measures of a burst, 0 disables the burst mode */
+static uint8_t lidar_burstDelay = 0;
+
+/*! \brief Measures left in the running burst */
+static uint8_t lidar_burstLeft;
+
+/*! \brief Set when the sensor was busy since the last harvested value */
+static uint8_t lidar_seenBusy;
+
+/*! \brief Register writes of the running configuration (register, value) */
+static uint8_t lidar_config[4][2];
+
+/*! \brief Number of register writes in lidar_config */
+static uint8_t lidar_configLength;
+
+/*! \brief Index of the running register write */
+static uint8_t lidar_configIndex;
+
+/*! \brief Called when all register writes of lidar_config are done */
+static void (*lidar_configThen)(void);
+
+/*! \brief Buffer for REGISTER_STATUS */
+static uint8_t lidar_status;
+
+/*! \brief Time of the last transaction submitted by the background measure */
+static volatile uint32_t lidar_activity;
+
+/*! \brief Shortest acquisition in us */
+static uint16_t lidar_latencyMin = 0xFFFF;
+
+/*! \brief Longest acquisition in us */
+static uint16_t lidar_latencyMax = 0;
+
+/*! \brief Sum of all acquisitions in us */
+static uint32_t lidar_latencySum = 0;
+
+/*! \brief Number of acquisitions in lidar_latencySum */
+static uint16_t lidar_latencyCount = 0;
+
+static void lidar_triggerDone(uint8_t status);
+static void lidar_statusDone(uint8_t status);
+static void lidar_readDone(uint8_t status);
+static void lidar_configDone(uint8_t status);
+static void lidar_burstStart(void);
+static void lidar_configure(uint8_t length, void (*then)(void));
+
+//Finish the measure of the current unit
+static void lidar_finish(uint16_t value){
+	lidar_unit_t *u = &lidar_units[lidar_current];
+	u->result = value;
+	u->samples = u->taken;
+	u->remaining = 0;
+	u->waiting = 0;
+}
+
+//Abort the background measure of all units
+static void lidar_fail(){
+	for (lidar_current = 0; lidar_current < lidar_unitCount; lidar_current++)
 	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, REGISTER_MEASURE, MEASURE_VALUE_WITH_DC);
-		if (errorW == TWI_CONNECTION_ERROR)
+		lidar_finish(TWI_CONNECTION_ERROR);
+	}
+	lidar_current = 0;
+	lidar_ready = 1;
+}
+
+//Check a transaction of the background measure, it fails if the TWI-queue is full
+static void lidar_submitted(uint8_t status){
+	if (status != TWI_OK)
+	{
+		lidar_fail();
+		return;
+	}
+	lidar_activity = timer_micros();
+}
+
+//Filtered value of the taken samples of the current unit
+static uint16_t lidar_filtered(){
+	lidar_unit_t *u = &lidar_units[lidar_current];
+	uint8_t n = u->taken;
+	uint8_t k;
+	uint16_t median;
+	uint32_t sum = 0;
+	uint8_t used = 0;
+
+	if (lidar_filter == LIDAR_FILTER_MEAN)
+	{
+		return u->sum / u->taken;
+	}
+
+	median = (n & 1) ? u->sorted[n/2] : (u->sorted[n/2 - 1] + u->sorted[n/2]) / 2;
+	switch (lidar_filter)
+	{
+		case LIDAR_FILTER_TRIMMED:
+		k = n / 4;
+		for (uint8_t i = k; i < n - k; i++)
 		{
-			return TWI_CONNECTION_ERROR;
+			sum += u->sorted[i];
 		}
-		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
+		return sum / (n - 2 * k);
+
+		case LIDAR_FILTER_REJECT:
+		for (uint8_t i = 0; i < n; i++)
+		{
+			if (u->sorted[i] + LIDAR_FILTER_WINDOW >= median && u->sorted[i] <= median + LIDAR_FILTER_WINDOW)
+			{
+				sum += u->sorted[i];
+				used++;
+			}
+		}
+		//The two middle samples can be far apart
+		return (used > 0) ? sum / used : median;
+
+		default:
+		return median;
 	}
-	while (errorR != 0)
+}
+
+//Add a sample to the current unit, ends its average if the standard error is below lidar_threshold
+static void lidar_addValue(uint16_t value){
+	lidar_unit_t *u = &lidar_units[lidar_current];
+	if (lidar_filter != LIDAR_FILTER_MEAN)
 	{
-		errorR = twi_readReg(LIDARLite_ADDRESS, REGISTER_VALUE, dp, 2);
-		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
-		if (errorR == TWI_CONNECTION_ERROR)
+		//Sorted insertion
+		uint8_t i = u->taken;
+		while (i > 0 && u->sorted[i - 1] > value)
 		{
-			return TWI_CONNECTION_ERROR;
+			u->sorted[i] = u->sorted[i - 1];
+			i--;
+		}
+		u->sorted[i] = value;
+	}
+	u->sum += value;
+	u->taken++;
+	u->remaining--;
+
+	//The early exit is only for the mean. This runs in the TWI-ISR, so the float math is skipped while it is off.
+	if (lidar_threshold == 0 || lidar_filter != LIDAR_FILTER_MEAN)
+	{
+		return;
+	}
+	float delta = value - u->mean;
+	u->mean += delta / u->taken;
+	u->m2 += delta * (value - u->mean);
+
+	//SE = sqrt(m2 / (n - 1)) / sqrt(n) < threshold
+	if (u->taken >= LIDAR_MIN_SAMPLES && u->m2 < (float)lidar_threshold * lidar_threshold * u->taken * (u->taken - 1))
+	{
+		u->remaining = 0;
+	}
+}
+
+//Add the time since the stamp of the current unit to the latency counters
+static void lidar_latency(){
+	lidar_unit_t *u = &lidar_units[lidar_current];
+	uint32_t now = timer_micros();
+	uint32_t latency = now - u->stamp;
+	u->stamp = now;
+	if (latency > 0xFFFF)
+	{
+		latency = 0xFFFF;
+	}
+	if (latency < lidar_latencyMin)
+	{
+		lidar_latencyMin = latency;
+	}
+	if (latency > lidar_latencyMax)
+	{
+		lidar_latencyMax = latency;
+	}
+	lidar_latencySum += latency;
+	lidar_latencyCount++;
+}
+
+//Start the acquisition of the next sample of the current unit
+static void lidar_trigger(){
+	lidar_retries = 0;
+	lidar_units[lidar_current].stamp = timer_micros();
+	lidar_submitted(twi_writeRegAsync(&lidar_transaction, lidar_units[lidar_current].address, REGISTER_MEASURE, &lidar_command, 1, lidar_triggerDone));
+}
+
+//Poll the busy bit of the current unit until the next value is valid
+static void lidar_poll(){
+	lidar_retries = 0;
+	lidar_seenBusy = 0;
+	lidar_submitted(twi_readRegAsync(&lidar_transaction, lidar_units[lidar_current].address, REGISTER_STATUS, &lidar_status, 1, lidar_statusDone));
+}
+
+//Round robin over the units after the current one: trigger the next unit which has samples left and is not
+//measuring, else poll the next unit which is measuring. So every unit measures while the others are read.
+//Without a measuring unit the background measure is finished.
+static void lidar_continue(){
+	uint8_t start = lidar_current;
+	for (uint8_t i = 1; i <= lidar_unitCount; i++)
+	{
+		lidar_current = (start + i) % lidar_unitCount;
+		if (!lidar_units[lidar_current].waiting && lidar_units[lidar_current].remaining > 0)
+		{
+			lidar_trigger();
+			return;
+		}
+	}
+	for (uint8_t i = 1; i <= lidar_unitCount; i++)
+	{
+		lidar_current = (start + i) % lidar_unitCount;
+		if (lidar_units[lidar_current].waiting)
+		{
+			lidar_poll();
+			return;
+		}
+	}
+	lidar_ready = 1;
+}
+
+//Called by the TWI-ISR after the trigger was written
+static void lidar_triggerDone(uint8_t status){
+	if (status == TWI_OK)
+	{
+		lidar_units[lidar_current].waiting = 1;
+		lidar_continue();
+	}
+	else if (status == TWI_CONNECTION_ERROR || ++lidar_retries > LIDAR_MAX_RETRIES)
+	{
+		lidar_fail();
+	}
+	else
+	{
+		lidar_submitted(twi_submit(&lidar_transaction));
+	}
+}
+
+//Called by the TWI-ISR after REGISTER_STATUS was read
+static void lidar_statusDone(uint8_t status){
+	if (status == TWI_CONNECTION_ERROR || ++lidar_retries > LIDAR_MAX_RETRIES)
+	{
+		lidar_fail();
+		return;
+	}
+	if (status != TWI_OK || (lidar_status & STATUS_BUSY))
+	{
+		//Sensor is still measuring, a NACK means busy as well
+		lidar_seenBusy = 1;
+		lidar_submitted(twi_submit(&lidar_transaction));
+		return;
+	}
+	if (lidar_burstLeft > 0 && !lidar_seenBusy)
+	{
+		//During a burst the last value stays valid until the next measure has started
+		lidar_submitted(twi_submit(&lidar_transaction));
+		return;
+	}
+	lidar_latency();
+	lidar_retries = 0;
+	lidar_submitted(twi_readRegAsync(&lidar_transaction, lidar_units[lidar_current].address, REGISTER_VALUE, lidar_data, 2, lidar_readDone));
+}
+
+//REGISTER_BURST_COUNT is back at single measures, finish the average
+static void lidar_burstEnd(){
+	lidar_finish(lidar_filtered());
+	lidar_ready = 1;
+}
+
+//Called by the TWI-ISR after the distance was read
+static void lidar_readDone(uint8_t status){
+	lidar_unit_t *u = &lidar_units[lidar_current];
+	if (status == TWI_CONNECTION_ERROR || ++lidar_retries > LIDAR_MAX_RETRIES)
+	{
+		lidar_fail();
+		return;
+	}
+	if (status != TWI_OK)
+	{
+		lidar_submitted(twi_submit(&lidar_transaction));
+		return;
+	}
+
+	uint16_t value = ((uint16_t)lidar_data[0] << 8) + lidar_data[1];
+	if (value == 0 && lidar_command == MEASURE_VALUE_WITH_DC)
+	{
+		value = MAX_VALUE;
+	}
+	lidar_addValue(value);
+
+	if (lidar_burstLeft > 0)
+	{
+		lidar_burstLeft--;
+		if (u->remaining == 0)
+		{
+			lidar_config[0][0] = REGISTER_BURST_COUNT;
+			lidar_config[0][1] = 1;
+			lidar_configure(1, lidar_burstEnd);
+		}
+		else if (lidar_burstLeft == 0)
+		{
+			lidar_burstStart();
+		}
+		else
+		{
+			lidar_poll();
+		}
+		return;
+	}
+	u->waiting = 0;
+	if (u->remaining == 0)
+	{
+		lidar_finish(lidar_filtered());
+	}
+	lidar_continue();
+}
+
+//Write the next register of lidar_config or continue with lidar_configThen
+static void lidar_configNext(){
+	if (lidar_configIndex < lidar_configLength)
+	{
+		lidar_submitted(twi_writeRegAsync(&lidar_transaction, lidar_units[lidar_current].address, lidar_config[lidar_configIndex][0], &lidar_config[lidar_configIndex][1], 1, lidar_configDone));
+	}
+	else
+	{
+		lidar_configThen();
+	}
+}
+
+//Write lidar_config in the background and call then() afterwards
+static void lidar_configure(uint8_t length, void (*then)(void)){
+	lidar_configLength = length;
+	lidar_configIndex = 0;
+	lidar_configThen = then;
+	lidar_retries = 0;
+	lidar_configNext();
+}
+
+//Called by the TWI-ISR after a register of lidar_config was written
+static void lidar_configDone(uint8_t status){
+	if (status == TWI_OK)
+	{
+		lidar_configIndex++;
+		lidar_retries = 0;
+		lidar_configNext();
+	}
+	else if (status == TWI_CONNECTION_ERROR || ++lidar_retries > LIDAR_MAX_RETRIES)
+	{
+		lidar_fail();
+	}
+	else
+	{
+		lidar_submitted(twi_submit(&lidar_transaction));
+	}
+}
+
+//The burst is triggered, start the latency measure
+static void lidar_burstTriggered(){
+	lidar_units[lidar_current].stamp = timer_micros();
+	lidar_poll();
+}
+
+//Configure and trigger a burst for the remaining measures
+static void lidar_burstStart(){
+	uint16_t remaining = lidar_units[lidar_current].remaining;
+	lidar_burstLeft = (remaining > LIDAR_BURST_MAX) ? LIDAR_BURST_MAX : remaining;
+	lidar_config[0][0] = REGISTER_BURST_DELAY;
+	lidar_config[0][1] = lidar_burstDelay;
+	lidar_config[1][0] = REGISTER_ACQ_MODE;
+	lidar_config[1][1] = ACQ_MODE_BURST_DELAY;
+	lidar_config[2][0] = REGISTER_BURST_COUNT;
+	lidar_config[2][1] = lidar_burstLeft;
+	lidar_config[3][0] = REGISTER_MEASURE;
+	lidar_config[3][1] = lidar_command;
+	lidar_configure(4, lidar_burstTriggered);
+}
+
+//Start a background measure of all units with the given command
+static void lidar_start(uint8_t command, uint16_t count){
+	//The transaction can only be used by one measure
+	while (!lidar_isReady())
+	{
+	}
+	if (count == 0)
+	{
+		count = 1;
+	}
+	if (lidar_filter != LIDAR_FILTER_MEAN && count > LIDAR_FILTER_SIZE)
+	{
+		count = LIDAR_FILTER_SIZE;
+	}
+	lidar_command = command;
+	for (uint8_t i = 0; i < lidar_unitCount; i++)
+	{
+		lidar_unit_t *u = &lidar_units[i];
+		u->remaining = count;
+		u->sum = 0;
+		u->taken = 0;
+		u->mean = 0;
+		u->m2 = 0;
+		u->waiting = 0;
+	}
+	lidar_burstLeft = 0;
+	lidar_ready = 0;
+	if (lidar_burstDelay != 0 && count > 1 && lidar_unitCount == 1)
+	{
+		//One trigger for all measures
+		lidar_current = 0;
+		lidar_burstStart();
+	}
+	else
+	{
+		//The round robin starts with unit 0
+		lidar_current = lidar_unitCount - 1;
+		lidar_continue();
+	}
+}
+
+//Wait for the background measure
+static uint16_t lidar_waitResult(){
+	while (!lidar_isReady())
+	{
+	}
+	return lidar_units[0].result;
+}
+
+/*! \brief Start a background measure
+ *
+ *	This function starts an average of a given count of distance measures on every unit and returns immediately.
+ *	The samples are taken by the TWI-ISR, so the motor and the UART can be served meanwhile.
+ *	The units are triggered round robin, each unit measures while the values of the others are read.
+ *	Poll lidar_isReady() and get the values with lidar_getResult() or lidar_getUnitResult().
+ *
+ *	\param count Quantity of Values
+ */
+void lidar_startValueAVG(uint16_t count){
+	lidar_start(MEASURE_VALUE_WITH_DC, count);
+}
+
+/*! \brief Check the background measure
+ *
+ *  A measure without a finished transaction for LIDAR_STALL_MS is aborted with TWI_CONNECTION_ERROR,
+ *  so a hanging bus does not block the callers until the watchdog resets the board.
+ *
+ *  \return 1 if the background measure is finished
+ */
+uint8_t lidar_isReady(){
+	if (!lidar_ready)
+	{
+		uint8_t sreg = SREG;
+		cli();
+		//Signed, a stamp of the ISR can be a little ahead of the main program
+		int32_t idle = timer_micros() - lidar_activity;
+		SREG = sreg;
+		if (idle > LIDAR_STALL_MS * 1000L)
+		{
+			//The callback of the aborted transaction finishes the measure
+			twi_abort();
+			cli();
+			if (!lidar_ready)
+			{
+				lidar_fail();
+			}
+			SREG = sreg;
 		}
 	}
-	sei();
-	int16_t temp;
-	temp = data[0];
-	temp = (temp <<8);
-	convert = (temp + data[1]);
-	if (convert == 0)
+	return lidar_ready;
+}
+
+/*! \brief Get the result of the background measure
+ *
+ *  \return Distance measure average of unit 0 or TWI_CONNECTION_ERROR
+ */
+uint16_t lidar_getResult(){
+	return lidar_units[0].result;
+}
+
+/*! \brief Get the result of the background measure of a unit
+ *
+ *	\param unit Unit, 0 to lidar_getUnits() - 1
+ *  \return Distance measure average or TWI_CONNECTION_ERROR
+ */
+uint16_t lidar_getUnitResult(uint8_t unit){
+	return lidar_units[unit].result;
+}
+
+/*! \brief Get the number of units
+ *
+ *  \return Number of LIDAR-Lite units found at the boot, at least 1
+ */
+uint8_t lidar_getUnits(){
+	return lidar_unitCount;
+}
+
+/*! \brief Set the burst mode
+ *
+ *	In burst mode an average is taken with a single trigger. The sensor repeats the measure by itself
+ *	and the new values are harvested from REGISTER_VALUE as they complete.
+ *
+ *	\param delay Delay between the measures (REGISTER_BURST_DELAY), 0 disables the burst mode
+ */
+void lidar_setBurst(uint8_t delay){
+	//Do not change the mode of a running measure
+	while (!lidar_isReady())
+	{
+	}
+	lidar_burstDelay = delay;
+}
+
+/*! \brief Get the burst mode
+ *
+ *  \return Delay between the measures of a burst, 0 if the burst mode is disabled
+ */
+uint8_t lidar_getBurst(){
+	return lidar_burstDelay;
+}
+
+/*! \brief Get the acquisition latency
+ *
+ *	Time from the trigger until the busy bit of the sensor is cleared, for all measures since the last reset.
+ *	During a burst the time between two values is counted.
+ *
+ *	\param min Shortest latency in us
+ *	\param avg Average latency in us
+ *	\param max Longest latency in us
+ *  \return Number of measures
+ */
+uint16_t lidar_getLatency(uint16_t *min, uint16_t *avg, uint16_t *max){
+	uint16_t count;
+	uint8_t sreg = SREG;
+	cli();
+	count = lidar_latencyCount;
+	*min = (count > 0) ? lidar_latencyMin : 0;
+	*avg = (count > 0) ? lidar_latencySum / count : 0;
+	*max = lidar_latencyMax;
+	SREG = sreg;
+	return count;
+}
+
+/*! \brief Reset the acquisition latency
+ */
+void lidar_resetLatency(){
+	uint8_t sreg = SREG;
+	cli();
+	lidar_latencyMin = 0xFFFF;
+	lidar_latencyMax = 0;
+	lidar_latencySum = 0;
+	lidar_latencyCount = 0;
+	SREG = sreg;
+}
+
+/*! \brief Set the early exit of averages
+ *
+ *	An average ends as soon as the standard error of the mean is below the threshold,
+ *	but not before LIDAR_MIN_SAMPLES samples. The count of the average is the upper limit.
+ *
+ *	\param threshold Standard error in cm, 0 takes all samples
+ */
+void lidar_setThreshold(uint8_t threshold){
+	while (!lidar_isReady())
+	{
+	}
+	lidar_threshold = threshold;
+}
+
+/*! \brief Get the early exit of averages
+ *
+ *  \return Standard error in cm, 0 if all samples are taken
+ */
+uint8_t lidar_getThreshold(){
+	return lidar_threshold;
+}
+
+/*! \brief Set the filter
+ *
+ *	The filters except LIDAR_FILTER_MEAN keep the samples sorted in a buffer of LIDAR_FILTER_SIZE,
+ *	so a no-return (MAX_VALUE) or a multipath spike does not move the result.
+ *
+ *	\param filter LIDAR_FILTER_MEAN, LIDAR_FILTER_MEDIAN, LIDAR_FILTER_TRIMMED or LIDAR_FILTER_REJECT
+ */
+void lidar_setFilter(uint8_t filter){
+	while (!lidar_isReady())
 	{
-		return MAX_VALUE;
 	}
-	return convert;
+	if (filter > LIDAR_FILTER_REJECT)
+	{
+		filter = LIDAR_FILTER_MEAN;
+	}
+	lidar_filter = filter;
+}
+
+/*! \brief Get the filter
+ *
+ *  \return Selected filter
+ */
+uint8_t lidar_getFilter(){
+	return lidar_filter;
+}
+
+/*! \brief Get the samples of the last measure
+ *
+ *  \return Number of samples the last finished average was taken from
+ */
+uint16_t lidar_getSamples(){
+	return lidar_units[0].samples;
+}
+
+/*! \brief Get value of distance measure
+ *
+ *  This function start a new distance measure.
+ *  \return Distance measure
+ */
+uint16_t lidar_getValue(){
+	return lidar_getValueAVG(1);
 }
 
 /*! \brief Get average of new distance measures
@@ -69,14 +737,8 @@ uint16_t lidar_getValue(){
  *  \return Distance measure average
  */
 uint16_t lidar_getValueAVG(uint16_t count){
-	uint16_t average = 0;
-	for (uint8_t i =0; i < count; i++)
-	{
-		average = average + lidar_getValue();
-		//_delay_us(50);
-	}
-	average = average / count;
-	return average;
+	lidar_start(MEASURE_VALUE_WITH_DC, count);
+	return lidar_waitResult();
 }
 
 /*! \brief Get value of distance measure without DC-Correction
@@ -85,37 +747,7 @@ uint16_t lidar_getValueAVG(uint16_t count){
  *  \return Distance measure
  */
 uint16_t lidar_getValueWithoutDCCorrection(){
-	int16_t convert;
-	uint8_t data[2];
-	uint8_t *dp = &data[0];
-	uint8_t errorW = 1;
-	uint8_t errorR = 1;
-	cli();
-	while (errorW != 0)
-	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, REGISTER_MEASURE, MEASURE_VALUE_WITHOUT_DC);
-		if (errorW == TWI_CONNECTION_ERROR)
-		{
-			return TWI_CONNECTION_ERROR;
-		}
-		//_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
-	}
-	while (errorR != 0)
-	{
-		errorR = twi_readReg(LIDARLite_ADDRESS, REGISTER_VALUE, dp, 2);
-		if (errorR == TWI_CONNECTION_ERROR)
-		{
-			return TWI_CONNECTION_ERROR;
-		}
-		//_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
-	}
-	sei();
-	
-	int16_t temp;
-	temp = data[0];
-	temp = (temp <<8);
-	convert = (temp + data[1]);
-	return convert;
+	return lidar_getValueAVGWithoutDCCorrection(1);
 }
 
 /*! \brief Get average of new distance measures without DC-Correction
@@ -125,14 +757,9 @@ uint16_t lidar_getValueWithoutDCCorrection(){
  *	\param count Quantity of Values
  *  \return Distance measure average
  */
-uint16_t lidar_getValueAVGWithoutDCCorrection(uint8_t count){
-	uint16_t average = 0;
-	for (uint8_t i =0; i < count; i++)
-	{
-		average += lidar_getValueWithoutDCCorrection();
-	}
-	average = average / count;
-	return average;
+uint16_t lidar_getValueAVGWithoutDCCorrection(uint16_t count){
+	lidar_start(MEASURE_VALUE_WITHOUT_DC, count);
+	return lidar_waitResult();
 }
 
 
@@ -160,13 +787,11 @@ void lidar_setVelocityEnable(uint8_t scale){
 		regval = 0x80;
 	}
 	uint8_t errorW = 100;
-	cli();
 	while (errorW != 0)
 	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, MEASURE_VALUE_WITH_DC, regval);
+		errorW = twi_writeReg(lidar_units[0].address, MEASURE_VALUE_WITH_DC, regval);
 		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
 	}
-	sei();
 }
 
 /*! \brief Disable the Velocity measure
@@ -176,13 +801,41 @@ void lidar_setVelocityEnable(uint8_t scale){
  */
 void lidar_setVelocityDisable(){
 	uint8_t errorW = 1;
-	cli();
 	while (errorW != 0)
 	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, REGISTER_MEASURE, 0x00);
+		errorW = twi_writeReg(lidar_units[0].address, REGISTER_MEASURE, 0x00);
 		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
 	}
-	sei();
+}
+
+/*! \brief Wait for the sensor
+ *
+ *  Poll the busy bit of the sensor until the measure is valid.
+ *  \return TWI_OK or TWI_CONNECTION_ERROR
+ */
+uint8_t lidar_waitBusy(){
+	uint8_t status = STATUS_BUSY;
+	uint16_t retries = 0;
+	//The background measure uses the latency counters too
+	while (!lidar_isReady())
+	{
+	}
+	lidar_current = 0;
+	lidar_units[0].stamp = timer_micros();
+	while (1)
+	{
+		uint8_t error = twi_readReg(lidar_units[0].address, REGISTER_STATUS, &status, 1);
+		if (error == TWI_CONNECTION_ERROR || ++retries > LIDAR_MAX_RETRIES)
+		{
+			return TWI_CONNECTION_ERROR;
+		}
+		if (error == TWI_OK && !(status & STATUS_BUSY))
+		{
+			lidar_latency();
+			return TWI_OK;
+		}
+		_delay_us(LIDAR_POLL_DELAY_US);
+	}
 }
 
 /*! \brief Get value of velocity measure
@@ -196,26 +849,28 @@ int8_t lidar_getVelocity()
 	uint8_t *dp = &data;
 	uint8_t errorW = 1;
 	uint8_t errorR = 1;
-	cli();
 	while (errorW != 0)
 	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, REGISTER_MEASURE, MEASURE_VALUE_WITH_DC);
+		errorW = twi_writeReg(lidar_units[0].address, REGISTER_MEASURE, MEASURE_VALUE_WITH_DC);
 		if (errorW == TWI_CONNECTION_ERROR)
 		{
 			return TWI_CONNECTION_ERROR;
 		}
-		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
+		_delay_us(LIDAR_POLL_DELAY_US);
+	}
+	if (lidar_waitBusy() != TWI_OK)
+	{
+		return TWI_CONNECTION_ERROR;
 	}
 	while (errorR != 0)
 	{
-		errorR = twi_readReg(LIDARLite_ADDRESS, REGISTER_MEASURE_VELOCITY, dp, 1);
+		errorR = twi_readReg(lidar_units[0].address, REGISTER_MEASURE_VELOCITY, dp, 1);
 		if (errorR == TWI_CONNECTION_ERROR)
 		{
 			return TWI_CONNECTION_ERROR;
 		}
-		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
+		_delay_us(LIDAR_POLL_DELAY_US);
 	}
-	sei();
 	return data;
 }
 
@@ -226,29 +881,86 @@ int8_t lidar_getVelocity()
 *	\param count Quantity of Values
 *  \return Velocity measure average
  */
-int8_t lidar_getVelocityAVG(uint8_t count){
-	int8_t average = 0;
-	int8_t temp =0;
-	for (uint8_t i =0; i < count; i++)
+int8_t lidar_getVelocityAVG(uint16_t count){
+	int32_t sum = 0;
+	if (count == 0)
 	{
-		temp = lidar_getVelocity();
-		if (temp < 0)
-		{
-			temp = (temp *(-1));
-			average = average - temp;
-		}
-		else
-		{
-			average = average + temp;
-		}
+		count = 1;
+	}
+	for (uint16_t i =0; i < count; i++)
+	{
+		sum += (int8_t)lidar_getVelocity();
+	}
+	return sum / (int32_t)count;
+}
+
+/*! \brief Start the velocity stream
+ *
+ *  The sensor repeats the velocity measure by itself with a continuous burst, so every period
+ *  gives a new value without a trigger. Get the values with lidar_pollVelocity().
+ *
+ *  \param scale 0: 100 ms period, 0.1 m/s per count; 1: 10 ms period, 1 m/s per count
+ *  \return TWI_OK or TWI_CONNECTION_ERROR
+ */
+uint8_t lidar_startVelocityStream(uint8_t scale){
+	//The background measure uses the bus and the burst registers too
+	while (!lidar_isReady())
+	{
+	}
+	lidar_seenBusy = 0;
+	if (lidar_writeRegister(REGISTER_BURST_DELAY, scale ? LIDAR_VELOCITY_DELAY_FAST : LIDAR_VELOCITY_DELAY_SLOW) != WRITE_REGISTER_OK
+		|| lidar_writeRegister(REGISTER_ACQ_MODE, ACQ_MODE_VELOCITY | ACQ_MODE_BURST_DELAY) != WRITE_REGISTER_OK
+		|| lidar_writeRegister(REGISTER_BURST_COUNT, BURST_COUNT_CONTINUOUS) != WRITE_REGISTER_OK
+		|| lidar_writeRegister(REGISTER_MEASURE, MEASURE_VALUE_WITH_DC) != WRITE_REGISTER_OK)
+	{
+		return TWI_CONNECTION_ERROR;
+	}
+	return TWI_OK;
+}
+
+/*! \brief Poll the velocity stream
+ *
+ *  A new value is valid when the busy bit was seen and is cleared again.
+ *
+ *  \param velocity New velocity measure
+ *  \param time Time of the new value in us (timer_micros())
+ *  \return 1 if a new value was read, 0 if the sensor is still measuring
+ */
+uint8_t lidar_pollVelocity(int8_t *velocity, uint32_t *time){
+	uint8_t status;
+	uint8_t error = twi_readReg(lidar_units[0].address, REGISTER_STATUS, &status, 1);
+	if (error != TWI_OK || (status & STATUS_BUSY))
+	{
+		//The sensor does not answer while it measures
+		lidar_seenBusy = 1;
+		return 0;
 	}
-	average = average / count;
-	return average;
+	if (!lidar_seenBusy)
+	{
+		return 0;
+	}
+	*time = timer_micros();
+	if (twi_readReg(lidar_units[0].address, REGISTER_MEASURE_VELOCITY, (uint8_t*)velocity, 1) != TWI_OK)
+	{
+		return 0;
+	}
+	lidar_seenBusy = 0;
+	return 1;
+}
+
+/*! \brief Stop the velocity stream
+ *
+ *  Stop the burst and restore the single measure.
+ */
+void lidar_stopVelocityStream(){
+	lidar_writeRegister(REGISTER_MEASURE, 0x00);
+	lidar_writeRegister(REGISTER_BURST_COUNT, 1);
+	lidar_writeRegister(REGISTER_ACQ_MODE, 0x00);
 }
 
 /*! \brief Set distance calibration
  *
- *  This function set the value for the offset calibration.
+ *  This function set the value for the offset calibration of all units.
  */
 void lidar_setDistanceCalibration(int8_t value){
 	if (value > 127)
@@ -260,14 +972,15 @@ void lidar_setDistanceCalibration(int8_t value){
 		value = -128;
 	}
 	
-	uint8_t errorW = 1;
-	cli();
-	while (errorW != 0)
+	for (uint8_t i = 0; i < lidar_unitCount; i++)
 	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, CALIBRATION_REGISTER, value);
-		_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
+		uint8_t errorW = 1;
+		while (errorW != 0)
+		{
+			errorW = twi_writeReg(lidar_units[i].address, CALIBRATION_REGISTER, value);
+			_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
+		}
 	}
-	sei();
 }
 
 /*! \brief Get distance calibration
@@ -279,17 +992,15 @@ int8_t lidar_getDistanceCalibration(){
 	uint8_t data;
 	uint8_t *dp = &data;
 	uint8_t errorR = 1;
-	cli();
 	while (errorR != 0)
 	{
-		errorR = twi_readReg(LIDARLite_ADDRESS, CALIBRATION_REGISTER, dp, 1);
+		errorR = twi_readReg(lidar_units[0].address, CALIBRATION_REGISTER, dp, 1);
 		if (errorR == TWI_CONNECTION_ERROR)
 		{
 			return TWI_CONNECTION_ERROR;
 		}
 		//_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
 	}
-	sei();
 	return data;
 }
 
@@ -301,17 +1012,15 @@ int8_t lidar_getDistanceCalibration(){
  */
 int8_t lidar_writeRegister(uint8_t reg, uint8_t value){
 	uint8_t errorW = 1;
-	cli();
 	while (errorW != 0)
 	{
-		errorW = twi_writeReg(LIDARLite_ADDRESS, reg, value);
+		errorW = twi_writeReg(lidar_units[0].address, reg, value);
 		if (errorW == TWI_CONNECTION_ERROR)
 		{
 			return TWI_CONNECTION_ERROR;
 		}
 		//_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
 	}
-	sei();
 	return WRITE_REGISTER_OK;
 }
 
@@ -325,16 +1034,14 @@ int8_t lidar_readRegister(uint8_t reg, uint8_t len){
 	uint8_t data;
 	uint8_t *dp = &data;
 	uint8_t errorR = 1;
-	cli();
 	while (errorR != 0)
 	{
-		errorR = twi_readReg(LIDARLite_ADDRESS, reg, dp, len);
+		errorR = twi_readReg(lidar_units[0].address, reg, dp, len);
 		if (errorR == TWI_CONNECTION_ERROR)
 		{
 			return TWI_CONNECTION_ERROR;
 		}
 		//_delay_ms(TWI_PREVENT_OVERPOLLING_DELAY);
 	}
-	sei();
 	return data;
 }
\ No newline at end of file
@@ -29,6 +29,67 @@
  */
 #define	LIDARLite_ADDRESS	0x62
 
+/*! \def LIDAR_UNITS_MAX
+ *
+ *  Define the peak of LIDAR-Lite units on the bus
+ */
+#define LIDAR_UNITS_MAX		4
+
+/*! \def LIDAR_UNIT_ADDRESS
+ *
+ *  Define the address of unit 0 after the boot, unit n gets LIDAR_UNIT_ADDRESS + n
+ */
+#define LIDAR_UNIT_ADDRESS	0x64
+
+/*! \def LIDAR_ENABLE_...
+ *
+ *  Define the power enable pins of the units 1 to 3 on PORTC. Unit 0 is always powered, the others
+ *  are switched on one after the other at the boot, so each one is alone at LIDARLite_ADDRESS.
+ */
+#define LIDAR_ENABLE_PORT	PORTC
+#define LIDAR_ENABLE_DDR	DDRC
+#define LIDAR_ENABLE_1		PINC0
+#define LIDAR_ENABLE_2		PINC2
+#define LIDAR_ENABLE_3		PINC3
+#define LIDAR_ENABLE_MASK	((1<<LIDAR_ENABLE_1) | (1<<LIDAR_ENABLE_2) | (1<<LIDAR_ENABLE_3))
+
+/*! \def LIDAR_POWER_UP_MS
+ *
+ *  Define the time a unit needs after its enable pin is set until it answers
+ */
+#define LIDAR_POWER_UP_MS	22
+
+/*! \def REGISTER_SERIAL
+ *
+ *  Define the register of the serial number (2 byte, read with auto increment)
+ */
+#define REGISTER_SERIAL		0x96
+
+/*! \def REGISTER_SERIAL_...
+ *
+ *  Define the registers the serial number is written back to, to unlock REGISTER_ADDRESS
+ */
+#define REGISTER_SERIAL_LOW		0x18
+#define REGISTER_SERIAL_HIGH	0x19
+
+/*! \def REGISTER_ADDRESS
+ *
+ *  Define the register of the new address
+ */
+#define REGISTER_ADDRESS	0x1A
+
+/*! \def REGISTER_ADDRESS_CONTROL
+ *
+ *  Define the register which enables the new address (0) and disables the default address
+ */
+#define REGISTER_ADDRESS_CONTROL	0x1E
+
+/*! \def ADDRESS_DISABLE_DEFAULT
+ *
+ *  Define the bit of REGISTER_ADDRESS_CONTROL which disables LIDARLite_ADDRESS until the next power up
+ */
+#define ADDRESS_DISABLE_DEFAULT		0x08
+
 /*! \def REGISTER_VALUE
  *
  *  Define the LIDAR-Lite register for the distance measure
@@ -77,6 +138,70 @@
  */
 #define ECHO_SELECT_RANGE_CRITERIA	0x02
 
+/*! \def REGISTER_STATUS
+ *
+ *  Define the register for the status of the LIDAR-Lite
+ */
+#define REGISTER_STATUS		0x01
+
+/*! \def STATUS_BUSY
+ *
+ *  Define the busy bit of REGISTER_STATUS, it is cleared when the measure is valid
+ */
+#define STATUS_BUSY			0x01
+
+// Burst Registers
+// a single trigger starts REGISTER_BURST_COUNT measures
+
+/*! \def REGISTER_ACQ_MODE
+ *
+ *  Define the register for the acquisition mode
+ */
+#define REGISTER_ACQ_MODE		0x04
+
+/*! \def ACQ_MODE_BURST_DELAY
+ *
+ *  Define the acquisition mode which uses REGISTER_BURST_DELAY between the measures of a burst
+ */
+#define ACQ_MODE_BURST_DELAY	0x20
+
+/*! \def ACQ_MODE_VELOCITY
+ *
+ *  Define the acquisition mode which writes the change of the distance to REGISTER_MEASURE_VELOCITY
+ */
+#define ACQ_MODE_VELOCITY		0x80
+
+/*! \def REGISTER_BURST_COUNT
+ *
+ *  Define the register for the number of measures per trigger (1 = single measure)
+ */
+#define REGISTER_BURST_COUNT	0x11
+
+/*! \def BURST_COUNT_CONTINUOUS
+ *
+ *  Define the burst count which repeats the measure until REGISTER_MEASURE is cleared
+ */
+#define BURST_COUNT_CONTINUOUS	0xFF
+
+/*! \def REGISTER_BURST_DELAY
+ *
+ *  Define the register for the delay between the measures of a burst (0x14 = 100 Hz, 0xC8 = 10 Hz)
+ */
+#define REGISTER_BURST_DELAY	0x45
+
+/*! \def LIDAR_BURST_MAX
+ *
+ *  Define the peak of measures of one burst. Longer averages are split into several bursts.
+ */
+#define LIDAR_BURST_MAX		254
+
+/*! \def LIDAR_VELOCITY_DELAY_...
+ *
+ *  Define the period of the velocity stream: 100 ms for 0.1 m/s per count, 10 ms for 1 m/s per count
+ */
+#define LIDAR_VELOCITY_DELAY_SLOW	0xC8
+#define LIDAR_VELOCITY_DELAY_FAST	0x14
+
 // Calibration Register
 // 8bit signed int
 //allows increasing or decreasing the measured value
@@ -123,6 +248,66 @@
  */
 #define MAX_VALUE	4000
 
+/*! \def LIDAR_MAX_RETRIES
+ *
+ *  Define the quantity of NACKed TWI-transactions before a background measure is aborted
+ */
+#define LIDAR_MAX_RETRIES	1000
+
+/*! \def LIDAR_MIN_SAMPLES
+ *
+ *  Define the quantity of samples an average takes at least before it can end early
+ */
+#define LIDAR_MIN_SAMPLES	2
+
+/*! \def LIDAR_FILTER_MEAN
+ *
+ *  Define the filter which averages all samples
+ */
+#define LIDAR_FILTER_MEAN		0
+
+/*! \def LIDAR_FILTER_MEDIAN
+ *
+ *  Define the filter which takes the median of the samples
+ */
+#define LIDAR_FILTER_MEDIAN		1
+
+/*! \def LIDAR_FILTER_TRIMMED
+ *
+ *  Define the filter which averages the samples without the lowest and highest quarter
+ */
+#define LIDAR_FILTER_TRIMMED	2
+
+/*! \def LIDAR_FILTER_REJECT
+ *
+ *  Define the filter which averages the samples within LIDAR_FILTER_WINDOW of the median
+ */
+#define LIDAR_FILTER_REJECT		3
+
+/*! \def LIDAR_FILTER_SIZE
+ *
+ *  Define the peak of samples for the filters except LIDAR_FILTER_MEAN. Longer averages are limited to this count.
+ */
+#define LIDAR_FILTER_SIZE		16
+
+/*! \def LIDAR_FILTER_WINDOW
+ *
+ *  Define the maximum distance of a sample to the median for LIDAR_FILTER_REJECT in cm
+ */
+#define LIDAR_FILTER_WINDOW		10
+
+/*! \def LIDAR_POLL_DELAY_US
+ *
+ *  Define the pause between two polls of the busy bit in blocking functions
+ */
+#define LIDAR_POLL_DELAY_US	50
+
+/*! \def LIDAR_STALL_MS
+ *
+ *  Define the time without a finished transaction after which the background measure is aborted
+ */
+#define LIDAR_STALL_MS		50
+
 
 #include <util/delay.h>
 #include "twi.h"
@@ -132,15 +317,33 @@ void lidar_init();
 uint16_t lidar_getValue();
 uint16_t lidar_getValueAVG(uint16_t count);
 uint16_t lidar_getValueWithoutDCCorrection();
-uint16_t lidar_getValueAVGWithoutDCCorrection(uint8_t count);
+uint16_t lidar_getValueAVGWithoutDCCorrection(uint16_t count);
 void lidar_setVelocityEnable(uint8_t scale);
 void lidar_setVelocityDisable();
 int8_t lidar_getVelocity();
-int8_t lidar_getVelocityAVG(uint8_t count);
+int8_t lidar_getVelocityAVG(uint16_t count);
+uint8_t lidar_startVelocityStream(uint8_t scale);
+uint8_t lidar_pollVelocity(int8_t *velocity, uint32_t *time);
+void lidar_stopVelocityStream();
 void lidar_setDistanceCalibration(int8_t value);
 int8_t lidar_getDistanceCalibration();
 int8_t lidar_writeRegister(uint8_t reg, uint8_t value);
 int8_t lidar_readRegister(uint8_t reg, uint8_t len);
+void lidar_startValueAVG(uint16_t count);
+uint8_t lidar_isReady();
+uint16_t lidar_getResult();
+uint16_t lidar_getUnitResult(uint8_t unit);
+uint8_t lidar_getUnits();
+void lidar_setBurst(uint8_t delay);
+uint8_t lidar_getBurst();
+uint16_t lidar_getLatency(uint16_t *min, uint16_t *avg, uint16_t *max);
+void lidar_resetLatency();
+void lidar_setThreshold(uint8_t threshold);
+uint8_t lidar_getThreshold();
+uint16_t lidar_getSamples();
+void lidar_setFilter(uint8_t filter);
+uint8_t lidar_getFilter();
+uint8_t lidar_waitBusy();
 
 
 #endif /* LIDAR_H_ */
\ No newline at end of file
@@ -27,28 +27,45 @@
 #include "serial.h"
 #include "lidar.h"
 #include "servo.h"
+#include "scan.h"
+#include "command.h"
+#include "timer.h"
+#include "config.h"
 
 /**********************************************************************************************//**
- * @fn	void send_data(char mpos, char sdeg, uint16_t val)
+ * @fn	static void main_link(uint8_t index)
  *
- * @brief	Sends data in the right format.
+ * @brief	Switches the baud rate with the link test and reports the result.
+ *          The firmware falls back to the old baud rate if the host does not follow.
  *
- * @author	Alex
- * @date	22.12.2015
- *
- * @param	mpos	The motor position.
- * @param	sdeg	The servo position.
- * @param	val 	The distance value.
+ * @param	index	Index of the baud rate (see serial_baudRate()).
  **************************************************************************************************/
 
-void send_data(char mpos, char sdeg, uint16_t val){
-	serial_write_string("mpos: ");
-	serial_write_int(mpos);
-	serial_write_string(" sdeg: ");
-	serial_write_int(sdeg);
-	serial_write_string(" val: ");
-	serial_write_int(val);
-	serial_write_string("\r\n");
+static void main_link(uint8_t index)
+{
+	serial_link_t link;
+	uint32_t baud = serial_baudRate(index);
+	if (baud == 0)
+	{
+		serial_write_string_P(PSTR("Unknown baud rate!\r\n"));
+		return;
+	}
+	//The host switches when it receives this line
+	serial_write_string_P(PSTR("Baud = "));
+	serial_write_long(baud);
+	serial_write_string_P(PSTR("\r\n"));
+	serial_link(baud, &link);
+	serial_write_string_P(PSTR("Link baud = "));
+	serial_write_long(serial_getBaud());
+	serial_write_string_P(PSTR(" received = "));
+	serial_write_int(link.received);
+	serial_write_string_P(PSTR(" errors = "));
+	serial_write_int(link.errors);
+	serial_write_string_P(PSTR(" confirmed = "));
+	serial_write_int(link.confirmed);
+	serial_write_string_P(PSTR(" time (us) = "));
+	serial_write_long(link.time);
+	serial_write_string_P(PSTR("\r\n"));
 }
 
 /**********************************************************************************************//**
@@ -69,6 +86,23 @@ void send_data(char mpos, char sdeg, uint16_t val){
  *          #7: Onetime measure of velocity in 1m/s \n
  *          #8 : Onetime measure of velocity in 0.1m/s \n
  *	    #9 x: Set Offset of measurement \n
+ *          #0 x: Set output format (0 = ASCII, 1 = binary, 2 = delta compressed) \n
+ *          #b x: Set burst mode (x = delay between measures, 0 = off) \n
+ *          #l : Acquisition latency (min/avg/max in us), resets the counters \n
+ *          #i x: Set I2C speed (0 = 100 kHz, 1 = 400 kHz) \n
+ *          #e x: End averages early at a standard error of x cm (0 = off) \n
+ *          #f x: Set filter (0 = mean, 1 = median, 2 = trimmed mean, 3 = reject outliers) \n
+ *          #t x: Timestamp of the points in us (0 = off, 1 = on) \n
+ *          #p : Time budget of the last scan (motor/servo/acquisition/serial in us) \n
+ *          #w ms me mk ss se sk: Set scan window (motor start/end/stride, servo start/end/stride) \n
+ *          #o x: Set order of the 3D scan (0 = shortest travel, 1 = rows, 2 = columns) \n
+ *          #m x: Activate monitor mode (2D, only changes of more than x cm, 0 = 10 cm, cancel with #) \n
+ *          #u x: Set baud rate with link test (0 = 56000, 1 = 250000, 2 = 500000, 3 = 1000000) \n
+ *          #v x: Stream velocity with timestamps (0 = 0.1m/s every 100 ms, 1 = 1m/s every 10 ms, cancel with #) \n
+ *          #c x: Configuration in the EEPROM (0 = load, 1 = save, 2 = reset to defaults) \n
+ *          #h x: Set step mode (0 = full steps, 200 positions, 1 = half steps, 400 positions) \n
+ *          #r : Activate rotating mode (360 degrees without turnarounds, frame marker per revolution, cancel with #) \n
+ *          The saved configuration is applied at boot, a saved baud rate is switched with the link test. \n
  *          
  *
  * @author	Alex
@@ -82,110 +116,117 @@ int main(void)
 	wdt_enable(WDTO_2S);
 	uint16_t avg = 10;
 	int16_t v = 0;
-	char stop = 0;
+	config_t config;
 	
 	
 	serial_init();
-	serial_write_string("SERIAL READY!\r\n");
+	serial_write_string_P(PSTR("SERIAL READY!\r\n"));
 	wdt_reset();
 	lidar_init();
-	serial_write_string("TWI READY!\r\n");
+	serial_write_string_P(PSTR("TWI READY!\r\n"));
 	wdt_reset();
 	adc_init();
-	serial_write_string("ADC READY!\r\n");
+	serial_write_string_P(PSTR("ADC READY!\r\n"));
 	wdt_reset();
 	motor_init();
-	serial_write_string("STEPPER READY!\r\n");
+	timer_init();
+	serial_write_string_P(PSTR("STEPPER READY!\r\n"));
 	wdt_reset();
 	servo_init();
-	serial_write_string("SERVO READY!\r\n");
+	serial_write_string_P(PSTR("SERVO READY!\r\n"));
 	wdt_reset();
-	serial_write_string("Calibrating...\r\n");
+	if (config_load(&config))
+	{
+		serial_write_string_P(PSTR("CONFIG LOADED!\r\n"));
+	}
+	else
+	{
+		serial_write_string_P(PSTR("CONFIG DEFAULTS!\r\n"));
+	}
+	config_apply(&config);
+	avg = config.avg;
+	wdt_reset();
+	serial_write_string_P(PSTR("Calibrating...\r\n"));
 	motor_calibrate();
 	wdt_reset();
-	serial_write_string("############################ \r\n");
-	serial_write_string("LIDAR Ready! \r\n");
-	serial_write_string("Type #? for more information.\r\n");
+	if (config.baud != 0)
+	{
+		main_link(config.baud);
+	}
+	serial_write_string_P(PSTR("############################ \r\n"));
+	serial_write_string_P(PSTR("LIDAR Ready! \r\n"));
+	serial_write_string_P(PSTR("LIDAR units = "));
+	serial_write_int(lidar_getUnits());
+	serial_write_string_P(PSTR("\r\n"));
+	serial_write_string_P(PSTR("Type #? for more information.\r\n"));
 	wdt_reset();
 	
 
 	
-	char a;
-	char b;
+	command_t cmd;
 
 	while (1)
 	{
 		wdt_reset();
-		stop = 0;
-		_delay_ms(100);
-		a = serial_read_char();
-		b = serial_read_char();
 		
 		//servo_toPosition(0);
-		if(a == '#')
+		if(command_poll(&cmd))
 		{
-			switch(b){
+			switch(cmd.code){
 				//////////////////////////////////////////////////////////////////////////
 				case '?':
 				wdt_reset();
-				serial_write_string("Possible actions: \r\n");
-				serial_write_string("#? : Help \r\n");
-				serial_write_string("#1 : Onetime measure of distance\r\n");
-				serial_write_string("#2 : Radar mode 2D\r\n");
-				serial_write_string("#3 mmm sss : Set Position of Motor and Servo \r\n");
-				serial_write_string("#4 : Calibration \r\n");
-				serial_write_string("#5 : Radar mode 3D (M first)\r\n");
-				serial_write_string("#6 : Set number of values per measurement (default = 10)\r\n");
-				serial_write_string("#7 : Onetime measure of velocity in 1m/s\r\n");
-				serial_write_string("#8 : Onetime measure of velocity in 10cm/s\r\n");
-				serial_write_string("#9 x: Set Offset of measurement\r\n");
+				serial_write_string_P(PSTR("Possible actions: \r\n"));
+				serial_write_string_P(PSTR("#? : Help \r\n"));
+				serial_write_string_P(PSTR("#1 : Onetime measure of distance\r\n"));
+				serial_write_string_P(PSTR("#2 : Radar mode 2D\r\n"));
+				serial_write_string_P(PSTR("#3 mmm sss : Set Position of Motor and Servo \r\n"));
+				serial_write_string_P(PSTR("#4 : Calibration \r\n"));
+				serial_write_string_P(PSTR("#5 : Radar mode 3D (M first)\r\n"));
+				serial_write_string_P(PSTR("#6 : Set number of values per measurement (default = 10)\r\n"));
+				serial_write_string_P(PSTR("#7 : Onetime measure of velocity in 1m/s\r\n"));
+				serial_write_string_P(PSTR("#8 : Onetime measure of velocity in 10cm/s\r\n"));
+				serial_write_string_P(PSTR("#9 x: Set Offset of measurement\r\n"));
+				serial_write_string_P(PSTR("#0 x: Set output format (0 = ASCII, 1 = binary, 2 = delta compressed)\r\n"));
+				serial_write_string_P(PSTR("#b x: Set burst mode (x = delay between measures, 0 = off)\r\n"));
+				serial_write_string_P(PSTR("#l : Acquisition latency (min/avg/max in us)\r\n"));
+				serial_write_string_P(PSTR("#i x: Set I2C speed (0 = 100 kHz, 1 = 400 kHz)\r\n"));
+				serial_write_string_P(PSTR("#e x: End averages early at a standard error of x cm (0 = off)\r\n"));
+				serial_write_string_P(PSTR("#f x: Set filter (0 = mean, 1 = median, 2 = trimmed mean, 3 = reject outliers)\r\n"));
+				serial_write_string_P(PSTR("#t x: Timestamp of the points in us (0 = off, 1 = on)\r\n"));
+				serial_write_string_P(PSTR("#p : Time budget of the last scan\r\n"));
+				serial_write_string_P(PSTR("#w ms me mk ss se sk: Set scan window (motor start/end/stride, servo start/end/stride)\r\n"));
+				serial_write_string_P(PSTR("#o x: Set order of the 3D scan (0 = shortest travel, 1 = rows, 2 = columns)\r\n"));
+				serial_write_string_P(PSTR("#m x: Monitor mode (2D, only changes of more than x cm)\r\n"));
+				serial_write_string_P(PSTR("#u x: Set baud rate with link test (0 = 56000, 1 = 250000, 2 = 500000, 3 = 1000000)\r\n"));
+				serial_write_string_P(PSTR("#v x: Stream velocity (0 = 0.1m/s every 100 ms, 1 = 1m/s every 10 ms)\r\n"));
+				serial_write_string_P(PSTR("#c x: Configuration (0 = load, 1 = save, 2 = reset to defaults)\r\n"));
+				serial_write_string_P(PSTR("#h x: Set step mode (0 = full steps, 1 = half steps)\r\n"));
+				serial_write_string_P(PSTR("#r : Rotating mode (360 degrees, frame marker per revolution)\r\n"));
 
 				break;
 				//////////////////////////////////////////////////////////////////////////
 				case '1':
-				wdt_reset();
-				serial_write_string("Onetime Measure: \r\n");
-				send_data(motor_get_position(),servo_get_position(),lidar_getValueAVG(avg));
-
-				break;
-				//////////////////////////////////////////////////////////////////////////
-				case '2':
-				wdt_reset();
-				serial_write_string("Radar mode 2D activated! \r\n");
-				while (1)
 				{
 					wdt_reset();
-					if (stop == 1)
-					{
-						break;
-					}
-					if (motor_get_position() == 1)
+					serial_write_string_P(PSTR("Onetime Measure: \r\n"));
+					motor_wait();
+					servo_wait();
+					uint32_t time = timer_micros();
+					lidar_getValueAVG(avg);
+					for (uint8_t unit = 0; unit < lidar_getUnits(); unit++)
 					{
-						for(int i = 0; i<=MOTOR_MAX_STEPS/2;i++ ){
-							wdt_reset();
-							if(serial_read_char() == '#'){
-								motor_calibrate();
-								stop = 1 ;
-								break;
-							}
-							motor_toPosition(i);
-							send_data(motor_get_position(),servo_get_position(),lidar_getValueAVG(avg));
-						}
-					}
-					else
-					{
-						for(int i = MOTOR_MAX_STEPS/2; i>0;i-- ){
-							wdt_reset();
-							if(serial_read_char() == '#'){
-								motor_calibrate();
-								stop = 1 ;
-								break;
-							}
-							motor_toPosition(i);
-							send_data(motor_get_position(),servo_get_position(),lidar_getValueAVG(avg));
-						}
+						send_data(scan_unitPosition(motor_get_position(), unit),servo_get_position(),lidar_getUnitResult(unit),time,unit);
 					}
+					scan_flush();
 				}
+
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case '2':
+				wdt_reset();
+				serial_write_string_P(PSTR("Radar mode 2D activated! \r\n"));
+				scan_run(SCAN_MODE_2D, avg);
 				
 				break;
 				//////////////////////////////////////////////////////////////////////////
@@ -194,9 +235,8 @@ int main(void)
 					wdt_reset();
 					uint16_t m ;
 					uint16_t s ;
-					serial_read_char();
-					m = serial_read_int();
-					s = serial_read_int();
+					m = cmd.args[0];
+					s = cmd.args[1];
 					motor_toPosition(m);
 					servo_toPosition(s);
 					
@@ -205,125 +245,306 @@ int main(void)
 				break;
 				//////////////////////////////////////////////////////////////////////////
 				case '4':
-				motor_calibrate();
-				serial_write_string("Calibrated \r\n");
+				motor_home();
+				serial_write_string_P(PSTR("Calibrated \r\n"));
 				break;
 				//////////////////////////////////////////////////////////////////////////
-				case '5': serial_write_string("Radar mode 3D (M first) activated! \r\n");
-				while (1)
-				{
-					wdt_reset();
-					if (stop == 1)
-					{
-						break;
-					}
-					for (char k = 0; k<= SERVO_MAX_DEG/2 ; k++)
-					{
-						wdt_reset();
-						if (stop == 1)
-						{
-							break;
-						}
-						servo_toPosition(k);
-
-							for(int i = 0; i<=MOTOR_MAX_STEPS/2;i++ ){
-								wdt_reset();
-								if(serial_read_char() == '#'){
-									motor_calibrate();
-									stop = 1 ;
-									break;
-								}
-								motor_toPosition(i);
-								send_data(motor_get_position(),servo_get_position(),lidar_getValueAVG(avg));
-							}
-							k++;
-							servo_toPosition(k);
-						
-							for(int i = MOTOR_MAX_STEPS/2; i>=0;i-- ){
-								wdt_reset();
-								if (stop == 1){break;}
-									
-								if(serial_read_char() == '#'){
-									motor_calibrate();
-									stop = 1 ;
-									break;
-								}
-								motor_toPosition(i);
-								send_data(motor_get_position(),servo_get_position(),lidar_getValueAVG(avg));
-							}
-							
-						
-						
-					}
-				}
+				case '5': serial_write_string_P(PSTR("Radar mode 3D (M first) activated! \r\n"));
+				scan_run(SCAN_MODE_3D, avg);
 				
 				break;
 				//////////////////////////////////////////////////////////////////////////
-				case '6': serial_write_string("#6 : Set number of values per measurement\r\n");
+				case '6': serial_write_string_P(PSTR("#6 : Set number of values per measurement\r\n"));
 
 				wdt_reset();
-				serial_read_char();
-				avg = serial_read_int();
-				serial_write_string("Number of Values = ");
+				avg = cmd.args[0];
+				serial_write_string_P(PSTR("Number of Values = "));
 				serial_write_int(avg);
-				serial_write_string("\r\n");
+				serial_write_string_P(PSTR("\r\n"));
 
 				
 				break;
 				//////////////////////////////////////////////////////////////////////////
-				case '7': serial_write_string("#7 : Onetime measure of velocity in 1m/s\r\n");
+				case '7': serial_write_string_P(PSTR("#7 : Onetime measure of velocity in 1m/s\r\n"));
 
 				wdt_reset();
 				lidar_setVelocityEnable(1);
 				v = lidar_getVelocityAVG(avg);
 				lidar_setVelocityDisable();
-				serial_write_string("Velocity = ");
+				serial_write_string_P(PSTR("Velocity = "));
 				//konvertierung von signed auf unsigned
 				if (v<0)
 				{
 					v = v*(-1);
-					serial_write_string("-");
+					serial_write_string_P(PSTR("-"));
 				}
 				serial_write_int(v);
-				serial_write_string("\r\n");
+				serial_write_string_P(PSTR("\r\n"));
 
 				
 
 				
 				break;
 				//////////////////////////////////////////////////////////////////////////
-				case '8': serial_write_string("#8 : Onetime measure of velocity in 10cm/s\r\n");
+				case '8': serial_write_string_P(PSTR("#8 : Onetime measure of velocity in 10cm/s\r\n"));
 
 				wdt_reset();
 				lidar_setVelocityEnable(0);
 				v = lidar_getVelocityAVG(avg);
 				lidar_setVelocityDisable();
-				serial_write_string("Velocity = ");
+				serial_write_string_P(PSTR("Velocity = "));
 				//converting signed to unsigned
 				if (v<0)
 				{
 					v = v*(-1);
-					serial_write_string("-");
+					serial_write_string_P(PSTR("-"));
 				}
 				serial_write_int(v);
-				serial_write_string("\r\n");
+				serial_write_string_P(PSTR("\r\n"));
 
 				
 				break;
 				//////////////////////////////////////////////////////////////////////////
-				case '9': serial_write_string("#9 x: Set Offset of measurement\r\n");
+				case '9': serial_write_string_P(PSTR("#9 x: Set Offset of measurement\r\n"));
 
 				wdt_reset();
-				serial_read_char();
-				int16_t offset = serial_read_int();
+				int16_t offset = cmd.args[0];
 				lidar_setDistanceCalibration(offset);
-				serial_write_string("Offset = ");
+				serial_write_string_P(PSTR("Offset = "));
 				serial_write_int(lidar_getDistanceCalibration());
-				serial_write_string("\r\n");
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case '0': serial_write_string_P(PSTR("#0 x: Set output format\r\n"));
+
+				wdt_reset();
+				scan_setFormat(cmd.args[0]);
+				serial_write_string_P(PSTR("Format = "));
+				serial_write_int(scan_getFormat());
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'b': serial_write_string_P(PSTR("#b x: Set burst mode\r\n"));
+
+				wdt_reset();
+				lidar_setBurst(cmd.args[0]);
+				serial_write_string_P(PSTR("Burst delay = "));
+				serial_write_int(lidar_getBurst());
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'l':
+				{
+					wdt_reset();
+					uint16_t min;
+					uint16_t mean;
+					uint16_t max;
+					uint16_t n = lidar_getLatency(&min, &mean, &max);
+					lidar_resetLatency();
+					serial_write_string_P(PSTR("Latency (us) n = "));
+					serial_write_int(n);
+					serial_write_string_P(PSTR(" min = "));
+					serial_write_int(min);
+					serial_write_string_P(PSTR(" avg = "));
+					serial_write_int(mean);
+					serial_write_string_P(PSTR(" max = "));
+					serial_write_int(max);
+					serial_write_string_P(PSTR("\r\n"));
+				}
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'i': serial_write_string_P(PSTR("#i x: Set I2C speed\r\n"));
+
+				wdt_reset();
+				//Do not switch in the middle of a background measure
+				while (!lidar_isReady())
+				{
+				}
+				twi_setSpeed(cmd.args[0]);
+				serial_write_string_P(PSTR("Speed = "));
+				serial_write_int(twi_getSpeed());
+				serial_write_string_P(PSTR(" Errors = "));
+				serial_write_int(twi_getErrors());
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'e': serial_write_string_P(PSTR("#e x: Set early exit of averages\r\n"));
+
+				wdt_reset();
+				lidar_setThreshold(cmd.args[0]);
+				serial_write_string_P(PSTR("Standard error = "));
+				serial_write_int(lidar_getThreshold());
+				serial_write_string_P(PSTR(" Samples of last measure = "));
+				serial_write_int(lidar_getSamples());
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'f': serial_write_string_P(PSTR("#f x: Set filter\r\n"));
+
+				wdt_reset();
+				lidar_setFilter(cmd.args[0]);
+				serial_write_string_P(PSTR("Filter = "));
+				serial_write_int(lidar_getFilter());
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 't': serial_write_string_P(PSTR("#t x: Set timestamp\r\n"));
+
+				wdt_reset();
+				scan_setTimestamp(cmd.args[0]);
+				serial_write_string_P(PSTR("Timestamp = "));
+				serial_write_int(scan_getTimestamp());
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'p':
+				{
+					wdt_reset();
+					const scan_profile_t *profile = scan_getProfile();
+					serial_write_string_P(PSTR("Profile (us) points = "));
+					serial_write_int(profile->points);
+					serial_write_string_P(PSTR(" total = "));
+					serial_write_long(profile->total);
+					serial_write_string_P(PSTR("\r\n motor = "));
+					serial_write_long(profile->phase[SCAN_PHASE_MOTOR]);
+					serial_write_string_P(PSTR(" servo = "));
+					serial_write_long(profile->phase[SCAN_PHASE_SERVO]);
+					serial_write_string_P(PSTR(" acquisition = "));
+					serial_write_long(profile->phase[SCAN_PHASE_ACQUISITION]);
+					serial_write_string_P(PSTR(" serial = "));
+					serial_write_long(profile->phase[SCAN_PHASE_SERIAL]);
+					serial_write_string_P(PSTR("\r\n"));
+				}
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'w':
+				{
+					wdt_reset();
+					scan_setWindow(cmd.args);
+					const scan_window_t *window = scan_getWindow();
+					serial_write_string_P(PSTR("Window motor = "));
+					serial_write_int(window->mstart);
+					serial_write_string_P(PSTR(".."));
+					serial_write_int(window->mend);
+					serial_write_string_P(PSTR(" / "));
+					serial_write_int(window->mstride);
+					serial_write_string_P(PSTR(" servo = "));
+					serial_write_int(window->sstart);
+					serial_write_string_P(PSTR(".."));
+					serial_write_int(window->send);
+					serial_write_string_P(PSTR(" / "));
+					serial_write_int(window->sstride);
+					serial_write_string_P(PSTR("\r\n"));
+				}
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'o': serial_write_string_P(PSTR("#o x: Set order\r\n"));
+
+				wdt_reset();
+				scan_setOrder(cmd.args[0]);
+				serial_write_string_P(PSTR("Order = "));
+				serial_write_int(scan_getOrder());
+				serial_write_string_P(PSTR(" Travel (ms) rows = "));
+				serial_write_long(scan_estimate(SCAN_ORDER_ROWS) / 1000);
+				serial_write_string_P(PSTR(" columns = "));
+				serial_write_long(scan_estimate(SCAN_ORDER_COLUMNS) / 1000);
+				serial_write_string_P(PSTR("\r\n"));
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'm': serial_write_string_P(PSTR("Monitor mode activated! \r\n"));
+
+				wdt_reset();
+				scan_setMonitorThreshold(cmd.args[0]);
+				serial_write_string_P(PSTR("Threshold = "));
+				serial_write_int(scan_getMonitorThreshold());
+				serial_write_string_P(PSTR("\r\n"));
+				scan_run(SCAN_MODE_MONITOR, avg);
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'r': serial_write_string_P(PSTR("Rotating mode activated! \r\n"));
+
+				wdt_reset();
+				scan_rotate(avg);
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'v': serial_write_string_P(PSTR("Velocity stream activated! \r\n"));
+
+				wdt_reset();
+				scan_velocity(cmd.args[0] != 0);
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'u':
+				wdt_reset();
+				main_link(cmd.args[0]);
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'c': serial_write_string_P(PSTR("#c x: Configuration\r\n"));
+
+				wdt_reset();
+				switch (cmd.args[0])
+				{
+					case CONFIG_LOAD:
+					//The baud rate is only switched at boot
+					if (config_load(&config))
+					{
+						serial_write_string_P(PSTR("Config = loaded\r\n"));
+					}
+					else
+					{
+						serial_write_string_P(PSTR("Config = defaults\r\n"));
+					}
+					config_apply(&config);
+					avg = config.avg;
+					break;
+
+					case CONFIG_SAVE:
+					config_read(&config, avg);
+					config_save(&config);
+					serial_write_string_P(PSTR("Config = saved\r\n"));
+					break;
+
+					case CONFIG_RESET:
+					config_erase();
+					config_defaults(&config);
+					config_apply(&config);
+					avg = config.avg;
+					serial_write_string_P(PSTR("Config = defaults\r\n"));
+					break;
+
+					default:
+					serial_write_string_P(PSTR("Unknown action!\r\n"));
+				}
+				
+				break;
+				//////////////////////////////////////////////////////////////////////////
+				case 'h': serial_write_string_P(PSTR("#h x: Set step mode\r\n"));
+
+				wdt_reset();
+				motor_set_mode(cmd.args[0]);
+				serial_write_string_P(PSTR("Step mode = "));
+				serial_write_int(motor_get_mode());
+				serial_write_string_P(PSTR(" Positions = "));
+				serial_write_int(motor_get_positions());
+				serial_write_string_P(PSTR("\r\n"));
 				
 				break;
 				//////////////////////////////////////////////////////////////////////////
-				default: serial_write_string("Unknown code!\r\n");
+				default: serial_write_string_P(PSTR("Unknown code!\r\n"));
 			}
 		}
 	}
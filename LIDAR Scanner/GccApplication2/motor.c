@@ -10,13 +10,101 @@
 #include <util/delay.h>
 #include <assert.h>
 #include <avr/wdt.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stddef.h>
 
-/** @brief	Last done step (0-3). */
+/** @brief	Last done step, index into the phase table of the step mode. */
 char step = 0;
 /** @brief	The motor position. */
-char motor_position = 0;
+uint16_t motor_position = 0;
+/** @brief	The step mode, MOTOR_MODE_FULL or MOTOR_MODE_HALF. */
+static char motor_mode = MOTOR_MODE_FULL;
+/** @brief	Time between steps at full speed of the step mode in timer2 ticks (fixed point 8.8). */
+static uint16_t motor_intervalMin = MOTOR_INTERVAL_MIN;
 /** @brief	The time between steps. */
 char speed = T_STEP;
+/** @brief	The maximum power output in %. */
+static char motor_power = POWER;
+/** @brief	Direction of the running move. */
+static volatile char motor_dir = CW;
+/** @brief	Remaining steps of the running move. */
+static volatile uint16_t motor_remaining = 0;
+/** @brief	Steps done in the acceleration ramp. */
+static volatile uint8_t motor_rampSteps = 0;
+/** @brief	Actual time between steps in timer2 ticks (fixed point 8.8). */
+static volatile uint16_t motor_interval = 0;
+/** @brief	1 if no move is running and the stepper has settled. */
+static volatile char motor_done = 1;
+/** @brief	Learned values of the homing. */
+static motor_home_t motor_homeData;
+/** @brief	1 if the position is valid since the last calibration. */
+static char motor_homed = 0;
+/** @brief	1 while the stepper spins without end. */
+static volatile char motor_endless = 0;
+/** @brief	Compare matches of timer2 per step, more than 1 for spins slower than the timer. */
+static uint8_t motor_divider = 1;
+/** @brief	Compare matches until the next step. */
+static volatile uint8_t motor_countdown = 1;
+/** @brief	1 while the light barrier is read around the index. */
+static char motor_syncActive = 0;
+/** @brief	Lowest value of the light barrier around the index. */
+static uint16_t motor_syncMin = 0xFFFF;
+/** @brief	Position of the lowest value, relative to the index. */
+static int8_t motor_syncAt = 0;
+/** @brief	Correction of the last pass of the index. */
+static volatile int8_t motor_sync = MOTOR_SYNC_NONE;
+
+/**********************************************************************************************//**
+ * @def	MOTOR_COILS_D();
+ *
+ * @brief	A macro that defines the coil pins on PORTD.
+ **************************************************************************************************/
+
+#define MOTOR_COILS_D	((1<<MOTA1) | (1<<MOTA2) | (1<<MOTB2))
+
+/**********************************************************************************************//**
+ * @def	MOTOR_COILS_B();
+ *
+ * @brief	A macro that defines the coil pins on PORTB.
+ **************************************************************************************************/
+
+#define MOTOR_COILS_B	(1<<MOTB1)
+
+/**********************************************************************************************//**
+ * @struct	motor_phase_t
+ *
+ * @brief	Levels of the coil pins of one phase.
+ **************************************************************************************************/
+
+typedef struct {
+	uint8_t d;	//Pins of MOTOR_COILS_D
+	uint8_t b;	//Pins of MOTOR_COILS_B
+} motor_phase_t;
+
+/** @brief	Full step sequence, both coils are powered. */
+static const motor_phase_t motor_fullSteps[4] = {
+	{(1<<MOTA1), (1<<MOTB1)},
+	{(1<<MOTA1) | (1<<MOTB2), 0},
+	{(1<<MOTA2) | (1<<MOTB2), 0},
+	{(1<<MOTA2), (1<<MOTB1)}
+};
+
+/** @brief	Half step sequence, every second phase powers only one coil. The even phases are the full steps. */
+static const motor_phase_t motor_halfSteps[8] = {
+	{(1<<MOTA1), (1<<MOTB1)},
+	{(1<<MOTA1), 0},
+	{(1<<MOTA1) | (1<<MOTB2), 0},
+	{(1<<MOTB2), 0},
+	{(1<<MOTA2) | (1<<MOTB2), 0},
+	{(1<<MOTA2), 0},
+	{(1<<MOTA2), (1<<MOTB1)},
+	{0, (1<<MOTB1)}
+};
+
+/** @brief	Phase table per step mode. */
+static const motor_phase_t * const motor_sequences[2] = {motor_fullSteps, motor_halfSteps};
 
 /**********************************************************************************************//**
  * @fn	void _sleep_ms(int ms)
@@ -41,7 +129,7 @@ void _sleep_ms(int ms){
 /**********************************************************************************************//**
  * @fn	void motor_timer_init(void)
  *
- * @brief	Initialises the timer0 for the power control. 
+ * @brief	Initialises the timer0 for the power control and the timer2 for the step generation. 
  *
  * @author	Alex
  * @date	22.12.2015
@@ -53,12 +141,86 @@ void motor_timer_init(void){
 	
 	OCR0A = (255/100) * POWER;
 	OCR0B = (255/100) * POWER;
+
+	//Timer2 CTC, started by a move
+	TCCR2A = (1<<WGM21);
+	TCCR2B = 0;
+	TIMSK2 |= (1<<OCIE2A);
+}
+
+/**********************************************************************************************//**
+ * @fn	static uint8_t motor_homeCrc(void)
+ *
+ * @brief	Returns the CRC8 of the homing record without the CRC itself.
+ **************************************************************************************************/
+
+static uint8_t motor_homeCrc(void){
+	uint8_t crc = 0;
+	const uint8_t *data = (const uint8_t*)&motor_homeData;
+	for (uint8_t i = 0; i < offsetof(motor_home_t, crc); i++)
+	{
+		crc = _crc8_ccitt_update(crc, data[i]);
+	}
+	return crc;
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_loadHome(void)
+ *
+ * @brief	Reads the homing record out of the EEPROM, an invalid record is replaced by the defaults.
+ **************************************************************************************************/
+
+static void motor_loadHome(void){
+	eeprom_read_block(&motor_homeData, (const void*)MOTOR_HOME_EEPROM, sizeof(motor_homeData));
+	if (motor_homeData.version != MOTOR_HOME_VERSION || motor_homeData.crc != motor_homeCrc())
+	{
+		motor_homeData.version = MOTOR_HOME_VERSION;
+		motor_homeData.top = MOTOR_INDEX_TOP;
+		motor_homeData.offset = 0;
+		motor_homeData.phase = MOTOR_PHASE_UNKNOWN;
+	}
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_saveHome(void)
+ *
+ * @brief	Writes the homing record to the EEPROM. Only changed bytes are written.
+ **************************************************************************************************/
+
+static void motor_saveHome(void){
+	motor_homeData.crc = motor_homeCrc();
+	eeprom_update_block(&motor_homeData, (void*)MOTOR_HOME_EEPROM, sizeof(motor_homeData));
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_coils(char s)
+ *
+ * @brief	Sets the pins of the coils for a phase of the step mode, with one write per port.
+ *
+ * @param	s	Phase (0-3 for full steps, 0-7 for half steps).
+ **************************************************************************************************/
+
+static void motor_coils(char s){
+	const motor_phase_t *phase = &motor_sequences[(uint8_t)motor_mode][(uint8_t)s];
+	//The port which switches a pin on is written first. Between both writes a coil brakes with both pins high,
+	//with both pins low it would be a half step in between.
+	if (phase->b)
+	{
+		PORTB = (PORTB & ~MOTOR_COILS_B) | phase->b;
+		PORTD = (PORTD & ~MOTOR_COILS_D) | phase->d;
+	}
+	else
+	{
+		PORTD = (PORTD & ~MOTOR_COILS_D) | phase->d;
+		PORTB = (PORTB & ~MOTOR_COILS_B) | phase->b;
+	}
 }
 
 /**********************************************************************************************//**
  * @fn	void motor_init(void)
  *
- * @brief	Initialises all used pins as output and calls motor_timer_init()
+ * @brief	Initialises all used pins as output, calls motor_timer_init() and loads the learned homing values.
+ *          The coils start with the phase of the index, so a rotor parked there does not move.
  *
  * @author	Alex
  * @date	22.12.2015
@@ -67,6 +229,13 @@ void motor_timer_init(void){
 void motor_init(void){
 	DDRD |= (1<<PWMA) | (1<<PWMB) | (1<<MOTA1) | (1<<MOTA2)  | (1<<MOTB2) | (1<<STBY);
 	DDRB |= (1<<MOTB1);
+	motor_loadHome();
+	if (motor_homeData.phase != MOTOR_PHASE_UNKNOWN)
+	{
+		step = motor_homeData.phase << motor_mode;
+	}
+	//The driver starts with a full step, not with the state between the writes of the ports
+	motor_coils(step);
 	PORTD |= (1<<PWMA) | (1<<PWMB) | (1<<STBY);
 
 
@@ -75,10 +244,132 @@ void motor_init(void){
 }
 
 /**********************************************************************************************//**
- * @fn	void motor_turn(char steps,char dir)
+ * @fn	static void motor_step(char dir)
+ *
+ * @brief	Sets the pins to rotate the stepper by one step in the desired direction.
+ *
+ * @param	dir	Direction (CW or CCW).
+ **************************************************************************************************/
+
+static void motor_step(char dir){
+	uint16_t positions = motor_get_positions();
+	//The phase goes backwards for CCW, so a change of the direction does not skip a phase
+	step = (step + dir) & ((4 << motor_mode) - 1);
+	if (dir == CW)
+	{
+		motor_position = (motor_position == positions-1) ? 0 : motor_position+1;
+	}
+	else
+	{
+		motor_position = (motor_position == 0) ? positions-1 : motor_position-1;
+	}
+	motor_coils(step);
+}
+
+/**********************************************************************************************//**
+ * @fn	static uint16_t motor_startInterval(void)
+ *
+ * @brief	Returns the time between steps at standstill (speed) of the step mode in timer2 ticks (fixed point 8.8).
+ **************************************************************************************************/
+
+static uint16_t motor_startInterval(void){
+	uint32_t ticks = ((uint32_t)speed * 1000 + MOTOR_TICK_US - 1) / MOTOR_TICK_US;
+	if (ticks > 255)
+	{
+		ticks = 255;
+	}
+	//Half steps come twice as often. A slow spin starts with its own time.
+	uint16_t interval = ((uint16_t)ticks << 8) >> motor_mode;
+	return interval < motor_intervalMin ? motor_intervalMin : interval;
+}
+
+/**********************************************************************************************//**
+ * @fn	static uint16_t motor_ramp(uint16_t interval, uint16_t remaining, uint8_t *rampSteps)
+ *
+ * @brief	Calculates the time to the next step.
+ *          The ramp follows c(n) = c(n-1) - 2*c(n-1)/(4n+1) from the start interval down to T_STEP_MIN_US
+ *          (half of it for half steps) and back up again when the remaining steps are as many as the ramp steps. 
+ *          After the last step the start interval is used to let the stepper settle.
+ *
+ * @param	interval 	Time since the last step in timer2 ticks (fixed point 8.8).
+ * @param	remaining	Remaining steps after the last step.
+ * @param	rampSteps	Steps done in the acceleration ramp, updated.
+ *
+ * @return	Time to the next step in timer2 ticks (fixed point 8.8).
+ **************************************************************************************************/
+
+static uint16_t motor_ramp(uint16_t interval, uint16_t remaining, uint8_t *rampSteps){
+	if (remaining == 0)
+	{
+		interval = motor_startInterval();
+	}
+	else if (remaining <= *rampSteps)
+	{
+		//Deceleration
+		interval += (interval / (4 * *rampSteps - 1)) << 1;
+		(*rampSteps)--;
+	}
+	else if (interval > motor_intervalMin)
+	{
+		//Acceleration
+		(*rampSteps)++;
+		interval -= (interval / (4 * *rampSteps + 1)) << 1;
+		if (interval < motor_intervalMin)
+		{
+			interval = motor_intervalMin;
+		}
+	}
+	return interval;
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_next(void)
+ *
+ * @brief	Does the next step of the running move and calculates the time to the following one.
+ **************************************************************************************************/
+
+static void motor_next(void){
+	uint8_t rampSteps = motor_rampSteps;
+	motor_step(motor_dir);
+	if (!motor_endless)
+	{
+		motor_remaining--;
+	}
+	motor_interval = motor_ramp(motor_interval, motor_remaining, &rampSteps);
+	motor_rampSteps = rampSteps;
+	OCR2A = (motor_interval >> 8) - 1;
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_start(uint16_t steps, char dir)
+ *
+ * @brief	Waits for the running move and starts a new one. The first step is done immediately.
+ *
+ * @param	steps	Number of steps (at least 1).
+ * @param	dir  	Direction (CW or CCW).
+ **************************************************************************************************/
+
+static void motor_start(uint16_t steps, char dir){
+	motor_wait();
+	cli();
+	motor_done = 0;
+	motor_dir = dir;
+	motor_remaining = steps;
+	motor_rampSteps = 0;
+	motor_interval = motor_startInterval();
+	motor_countdown = motor_divider;
+	motor_next();
+	TCNT2 = 0;
+	TIFR2 = (1<<OCF2A);
+	TCCR2B = (1<<CS22) | (1<<CS21) | (1<<CS20);
+	sei();
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_turn(uint16_t steps,char dir)
  *
  * @brief	Turn Stepper for some steps in the desired direction.
- *          Based on the last step, this function sets the pins to rotate the stepper by one step.
+ *          The steps are generated by the timer2, this function waits until the stepper has settled.
  * 
  *
  * @author	Alex
@@ -88,91 +379,37 @@ void motor_init(void){
  * @param	dir  	Direction (CW or CCW).
  **************************************************************************************************/
 
-void motor_turn(char steps,char dir){
-	for (char s = 0; s<steps ; s++)
+void motor_turn(uint16_t steps,char dir){
+	if (steps == 0)
 	{
-		step = (step + 1) % 4;
-		if (dir == CW)
-		{
-			motor_position = (motor_position+1) % MOTOR_MAX_STEPS;
-			switch (step)
-			{
-				case 0:
-				PORTD |= (1<<MOTA1);
-				PORTB |= (1<<MOTB1);
-				PORTD &=  ~((1<<MOTA2) | (1<<MOTB2));
-				break;
-				case 1:
-				PORTD |= (1<<MOTA1) | (1<<MOTB2);
-				PORTD &=  ~(1<<MOTA2);
-				PORTB &= ~(1<<MOTB1);
-				break;
-				case 2:
-				PORTD |= (1<<MOTA2)  | (1<<MOTB2);
-				PORTD &=  ~(1<<MOTA1);
-				PORTB &= ~(1<<MOTB1);
-				break;
-				case 3:
-				PORTD |=  (1<<MOTA2);
-				PORTB |= (1<<MOTB1);
-				PORTD &=  ~((1<<MOTA1) | (1<<MOTB2));
-				break;
-			}
-		}
-		else
-		{
-			motor_position = (motor_position-1) % MOTOR_MAX_STEPS;
-			switch (step)
-			{
-				case 0:
-				PORTD |= (1<<MOTA2);
-				PORTB |= (1<<MOTB1);
-				PORTD &=  ~((1<<MOTA1) | (1<<MOTB2));
-				break;
-				case 1:
-				PORTD |= (1<<MOTA2) | (1<<MOTB2);
-				PORTD &=  ~(1<<MOTA1);
-				PORTB &= ~(1<<MOTB1);
-				break;
-				case 2:
-				PORTD |= (1<<MOTA1)  | (1<<MOTB2);
-				PORTD &=  ~(1<<MOTA2);
-				PORTB &= ~(1<<MOTB1);
-				break;
-				case 3:
-				PORTD |=  (1<<MOTA1);
-				PORTB |= (1<<MOTB1);
-				PORTD &=  ~((1<<MOTA2) | (1<<MOTB2));
-				break;
-			}
-		}
-		
-		_sleep_ms(speed);
-		
+		return;
 	}
-	
+	motor_start(steps, dir);
+	motor_wait();
 }
 
 /**********************************************************************************************//**
- * @fn	void motor_toPosition(char p)
+ * @fn	void motor_toPosition(uint16_t p)
  *
- * @brief	Turns motor to the defined position.
+ * @brief	Starts a move to the defined position and returns immediately.
+ *          A running move is finished first. Use motor_isDone() or motor_wait() to wait for the stepper.
  *
  * @author	Alex
  * @date	22.12.2015
  *
- * @param	p	The char to process.
+ * @param	p	The position (0 to motor_get_positions() - 1).
  **************************************************************************************************/
 
-void motor_toPosition(char p){
-	p = p % MOTOR_MAX_STEPS;
+void motor_toPosition(uint16_t p){
+	p = p % motor_get_positions();
+	motor_wait();
 	if (motor_position > p )
 	{
-		motor_turn(motor_position-p,CCW);
+		motor_start(motor_position-p,CCW);
 	}
 	else if (motor_position < p)
 	{
-		motor_turn(p-motor_position,CW);
+		motor_start(p-motor_position,CW);
 	}
 	else
 	{
@@ -180,6 +417,53 @@ void motor_toPosition(char p){
 	}
 }
 
+/**********************************************************************************************//**
+ * @fn	uint32_t motor_moveTime(uint16_t steps)
+ *
+ * @brief	Returns the time a move needs in the actual step mode, with the ramp and the settle time.
+ *
+ * @param	steps	Number of steps.
+ *
+ * @return	Time in us.
+ **************************************************************************************************/
+
+uint32_t motor_moveTime(uint16_t steps){
+	uint16_t interval = motor_startInterval();
+	uint8_t rampSteps = 0;
+	uint32_t ticks = 0;
+	while (steps > 0)
+	{
+		steps--;
+		interval = motor_ramp(interval, steps, &rampSteps);
+		ticks += interval >> 8;
+	}
+	return ticks * MOTOR_TICK_US;
+}
+
+/**********************************************************************************************//**
+ * @fn	char motor_isDone(void)
+ *
+ * @brief	Checks if the move is done and the stepper has settled.
+ *
+ * @return	1 if the stepper has settled, else 0.
+ **************************************************************************************************/
+
+char motor_isDone(void){
+	return motor_done;
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_wait(void)
+ *
+ * @brief	Waits until the move is done and the stepper has settled.
+ **************************************************************************************************/
+
+void motor_wait(void){
+	while (!motor_done)
+	{
+	}
+}
+
 /**********************************************************************************************//**
  * @fn	void motor_set_speed(char t)
  *
@@ -211,12 +495,100 @@ void motor_set_speed(char t){
 void motor_set_power(char power){
 	assert(power >= 0 && power <=100);
 	
+	motor_power = power;
 	OCR0A = (255/100) * power;
 	OCR0B = (255/100) * power;
 }
 
 /**********************************************************************************************//**
- * @fn	void motor_set_position(char pos)
+ * @fn	char motor_get_speed(void)
+ *
+ * @brief	Returns the time between steps at standstill.
+ *
+ * @return	Time in ms.
+ **************************************************************************************************/
+
+char motor_get_speed(void){
+	return speed;
+}
+
+/**********************************************************************************************//**
+ * @fn	char motor_get_power(void)
+ *
+ * @brief	Returns the maximum power output.
+ *
+ * @return	Power in %.
+ **************************************************************************************************/
+
+char motor_get_power(void){
+	return motor_power;
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_set_mode(char mode)
+ *
+ * @brief	Change the step mode. Waits for the running move, the position is converted to the new mode.
+ *          A half step between two full steps goes on to the next full step.
+ *          The time between steps is halved in the half step mode, so the speed of the rotor stays the same.
+ *
+ * @param	mode	MOTOR_MODE_FULL or MOTOR_MODE_HALF.
+ **************************************************************************************************/
+
+void motor_set_mode(char mode){
+	if (mode != MOTOR_MODE_HALF)
+	{
+		mode = MOTOR_MODE_FULL;
+	}
+	motor_wait();
+	if (mode == motor_mode)
+	{
+		return;
+	}
+	if (mode == MOTOR_MODE_FULL)
+	{
+		//Only the even half steps power both coils. Phase and position are odd together.
+		if (step & 1)
+		{
+			motor_turn(1, CW);
+		}
+		step >>= 1;
+		motor_position >>= 1;
+	}
+	else
+	{
+		step <<= 1;
+		motor_position <<= 1;
+	}
+	motor_mode = mode;
+	motor_intervalMin = MOTOR_INTERVAL_MIN >> mode;
+}
+
+/**********************************************************************************************//**
+ * @fn	char motor_get_mode(void)
+ *
+ * @brief	Returns the step mode.
+ *
+ * @return	MOTOR_MODE_FULL or MOTOR_MODE_HALF.
+ **************************************************************************************************/
+
+char motor_get_mode(void){
+	return motor_mode;
+}
+
+/**********************************************************************************************//**
+ * @fn	uint16_t motor_get_positions(void)
+ *
+ * @brief	Returns the positions per rotation of the step mode.
+ *
+ * @return	MOTOR_MAX_STEPS in the full step mode, MOTOR_MAX_POSITIONS in the half step mode.
+ **************************************************************************************************/
+
+uint16_t motor_get_positions(void){
+	return MOTOR_MAX_STEPS << motor_mode;
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_set_position(uint16_t pos)
  *
  * @brief	Set the position of the stepper (only in software).
  *
@@ -226,78 +598,359 @@ void motor_set_power(char power){
  * @param	pos	The position.
  **************************************************************************************************/
 
-void motor_set_position(char pos){
+void motor_set_position(uint16_t pos){
 	motor_position = pos;
 }
 
 /**********************************************************************************************//**
- * @fn	char motor_get_position(void)
+ * @fn	uint16_t motor_get_position(void)
  *
- * @brief	Returns the actual motor position.
+ * @brief	Returns the actual motor position. The position is read atomically, the stepper may be spinning.
  *
  * @author	Alex
  * @date	22.12.2015
  *
- * @return	Motor position in steps.
+ * @return	Motor position in positions of the step mode.
  **************************************************************************************************/
 
-char motor_get_position(void){
-	return motor_position;
+uint16_t motor_get_position(void){
+	uint16_t p;
+	uint8_t sreg = SREG;
+	cli();
+	p = motor_position;
+	SREG = sreg;
+	return p;
 }
 
 /**********************************************************************************************//**
- * @fn	void motor_calibrate()
+ * @fn	static int16_t motor_distance(uint16_t from, uint16_t to)
  *
- * @brief	Calibrates motor position.
- *          This function reads the value of the adc pin of the light barrier. 
- *          The motor is in the right position if the value is lower than 40.
- *          If it is higher, it rotates the stepper in CW direction for 100 steps (180). 
- *          Then it returns to zero and rotates in CCW direction for 100 steps (180) till the value is below 40.
- *          
+ * @brief	Returns the shortest way between two positions of the step mode, positive for CW.
+ **************************************************************************************************/
+
+static int16_t motor_distance(uint16_t from, uint16_t to){
+	int16_t positions = motor_get_positions();
+	int16_t d = ((int16_t)to - (int16_t)from + positions) % positions;
+	return (d > positions/2) ? d - positions : d;
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_go(uint16_t p)
  *
- * @author	Alex
- * @date	22.12.2015
+ * @brief	Moves the shortest way to the position, also across position 0, and waits for the stepper.
  **************************************************************************************************/
 
-void motor_calibrate(){
-	uint16_t a;
-	char p = 0;
-	char top = 60;
-	int8_t d = CW;
-	while (1)
+static void motor_go(uint16_t p){
+	motor_wait();
+	int16_t d = motor_distance(motor_position, p);
+	motor_turn(d < 0 ? -d : d, d < 0 ? CCW : CW);
+}
+
+/**********************************************************************************************//**
+ * @fn	static char motor_sweep(uint8_t *hit, uint8_t *darkest, uint16_t *min)
+ *
+ * @brief	Fast phase of the homing. Turns CW with the ramp for one turn and reads the light barrier meanwhile.
+ *          At the first value below the threshold the stepper decelerates.
+ *
+ * @param	hit    	Position of the first value below the threshold.
+ * @param	darkest	Position of the lowest value.
+ * @param	min    	Lowest value.
+ *
+ * @return	1 if a value below the threshold was found, else 0.
+ **************************************************************************************************/
+
+static char motor_sweep(uint8_t *hit, uint8_t *darkest, uint16_t *min){
+	*min = 0xFFFF;
+	motor_start(MOTOR_MAX_STEPS, CW);
+	while (!motor_done)
+	{
+		wdt_reset();
+		uint16_t a = adc_read();
+		uint8_t p = motor_position;
+		if (a < *min)
+		{
+			*min = a;
+			*darkest = p;
+		}
+		if (a <= motor_homeData.top)
+		{
+			*hit = p;
+			//Stop with the deceleration ramp, so no step is lost
+			cli();
+			if (motor_remaining > motor_rampSteps)
+			{
+				motor_remaining = motor_rampSteps;
+			}
+			sei();
+			motor_wait();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**********************************************************************************************//**
+ * @fn	static uint16_t motor_approach(uint8_t p)
+ *
+ * @brief	Slow phase of the homing. Checks the steps around the expected index one by one at T_STEP
+ *          and stops at the step with the lowest value.
+ *
+ * @param	p	Expected index.
+ *
+ * @return	Value of the light barrier at the index.
+ **************************************************************************************************/
+
+static uint16_t motor_approach(uint8_t p){
+	uint16_t min = 0xFFFF;
+	uint8_t best = p;
+	motor_go((p + MOTOR_MAX_STEPS - MOTOR_HOME_WINDOW) % MOTOR_MAX_STEPS);
+	for (uint8_t i = 0; i <= 2*MOTOR_HOME_WINDOW; i++)
 	{
 		wdt_reset();
-		
-		a = adc_read_avg(5);
-		//a= adc_read_avg(3);
-		
-		//serial_write_int(a); //debug infos
-		//serial_write_string("\r\n");
-		if (a<=top)
+		if (i > 0)
 		{
-			
-			//motor_turn(2,d);
-			motor_set_position(MOTOR_MAX_STEPS/4);
-			return;
+			motor_turn(1, CW);
 		}
-		
-		if(d==CW)
+		uint16_t a = adc_read_avg(5);
+		if (a < min)
 		{
-			motor_turn(1,CW);
-			p++;
+			min = a;
+			best = motor_position;
 		}
-		else
+	}
+	motor_go(best);
+	return min;
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_calibrate()
+ *
+ * @brief	Calibrates motor position.
+ *          If the position is known, the stepper moves straight to the index, else it checks the place where
+ *          it stands (the index after a clean stop). If the light barrier confirms the index, the
+ *          calibration is done, else motor_home() searches the index.
+ *          Without a learned phase the first field may have moved the rotor away from the index, so it is searched.
+ *          The index is a quarter turn in every step mode.
+ *
+ * @author	Alex
+ * @date	22.12.2015
+ **************************************************************************************************/
+
+void motor_calibrate(){
+	wdt_reset();
+	if (motor_homed)
+	{
+		motor_go(motor_get_positions()/4);
+	}
+	else if (motor_homeData.phase == MOTOR_PHASE_UNKNOWN)
+	{
+		motor_home();
+		return;
+	}
+	else
+	{
+		//Hold the rotor before it is checked, the first step would be lost else
+		motor_coils(step);
+		_sleep_ms(T_STEP);
+	}
+	if (adc_read_avg(5) <= motor_homeData.top)
+	{
+		motor_set_position(motor_get_positions()/4);
+		motor_homed = 1;
+		return;
+	}
+	motor_home();
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_home()
+ *
+ * @brief	Searches the index in two phases.
+ *          A fast sweep of up to one turn stops at the first value of the light barrier below the threshold.
+ *          Then the stepper approaches the index with single slow steps and takes the step with the lowest value.
+ *          The threshold and the offset between both phases are learned and kept in the EEPROM,
+ *          together with the phase of the coils at the index for the next power up.
+ *          If the sweep finds no value below the threshold, the lowest value of the turn is taken.
+ *          The search runs in full steps, so the learned values do not depend on the step mode.
+ **************************************************************************************************/
+
+void motor_home(){
+	uint8_t hit = 0;
+	uint8_t darkest = 0;
+	uint16_t min;
+	uint16_t top;
+	char found;
+	char mode = motor_mode;
+
+	motor_homed = 0;
+	motor_set_mode(MOTOR_MODE_FULL);
+	found = motor_sweep(&hit, &darkest, &min);
+	if (found)
+	{
+		min = motor_approach((hit + motor_homeData.offset + MOTOR_MAX_STEPS) % MOTOR_MAX_STEPS);
+		motor_homeData.offset = motor_distance(hit, motor_position);
+	}
+	else
+	{
+		min = motor_approach(darkest);
+	}
+
+	//Raise the threshold if the index got brighter, lower it only if it is much darker (few EEPROM writes)
+	top = min + MOTOR_INDEX_MARGIN;
+	if (top > motor_homeData.top || top + MOTOR_INDEX_MARGIN/2 < motor_homeData.top)
+	{
+		motor_homeData.top = top;
+	}
+	motor_homeData.phase = step;
+	motor_saveHome();
+
+	motor_set_position(MOTOR_MAX_STEPS/4);
+	motor_set_mode(mode);
+	motor_homed = 1;
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_spin(uint32_t us)
+ *
+ * @brief	Waits for the running move and turns CW without end, until motor_stop() is called.
+ *          The stepper ramps up to the time per position, slower times need no ramp.
+ *          Times above the range of timer2 step only with every motor_divider-th compare match.
+ *          On every pass of the index the light barrier is read around it and the position is corrected.
+ *
+ * @param	us	Time per position of the step mode in us.
+ **************************************************************************************************/
+
+void motor_spin(uint32_t us){
+	uint32_t ticks = us / MOTOR_TICK_US;
+	uint16_t interval;
+	motor_wait();
+	if (ticks > 255UL * 255)
+	{
+		ticks = 255UL * 255;
+	}
+	motor_divider = ticks / 256 + 1;
+	interval = (uint16_t)(ticks / motor_divider) << 8;
+	if (interval < (MOTOR_INTERVAL_MIN >> motor_mode))
+	{
+		interval = MOTOR_INTERVAL_MIN >> motor_mode;
+	}
+	motor_intervalMin = interval;
+	motor_syncActive = 0;
+	motor_sync = MOTOR_SYNC_NONE;
+	motor_endless = 1;
+	motor_start(0xFFFF, CW);
+}
+
+/**********************************************************************************************//**
+ * @fn	void motor_stop(void)
+ *
+ * @brief	Stops the spin with the deceleration ramp and waits until the stepper has settled.
+ **************************************************************************************************/
+
+void motor_stop(void){
+	cli();
+	if (motor_endless)
+	{
+		motor_endless = 0;
+		motor_remaining = motor_rampSteps;
+	}
+	sei();
+	motor_wait();
+	motor_divider = 1;
+	motor_intervalMin = MOTOR_INTERVAL_MIN >> motor_mode;
+}
+
+/**********************************************************************************************//**
+ * @fn	int8_t motor_getSync(void)
+ *
+ * @brief	Returns the correction of the last pass of the index while spinning and clears it.
+ *
+ * @return	Correction in positions of the step mode, MOTOR_SYNC_NONE or MOTOR_SYNC_LOST.
+ **************************************************************************************************/
+
+int8_t motor_getSync(void){
+	int8_t s;
+	uint8_t sreg = SREG;
+	cli();
+	s = motor_sync;
+	motor_sync = MOTOR_SYNC_NONE;
+	SREG = sreg;
+	return s;
+}
+
+/**********************************************************************************************//**
+ * @fn	static void motor_track(void)
+ *
+ * @brief	Reads the light barrier around the index while spinning, called after every step.
+ *          Each step takes the conversion of the step before and starts a new one. When the rotor has left
+ *          the window, the position is corrected to the darkest step. If no value is below the threshold,
+ *          the index is lost and the next motor_calibrate() searches it.
+ **************************************************************************************************/
+
+static void motor_track(void){
+	int16_t positions = motor_get_positions();
+	int8_t window = MOTOR_SYNC_WINDOW << motor_mode;
+	int16_t r = motor_distance(positions/4, motor_position);
+	if (motor_syncActive)
+	{
+		uint16_t a = adc_result();
+		if (a < motor_syncMin)
 		{
-			motor_turn(1,CCW);
-			p++;
+			motor_syncMin = a;
+			motor_syncAt = r - 1;
 		}
-		if (p == 100)
+	}
+	if (r == -window)
+	{
+		motor_syncActive = 1;
+		motor_syncMin = 0xFFFF;
+	}
+	if (!motor_syncActive)
+	{
+		return;
+	}
+	if (r <= window)
+	{
+		adc_start();
+		return;
+	}
+	motor_syncActive = 0;
+	if (motor_syncMin <= motor_homeData.top)
+	{
+		motor_position = ((int16_t)motor_position - motor_syncAt + positions) % positions;
+		motor_sync = -motor_syncAt;
+	}
+	else
+	{
+		motor_homed = 0;
+		motor_sync = MOTOR_SYNC_LOST;
+	}
+}
+
+/**********************************************************************************************//**
+ * @fn	ISR(TIMER2_COMPA_vect)
+ *
+ * @brief	Timer2 compare interrupt. Does the next step of the running move or ends the move after the settle time.
+ **************************************************************************************************/
+
+ISR(TIMER2_COMPA_vect){
+	if (--motor_countdown)
+	{
+		//Slow spin, only every motor_divider-th compare match steps
+		return;
+	}
+	motor_countdown = motor_divider;
+	if (motor_remaining > 0)
+	{
+		motor_next();
+		if (motor_endless)
 		{
-			d = d * (-1);
-			motor_turn(100,d);
-			p = 0;
-			top+=5;
+			motor_track();
 		}
-		
+	}
+	else
+	{
+		TCCR2B = 0;
+		motor_done = 1;
 	}
 }
\ No newline at end of file
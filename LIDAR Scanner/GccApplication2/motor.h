@@ -109,6 +109,31 @@
 
 #define T_STEP	10	  //Time between steps
 
+/**********************************************************************************************//**
+ * @def	T_STEP_MIN_US();
+ *
+ * @brief	A macro that defines the time between steps at full speed in us. Moves ramp up from T_STEP to this time.
+ **************************************************************************************************/
+
+#define T_STEP_MIN_US	2500	  //Time between steps at full speed
+
+/**********************************************************************************************//**
+ * @def	MOTOR_TICK_US();
+ *
+ * @brief	A macro that defines the period of a timer2 tick in us (prescaler 1024).
+ *          T_STEP is limited to 255 ticks (16 ms).
+ **************************************************************************************************/
+
+#define MOTOR_TICK_US	64	  //Timer2 tick
+
+/**********************************************************************************************//**
+ * @def	MOTOR_INTERVAL_MIN();
+ *
+ * @brief	A macro that defines T_STEP_MIN_US in timer2 ticks (fixed point 8.8).
+ **************************************************************************************************/
+
+#define MOTOR_INTERVAL_MIN	((uint16_t)(T_STEP_MIN_US / MOTOR_TICK_US) << 8)
+
 /**********************************************************************************************//**
  * @def	CW();
  *
@@ -142,6 +167,31 @@
 
 #define MOTOR_MAX_STEPS 200 //Steps per rotation
 
+/**********************************************************************************************//**
+ * @def	MOTOR_MODE_FULL();
+ *
+ * @brief	A macro that defines the full step mode, MOTOR_MAX_STEPS positions per rotation.
+ **************************************************************************************************/
+
+#define MOTOR_MODE_FULL	0	  //Full steps
+
+/**********************************************************************************************//**
+ * @def	MOTOR_MODE_HALF();
+ *
+ * @brief	A macro that defines the half step mode, twice as many positions per rotation.
+ *          The value is the shift from full steps to positions.
+ **************************************************************************************************/
+
+#define MOTOR_MODE_HALF	1	  //Half steps
+
+/**********************************************************************************************//**
+ * @def	MOTOR_MAX_POSITIONS();
+ *
+ * @brief	A macro that defines the positions per rotation in the finest step mode.
+ **************************************************************************************************/
+
+#define MOTOR_MAX_POSITIONS	(MOTOR_MAX_STEPS << MOTOR_MODE_HALF)
+
 /**********************************************************************************************//**
  * @def	POWER();
  *
@@ -153,6 +203,94 @@
 
 #define POWER	60	  //Maximum stepper Power in %
 
+/**********************************************************************************************//**
+ * @def	MOTOR_INDEX_TOP();
+ *
+ * @brief	A macro that defines the threshold of the light barrier at the index until a threshold is learned.
+ **************************************************************************************************/
+
+#define MOTOR_INDEX_TOP	60	  //Light barrier threshold
+
+/**********************************************************************************************//**
+ * @def	MOTOR_INDEX_MARGIN();
+ *
+ * @brief	A macro that defines the learned threshold above the value of the light barrier at the index.
+ **************************************************************************************************/
+
+#define MOTOR_INDEX_MARGIN	40
+
+/**********************************************************************************************//**
+ * @def	MOTOR_HOME_WINDOW();
+ *
+ * @brief	A macro that defines the steps on each side of the expected index the fine approach checks.
+ **************************************************************************************************/
+
+#define MOTOR_HOME_WINDOW	1
+
+/**********************************************************************************************//**
+ * @def	MOTOR_SYNC_WINDOW();
+ *
+ * @brief	A macro that defines the full steps on each side of the index the light barrier is read while spinning.
+ **************************************************************************************************/
+
+#define MOTOR_SYNC_WINDOW	2
+
+/**********************************************************************************************//**
+ * @def	MOTOR_SYNC_NONE();
+ *
+ * @brief	A macro that defines the result of motor_getSync() if the index was not passed since the last call.
+ **************************************************************************************************/
+
+#define MOTOR_SYNC_NONE	127
+
+/**********************************************************************************************//**
+ * @def	MOTOR_SYNC_LOST();
+ *
+ * @brief	A macro that defines the result of motor_getSync() if the index was not found in the window.
+ **************************************************************************************************/
+
+#define MOTOR_SYNC_LOST	(-128)
+
+/**********************************************************************************************//**
+ * @def	MOTOR_HOME_EEPROM();
+ *
+ * @brief	A macro that defines the EEPROM address of the homing record.
+ **************************************************************************************************/
+
+#define MOTOR_HOME_EEPROM	0x000
+
+/**********************************************************************************************//**
+ * @def	MOTOR_HOME_VERSION();
+ *
+ * @brief	A macro that defines the version of the homing record, older records are ignored.
+ **************************************************************************************************/
+
+#define MOTOR_HOME_VERSION	2
+
+/**********************************************************************************************//**
+ * @def	MOTOR_PHASE_UNKNOWN();
+ *
+ * @brief	A macro that defines the phase of the homing record before the first homing.
+ **************************************************************************************************/
+
+#define MOTOR_PHASE_UNKNOWN	0xFF
+
+#include <avr/io.h>
+
+/**********************************************************************************************//**
+ * @struct	motor_home_t
+ *
+ * @brief	Learned values of the homing, kept in the EEPROM.
+ **************************************************************************************************/
+
+typedef struct {
+	uint8_t version;	//MOTOR_HOME_VERSION
+	uint16_t top;		//Threshold of the light barrier at the index
+	int8_t offset;		//Steps from the first value below top in the fast sweep to the index
+	uint8_t phase;		//Full step phase of the coils at the index, MOTOR_PHASE_UNKNOWN before the first homing
+	uint8_t crc;		//CRC8 of the bytes before
+} motor_home_t;
+
 /**********************************************************************************************//**
  * @fn	void _sleep_ms(int ms)
  *
@@ -169,18 +307,18 @@ void _sleep_ms(int ms);
 /**********************************************************************************************//**
  * @fn	void motor_timer_init(void)
  *
- * @brief	Initialises the timer0 for the power control. 
+ * @brief	Initialises the timer0 for the power control and the timer2 for the step generation. 
  *
  * @author	Alex
  * @date	22.12.2015
  **************************************************************************************************/
 
-void motor_timer_init(void);	  //Initializes Timer 0 for PWM
+void motor_timer_init(void);	  //Initializes Timer 0 for PWM and Timer 2 for steps
 
 /**********************************************************************************************//**
  * @fn	void motor_init(void)
  *
- * @brief	Initialises all used pins as output and calls motor_timer_init()
+ * @brief	Initialises all used pins as output, calls motor_timer_init() and loads the learned homing values.
  *
  * @author	Alex
  * @date	22.12.2015
@@ -189,33 +327,64 @@ void motor_timer_init(void);	  //Initializes Timer 0 for PWM
 void motor_init(void);	  //Initializes the stepper
 
 /**********************************************************************************************//**
- * @fn	void motor_turn(char steps,char dir)
+ * @fn	void motor_turn(uint16_t steps,char dir)
  *
  * @brief	Turn Stepper for some steps in the desired direction.
- *          Based on the last step, this function sets the pins to rotate the stepper by one step.
+ *          The steps are generated by the timer2, this function waits until the stepper has settled.
  * 
  *
  * @author	Alex
  * @date	22.12.2015
  *
- * @param	steps	Number of steps.
+ * @param	steps	Number of steps (positions of the step mode).
  * @param	dir  	Direction (CW or CCW).
  **************************************************************************************************/
 
-void motor_turn(char steps,char dir ); //Moves Stepper for "steps" steps in "dir" direction 
+void motor_turn(uint16_t steps,char dir ); //Moves Stepper for "steps" steps in "dir" direction 
 
 /**********************************************************************************************//**
- * @fn	void motor_toPosition(char p)
+ * @fn	void motor_toPosition(uint16_t p)
  *
- * @brief	Turns motor to the defined position.
+ * @brief	Starts a move to the defined position and returns immediately.
+ *          A running move is finished first. Use motor_isDone() or motor_wait() to wait for the stepper.
  *
  * @author	Alex
  * @date	22.12.2015
  *
- * @param	p	The char to process.
+ * @param	p	The position (0 to motor_get_positions() - 1).
+ **************************************************************************************************/
+
+void motor_toPosition(uint16_t p); //Rotates Stepper to desired position
+
+/**********************************************************************************************//**
+ * @fn	uint32_t motor_moveTime(uint16_t steps)
+ *
+ * @brief	Returns the time a move needs in the actual step mode, with the ramp and the settle time.
+ *
+ * @param	steps	Number of steps.
+ *
+ * @return	Time in us.
+ **************************************************************************************************/
+
+uint32_t motor_moveTime(uint16_t steps);
+
+/**********************************************************************************************//**
+ * @fn	char motor_isDone(void)
+ *
+ * @brief	Checks if the move is done and the stepper has settled.
+ *
+ * @return	1 if the stepper has settled, else 0.
  **************************************************************************************************/
 
-void motor_toPosition(char p); //Rotates Stepper to desired position
+char motor_isDone(void);
+
+/**********************************************************************************************//**
+ * @fn	void motor_wait(void)
+ *
+ * @brief	Waits until the move is done and the stepper has settled.
+ **************************************************************************************************/
+
+void motor_wait(void);
 
 /**********************************************************************************************//**
  * @fn	void motor_set_speed(char t)
@@ -244,7 +413,59 @@ void motor_set_speed(char t); //Setter function for the Speed parameter
 void motor_set_power(char power); //Setter function for Stepper Power; "power" in %
 
 /**********************************************************************************************//**
- * @fn	void motor_set_position(char pos)
+ * @fn	char motor_get_speed(void)
+ *
+ * @brief	Returns the time between steps at standstill.
+ *
+ * @return	Time in ms.
+ **************************************************************************************************/
+
+char motor_get_speed(void);
+
+/**********************************************************************************************//**
+ * @fn	char motor_get_power(void)
+ *
+ * @brief	Returns the maximum power output.
+ *
+ * @return	Power in %.
+ **************************************************************************************************/
+
+char motor_get_power(void);
+
+/**********************************************************************************************//**
+ * @fn	void motor_set_mode(char mode)
+ *
+ * @brief	Change the step mode. Waits for the running move, the position is converted to the new mode.
+ *          A half step between two full steps goes on to the next full step.
+ *          The time between steps is halved in the half step mode, so the speed of the rotor stays the same.
+ *
+ * @param	mode	MOTOR_MODE_FULL or MOTOR_MODE_HALF.
+ **************************************************************************************************/
+
+void motor_set_mode(char mode);
+
+/**********************************************************************************************//**
+ * @fn	char motor_get_mode(void)
+ *
+ * @brief	Returns the step mode.
+ *
+ * @return	MOTOR_MODE_FULL or MOTOR_MODE_HALF.
+ **************************************************************************************************/
+
+char motor_get_mode(void);
+
+/**********************************************************************************************//**
+ * @fn	uint16_t motor_get_positions(void)
+ *
+ * @brief	Returns the positions per rotation of the step mode.
+ *
+ * @return	MOTOR_MAX_STEPS in the full step mode, MOTOR_MAX_POSITIONS in the half step mode.
+ **************************************************************************************************/
+
+uint16_t motor_get_positions(void);
+
+/**********************************************************************************************//**
+ * @fn	void motor_set_position(uint16_t pos)
  *
  * @brief	Set the position of the stepper (only in software).
  *
@@ -254,30 +475,29 @@ void motor_set_power(char power); //Setter function for Stepper Power; "power" i
  * @param	pos	The position.
  **************************************************************************************************/
 
-void motor_set_position(char pos); //Setter function for stepper position
+void motor_set_position(uint16_t pos); //Setter function for stepper position
 
 /**********************************************************************************************//**
- * @fn	char motor_get_position(void)
+ * @fn	uint16_t motor_get_position(void)
  *
  * @brief	Returns the actual motor position.
  *
  * @author	Alex
  * @date	22.12.2015
  *
- * @return	Motor position in steps.
+ * @return	Motor position in positions of the step mode.
  **************************************************************************************************/
 
-char motor_get_position(void);
+uint16_t motor_get_position(void);
 
 /**********************************************************************************************//**
  * @fn	void motor_calibrate()
  *
  * @brief	Calibrates motor position.
- *          This function reads the value of the adc pin of the light barrier. 
- *          The motor is in the right position if the value is lower than 40.
- *          If it is higher, it rotates the stepper in CW direction for 100 steps (180). 
- *          Then it returns to zero and rotates in CCW direction for 100 steps (180) till the value is below 40.
- *          
+ *          If the position is known, the stepper moves straight to the index, else it checks the place where
+ *          it stands (the index after a clean stop). If the light barrier confirms the index, the
+ *          calibration is done, else motor_home() searches the index.
+ *          The index is a quarter turn in every step mode.
  *
  * @author	Alex
  * @date	22.12.2015
@@ -285,6 +505,50 @@ char motor_get_position(void);
 
 void motor_calibrate(void);
 
+/**********************************************************************************************//**
+ * @fn	void motor_home()
+ *
+ * @brief	Searches the index in two phases.
+ *          A fast sweep of up to one turn stops at the first value of the light barrier below the threshold.
+ *          Then the stepper approaches the index with single slow steps and takes the step with the lowest value.
+ *          The threshold and the offset between both phases are learned and kept in the EEPROM.
+ *          If the sweep finds no value below the threshold, the lowest value of the turn is taken.
+ *          The search runs in full steps, so the learned values do not depend on the step mode.
+ **************************************************************************************************/
+
+void motor_home(void);
+
+/**********************************************************************************************//**
+ * @fn	void motor_spin(uint32_t us)
+ *
+ * @brief	Waits for the running move and turns CW without end, until motor_stop() is called.
+ *          The stepper ramps up to the time per position, slower times need no ramp.
+ *          On every pass of the index the light barrier is read around it and the position is corrected.
+ *
+ * @param	us	Time per position of the step mode in us.
+ **************************************************************************************************/
+
+void motor_spin(uint32_t us);
+
+/**********************************************************************************************//**
+ * @fn	void motor_stop(void)
+ *
+ * @brief	Stops the spin with the deceleration ramp and waits until the stepper has settled.
+ **************************************************************************************************/
+
+void motor_stop(void);
+
+/**********************************************************************************************//**
+ * @fn	int8_t motor_getSync(void)
+ *
+ * @brief	Returns the correction of the last pass of the index while spinning and clears it.
+ *
+ * @return	Correction in positions of the step mode, MOTOR_SYNC_NONE or MOTOR_SYNC_LOST.
+ **************************************************************************************************/
+
+int8_t motor_getSync(void);
+
+
 
 
 #endif /* MOTOR_H_ */
\ No newline at end of file
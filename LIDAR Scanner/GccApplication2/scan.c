@@ -0,0 +1,866 @@
+/*
+ * scan.c
+ *
+ * Created: 17.10.2026
+ */
+
+#include "scan.h"
+#include <avr/wdt.h>
+#include <util/crc16.h>
+#include "motor.h"
+#include "servo.h"
+#include "lidar.h"
+#include "serial.h"
+#include "timer.h"
+
+
+/*! \brief Mode of the running scan */
+static char scan_mode;
+
+/*! \brief Motor window of the running scan in positions of the step mode */
+static uint16_t scan_mstart;
+static uint16_t scan_mend;
+
+/*! \brief Motor stride of the running scan, the monitor mode moves in full steps */
+static uint8_t scan_mstride;
+
+/*! \brief Direction of the motor and the servo, CW is towards the end of the window */
+static int8_t scan_dir;
+static int8_t scan_sdir;
+
+/*! \brief Selected order of the points */
+static char scan_order = SCAN_ORDER_AUTO;
+
+/*! \brief Order of the running scan, SCAN_ORDER_ROWS or SCAN_ORDER_COLUMNS */
+static char scan_plan;
+
+/*! \brief Output format of send_data() */
+static char scan_format = SCAN_FORMAT_ASCII;
+
+/*! \brief Sequence number of the next binary scan record */
+static uint8_t scan_sequence = 0;
+
+/*! \brief Block of the delta format, its length and the number of points */
+static uint8_t scan_block[SCAN_BLOCK_LENGTH];
+static uint8_t scan_blockLength = 0;
+static uint8_t scan_blockPoints = 0;
+
+/*! \brief Last point of the block, the next point is coded as difference to it */
+static scan_point_t scan_last;
+static uint16_t scan_lastValue;
+static uint32_t scan_lastTime;
+
+/*! \brief Set if send_data() adds the timestamp */
+static char scan_timestamp = 0;
+
+/*! \brief Window of the scan, the whole half turn and the servo range by default */
+static scan_window_t scan_window = {0, MOTOR_MAX_STEPS/2, 1, 0, SERVO_MAX_DEG/2, 1};
+
+/*! \brief Range per full step of the monitor mode, the last one which was sent. 0 if the position was not measured yet.
+ *  One range per full step halves the SRAM of the half step mode, so the monitor mode keeps to the full steps there. */
+static uint16_t scan_baseline[MOTOR_MAX_STEPS];
+
+/*! \brief Change of the range in cm which the monitor mode sends */
+static uint16_t scan_monitorThreshold = SCAN_MONITOR_THRESHOLD;
+
+/*! \brief Time budget of the last scan */
+static scan_profile_t scan_profile;
+
+
+//Send one byte of a binary scan record and update the CRC
+static void scan_write_byte(uint8_t b, uint8_t *crc){
+	*crc = _crc8_ccitt_update(*crc, b);
+	serial_write_char(b);
+}
+
+//Append an unsigned varint to the block: 7 bit per byte, low bits first, bit 7 is set if more bytes follow
+static void scan_put_varint(uint32_t v){
+	while (v >= 0x80)
+	{
+		scan_block[scan_blockLength++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	scan_block[scan_blockLength++] = v;
+}
+
+//Append a signed difference as zig-zag varint, so small negative differences get short codes too
+static void scan_put_delta(int32_t d){
+	scan_put_varint(((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+}
+
+//Add a point to the block of the delta format
+static void scan_delta(uint16_t mpos, char sdeg, uint16_t val, uint32_t time){
+	if (scan_blockPoints == 0)
+	{
+		//Keyframe: the first point of a block is complete, so every block can be decoded on its own
+		scan_block[0] = SCAN_SYNC_DELTA;
+		scan_block[1] = scan_sequence++;
+		scan_block[2] = scan_timestamp ? SCAN_DELTA_TIME : 0;
+		scan_block[3] = mpos & 0xFF;
+		scan_block[4] = sdeg | ((mpos >> 8) ? SCAN_MPOS_HIGH : 0);
+		scan_block[5] = val & 0xFF;
+		scan_block[6] = val >> 8;
+		scan_blockLength = 7;
+		if (scan_timestamp)
+		{
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				scan_block[scan_blockLength++] = time >> (8 * i);
+			}
+		}
+	}
+	else
+	{
+		scan_put_delta((int16_t)mpos - scan_last.mpos);
+		scan_put_delta((int16_t)sdeg - scan_last.spos);
+		scan_put_delta((int32_t)val - scan_lastValue);
+		if (scan_block[2] & SCAN_DELTA_TIME)
+		{
+			scan_put_varint(time - scan_lastTime);
+		}
+	}
+	scan_last.mpos = mpos;
+	scan_last.spos = sdeg;
+	scan_lastValue = val;
+	scan_lastTime = time;
+	if (++scan_blockPoints == SCAN_DELTA_POINTS)
+	{
+		scan_flush();
+	}
+}
+
+/*! \brief Send the block of the delta format
+ *
+ *  A block is sent when it is full. This function sends the points of an incomplete block, e.g. at the end of a scan.
+ */
+void scan_flush(void){
+	if (scan_blockPoints == 0)
+	{
+		return;
+	}
+	uint8_t crc = 0;
+	scan_block[2] |= scan_blockPoints;
+	serial_write_char(scan_block[0]);
+	for (uint8_t i = 1; i < scan_blockLength; i++)
+	{
+		scan_write_byte(scan_block[i], &crc);
+	}
+	serial_write_char(crc);
+	scan_blockPoints = 0;
+}
+
+/*! \brief Sends data in the right format.
+ *
+ *  In SCAN_FORMAT_ASCII a text line is sent, in SCAN_FORMAT_BINARY a scan record of SCAN_RECORD_LENGTH byte.
+ *  In SCAN_FORMAT_DELTA the point is added to a block, which is sent when it has SCAN_DELTA_POINTS points.
+ *  If the timestamp is enabled, it is appended to the line or a scan record of SCAN_RECORD_TIME_LENGTH byte is sent.
+ *  With more than one LIDAR-Lite the line ends with " id: u", the binary formats always carry u in the value.
+ *
+ *	\param mpos The motor position, bit 8 is sent in SCAN_MPOS_HIGH of sdeg in the binary formats.
+ *	\param sdeg The servo position.
+ *	\param val The distance value.
+ *	\param time The time when the measure was started (timer_micros()).
+ *	\param unit The LIDAR-Lite unit, sent in the bits from SCAN_UNIT_SHIFT of val in the binary formats.
+ */
+void send_data(uint16_t mpos, char sdeg, uint16_t val, uint32_t time, uint8_t unit){
+	if (scan_format != SCAN_FORMAT_ASCII)
+	{
+		val |= (uint16_t)unit << SCAN_UNIT_SHIFT;
+	}
+	if (scan_format == SCAN_FORMAT_DELTA)
+	{
+		scan_delta(mpos, sdeg, val, time);
+		return;
+	}
+	if (scan_format == SCAN_FORMAT_BINARY)
+	{
+		uint8_t crc = 0;
+		serial_write_char(scan_timestamp ? SCAN_SYNC_TIME : SCAN_SYNC);
+		scan_write_byte(scan_sequence++, &crc);
+		scan_write_byte(mpos & 0xFF, &crc);
+		scan_write_byte(sdeg | ((mpos >> 8) ? SCAN_MPOS_HIGH : 0), &crc);
+		scan_write_byte(val & 0xFF, &crc);
+		scan_write_byte(val >> 8, &crc);
+		if (scan_timestamp)
+		{
+			for (uint8_t i = 0; i < 4; i++)
+			{
+				scan_write_byte(time & 0xFF, &crc);
+				time >>= 8;
+			}
+		}
+		serial_write_char(crc);
+		return;
+	}
+	serial_write_string_P(PSTR("mpos: "));
+	serial_write_int(mpos);
+	serial_write_string_P(PSTR(" sdeg: "));
+	serial_write_int(sdeg);
+	serial_write_string_P(PSTR(" val: "));
+	serial_write_int(val);
+	if (scan_timestamp)
+	{
+		serial_write_string_P(PSTR(" t: "));
+		serial_write_long(time);
+	}
+	if (lidar_getUnits() > 1)
+	{
+		serial_write_string_P(PSTR(" id: "));
+		serial_write_int(unit);
+	}
+	serial_write_string_P(PSTR("\r\n"));
+}
+
+/*! \brief Position of a unit
+ *
+ *  The LIDAR-Lite units are mounted evenly around the rotor, unit u is turned by u / lidar_getUnits() of a turn
+ *  against unit 0. The offset is counted in full steps, so it is the same in both step modes.
+ *
+ *	\param mpos The motor position.
+ *	\param unit The LIDAR-Lite unit.
+ *  \return The motor position the unit points to.
+ */
+uint16_t scan_unitPosition(uint16_t mpos, uint8_t unit){
+	uint16_t positions = motor_get_positions();
+	uint16_t offset = unit * (MOTOR_MAX_STEPS / lidar_getUnits()) * (positions / MOTOR_MAX_STEPS);
+	return (mpos + offset) % positions;
+}
+
+/*! \brief Set the output format
+ *
+ *	\param format SCAN_FORMAT_ASCII, SCAN_FORMAT_BINARY or SCAN_FORMAT_DELTA
+ */
+void scan_setFormat(char format){
+	scan_flush();
+	if (format == SCAN_FORMAT_BINARY || format == SCAN_FORMAT_DELTA)
+	{
+		scan_format = format;
+		scan_sequence = 0;
+	}
+	else
+	{
+		scan_format = SCAN_FORMAT_ASCII;
+	}
+}
+
+/*! \brief Get the output format
+ *
+ *	\return SCAN_FORMAT_ASCII, SCAN_FORMAT_BINARY or SCAN_FORMAT_DELTA
+ */
+char scan_getFormat(void){
+	return scan_format;
+}
+
+/*! \brief Enable the timestamp of the points
+ *
+ *	\param enable 1 to send the time of every measure in us, 0 to send the points without time
+ */
+void scan_setTimestamp(char enable){
+	scan_flush();
+	scan_timestamp = (enable != 0);
+}
+
+/*! \brief Get the state of the timestamp
+ *
+ *	\return 1 if the points have a timestamp, else 0
+ */
+char scan_getTimestamp(void){
+	return scan_timestamp;
+}
+
+/*! \brief Get the time budget of the last scan
+ *
+ *  The profile is valid after the scan was cancelled and until the next scan starts.
+ *	\return Profile of the last scan
+ */
+const scan_profile_t* scan_getProfile(void){
+	return &scan_profile;
+}
+
+//Limit a value of the window
+static uint8_t scan_limit(int16_t value, uint8_t min, uint8_t max){
+	if (value < min)
+	{
+		return min;
+	}
+	if (value > max)
+	{
+		return max;
+	}
+	return value;
+}
+
+/*! \brief Set the window of the scan
+ *
+ *  The values are limited to the range of the motor and the servo, an end before the start is set to the start.
+ *	\param values Motor start, end, stride, servo start, end, stride
+ */
+void scan_setWindow(const int16_t *values){
+	scan_window.mstart = scan_limit(values[0], 0, MOTOR_MAX_STEPS - 1);
+	scan_window.mend = scan_limit(values[1], scan_window.mstart, MOTOR_MAX_STEPS - 1);
+	scan_window.mstride = scan_limit(values[2], 1, MOTOR_MAX_STEPS - 1);
+	scan_window.sstart = scan_limit(values[3], 0, SERVO_MAX_DEG/2);
+	scan_window.send = scan_limit(values[4], scan_window.sstart, SERVO_MAX_DEG/2);
+	scan_window.sstride = scan_limit(values[5], 1, SERVO_MAX_DEG/2);
+}
+
+/*! \brief Get the window of the scan
+ *
+ *	\return Window
+ */
+const scan_window_t* scan_getWindow(void){
+	return &scan_window;
+}
+
+/*! \brief Set the threshold of the monitor mode
+ *
+ *	\param cm Change of the range in cm which is sent, SCAN_MONITOR_THRESHOLD if below 1
+ */
+void scan_setMonitorThreshold(int16_t cm){
+	scan_monitorThreshold = cm < 1 ? SCAN_MONITOR_THRESHOLD : cm;
+}
+
+/*! \brief Get the threshold of the monitor mode
+ *
+ *	\return Change of the range in cm
+ */
+uint16_t scan_getMonitorThreshold(void){
+	return scan_monitorThreshold;
+}
+
+/*! \brief Set the order of the points
+ *
+ *	\param order SCAN_ORDER_AUTO, SCAN_ORDER_ROWS or SCAN_ORDER_COLUMNS
+ */
+void scan_setOrder(char order){
+	if (order > SCAN_ORDER_COLUMNS)
+	{
+		order = SCAN_ORDER_AUTO;
+	}
+	scan_order = order;
+}
+
+/*! \brief Get the order of the points
+ *
+ *	\return SCAN_ORDER_AUTO, SCAN_ORDER_ROWS or SCAN_ORDER_COLUMNS
+ */
+char scan_getOrder(void){
+	return scan_order;
+}
+
+/*! \brief Estimate the travel time of a 3D scan
+ *
+ *  Time motor and servo need to move through the window once, from the moves of motor_moveTime() and servo_moveTime().
+ *	\param order SCAN_ORDER_ROWS or SCAN_ORDER_COLUMNS
+ *	\return Time in us
+ */
+uint32_t scan_estimate(char order){
+	uint32_t columns = ((uint16_t)(scan_window.mend - scan_window.mstart) << motor_get_mode()) / scan_window.mstride + 1;
+	uint32_t rows = (scan_window.send - scan_window.sstart) / scan_window.sstride + 1;
+	uint32_t motor = motor_moveTime(scan_window.mstride);
+	uint32_t servo = servo_moveTime(scan_window.sstride);
+	if (order == SCAN_ORDER_COLUMNS)
+	{
+		return columns * (rows - 1) * servo + (columns - 1) * motor;
+	}
+	return rows * (columns - 1) * motor + (rows - 1) * servo;
+}
+
+//Book the time since mark to a phase, returns the new mark
+static uint32_t scan_book(uint8_t phase, uint32_t mark){
+	uint32_t now = timer_micros();
+	scan_profile.phase[phase] += now - mark;
+	return now;
+}
+
+//First point of the scan
+static void scan_first(scan_point_t *p){
+	scan_dir = CW;
+	scan_sdir = CW;
+	scan_plan = scan_order;
+	if (scan_plan == SCAN_ORDER_AUTO)
+	{
+		scan_plan = (scan_estimate(SCAN_ORDER_COLUMNS) < scan_estimate(SCAN_ORDER_ROWS)) ? SCAN_ORDER_COLUMNS : SCAN_ORDER_ROWS;
+	}
+	scan_mstart = (uint16_t)scan_window.mstart << motor_get_mode();
+	scan_mend = (uint16_t)scan_window.mend << motor_get_mode();
+	scan_mstride = scan_window.mstride;
+	if (scan_mode == SCAN_MODE_MONITOR && motor_get_mode() == MOTOR_MODE_HALF)
+	{
+		//Round up to whole steps, the start of the window is on a full step
+		scan_mstride = (scan_mstride + 1) & ~1;
+	}
+	p->mpos = scan_mstart;
+	if (scan_mode == SCAN_MODE_3D)
+	{
+		p->spos = scan_window.sstart;
+	}
+	else
+	{
+		p->spos = servo_get_position();
+	}
+}
+
+//Move a position one stride in its direction, at the end of the window it turns around and returns 0.
+//The positions stay on the grid of the stride, so the way back ends at the start again.
+static uint8_t scan_advance(uint16_t *pos, int8_t *dir, uint16_t start, uint16_t end, uint8_t stride){
+	if (*dir == CW && *pos + stride <= end)
+	{
+		*pos += stride;
+		return 1;
+	}
+	if (*dir == CCW && *pos >= start + stride)
+	{
+		*pos -= stride;
+		return 1;
+	}
+	*dir = -*dir;
+	return 0;
+}
+
+//Move a position back and forth through the window without visiting the end twice
+static void scan_bounce(uint16_t *pos, int8_t *dir, uint16_t start, uint16_t end, uint8_t stride){
+	if (!scan_advance(pos, dir, start, end, stride))
+	{
+		scan_advance(pos, dir, start, end, stride);
+	}
+}
+
+//Compare a range of the monitor mode with the baseline, returns 1 if the point has to be sent.
+//The first range of a position and every change above the threshold are sent and become the new baseline,
+//so a static scene is sent once and an object which appears or leaves once.
+static char scan_change(uint16_t mpos, uint16_t value){
+	uint8_t step = mpos >> motor_get_mode();
+	uint16_t base = scan_baseline[step];
+	uint16_t change = value > base ? value - base : base - value;
+	if (base != 0 && change <= scan_monitorThreshold)
+	{
+		return 0;
+	}
+	scan_baseline[step] = value;
+	return 1;
+}
+
+//Next point of the scan. Both axes serpentine through the window, so there is no long move back to the start.
+static void scan_next(scan_point_t *p){
+	if (scan_mode != SCAN_MODE_3D)
+	{
+		scan_bounce(&p->mpos, &scan_dir, scan_mstart, scan_mend, scan_mstride);
+	}
+	else if (scan_plan == SCAN_ORDER_COLUMNS)
+	{
+		if (!scan_advance(&p->spos, &scan_sdir, scan_window.sstart, scan_window.send, scan_window.sstride))
+		{
+			scan_bounce(&p->mpos, &scan_dir, scan_mstart, scan_mend, scan_mstride);
+		}
+	}
+	else
+	{
+		if (!scan_advance(&p->mpos, &scan_dir, scan_mstart, scan_mend, scan_mstride))
+		{
+			scan_bounce(&p->spos, &scan_sdir, scan_window.sstart, scan_window.send, scan_window.sstride);
+		}
+	}
+}
+
+//Write a signed value as text
+static void scan_write_signed(int32_t value){
+	if (value < 0)
+	{
+		serial_write_string_P(PSTR("-"));
+		value = -value;
+	}
+	serial_write_long(value);
+}
+
+//Time to send one point in us. ASCII lines are counted with their maximum length.
+static uint32_t scan_pointTime(void){
+	uint32_t length = SCAN_LINE_LENGTH;
+	if (scan_format == SCAN_FORMAT_BINARY)
+	{
+		length = scan_timestamp ? SCAN_RECORD_TIME_LENGTH : SCAN_RECORD_LENGTH;
+	}
+	else if (scan_format == SCAN_FORMAT_DELTA)
+	{
+		length = SCAN_BLOCK_LENGTH / SCAN_DELTA_POINTS + 1;
+	}
+	//10 bit per byte
+	return length * 10000000UL / serial_getBaud();
+}
+
+//Send the frame marker of a revolution of the rotating mode. A block of the delta format is sent first,
+//so the marker follows the last point of the revolution.
+static void scan_frame(uint16_t revolution, uint16_t points, uint16_t missed, int8_t sync){
+	scan_flush();
+	if (scan_format != SCAN_FORMAT_ASCII)
+	{
+		uint8_t crc = 0;
+		serial_write_char(SCAN_SYNC_FRAME);
+		scan_write_byte(scan_sequence++, &crc);
+		scan_write_byte(revolution & 0xFF, &crc);
+		scan_write_byte(revolution >> 8, &crc);
+		scan_write_byte(points & 0xFF, &crc);
+		scan_write_byte(points >> 8, &crc);
+		scan_write_byte(missed & 0xFF, &crc);
+		scan_write_byte(missed >> 8, &crc);
+		scan_write_byte(sync, &crc);
+		serial_write_char(crc);
+		return;
+	}
+	serial_write_string_P(PSTR("frame: "));
+	serial_write_int(revolution);
+	serial_write_string_P(PSTR(" points: "));
+	serial_write_int(points);
+	serial_write_string_P(PSTR(" missed: "));
+	serial_write_int(missed);
+	serial_write_string_P(PSTR(" sync: "));
+	if (sync == MOTOR_SYNC_NONE)
+	{
+		serial_write_string_P(PSTR("none"));
+	}
+	else if (sync == MOTOR_SYNC_LOST)
+	{
+		serial_write_string_P(PSTR("lost"));
+	}
+	else
+	{
+		scan_write_signed(sync);
+	}
+	serial_write_string_P(PSTR("\r\n"));
+}
+
+//Positions the rotor still has to turn CW to a position, above half a turn it has passed it
+static uint16_t scan_ahead(uint16_t pos, uint16_t positions){
+	return (pos + positions - motor_get_position()) % positions;
+}
+
+//Next position of the grid of the rotating mode, returns 1 if it starts the next revolution
+static uint8_t scan_around(uint16_t *pos, uint8_t stride, uint16_t positions){
+	*pos += stride;
+	if (*pos >= positions)
+	{
+		*pos = 0;
+		return 1;
+	}
+	return 0;
+}
+
+//Mask of all units for the points pending to be sent
+static uint8_t scan_units(void){
+	return (1 << lidar_getUnits()) - 1;
+}
+
+//Send the first pending point of the units
+static void scan_send(uint8_t *pending, uint16_t mpos, char sdeg, const uint16_t *values, uint32_t time){
+	uint8_t unit = 0;
+	while (!(*pending & (1 << unit)))
+	{
+		unit++;
+	}
+	send_data(scan_unitPosition(mpos, unit), sdeg, values[unit], time, unit);
+	*pending &= ~(1 << unit);
+	scan_profile.points++;
+}
+
+/*! \brief Run a radar mode
+ *
+ *  Pipelined scan executor for the window of scan_setWindow() in the order of scan_setOrder().
+ *  While the LIDAR-Lite measures point N in the background, point N-1 is sent over the UART.
+ *  As soon as the measure of point N is finished, the stepper or the servo start the move to N+1.
+ *  Their settle time runs in the background until the next measure is triggered.
+ *  The scan runs until a new command is received, then the motor gets calibrated.
+ *  The time the loop waits for the motor, the servo, the LIDAR-Lite and the UART is booked in the profile.
+ *  With several LIDAR-Lite units every stop gives a point per unit at scan_unitPosition(), so the window
+ *  only has to cover the part of the turn up to the next unit.
+ *  SCAN_MODE_MONITOR scans like SCAN_MODE_2D, but only sends the points of scan_change(). They are not
+ *  collected in blocks of the delta format, so an alert is not held back. In the half step mode it moves in
+ *  full steps, the baseline has one range per full step.
+ *
+ *	\param mode SCAN_MODE_2D, SCAN_MODE_3D or SCAN_MODE_MONITOR
+ *	\param avg Quantity of Values per point
+ */
+void scan_run(char mode, uint16_t avg){
+	scan_point_t current;
+	scan_point_t previous = {0, 0};
+	uint16_t values[LIDAR_UNITS_MAX];
+	uint8_t pending = 0;
+	uint32_t time = 0;
+	uint32_t previousTime = 0;
+	uint32_t start = timer_micros();
+	uint32_t mark = start;
+
+	for (uint8_t i = 0; i < SCAN_PHASES; i++)
+	{
+		scan_profile.phase[i] = 0;
+	}
+	scan_profile.points = 0;
+	for (uint8_t i = 0; i < MOTOR_MAX_STEPS; i++)
+	{
+		scan_baseline[i] = 0;
+	}
+
+	scan_mode = mode;
+	scan_first(&current);
+	servo_toPosition(current.spos);
+	mark = scan_book(SCAN_PHASE_SERVO, mark);
+	motor_toPosition(current.mpos);
+
+	while (1)
+	{
+		wdt_reset();
+		//Every new command stops the scan, it is executed afterwards
+		if (serial_commandPending())
+		{
+			break;
+		}
+
+		//Trigger point N as soon as the optics have settled
+		motor_wait();
+		mark = scan_book(SCAN_PHASE_MOTOR, mark);
+		servo_wait();
+		mark = scan_book(SCAN_PHASE_SERVO, mark);
+		time = mark;
+		lidar_startValueAVG(avg);
+
+		//Send point N-1 while point N is measured, but only if the whole point fits into the transmit buffer
+		while (pending || !lidar_isReady())
+		{
+			if (pending && serial_tx_free() >= SCAN_LINE_LENGTH)
+			{
+				scan_send(&pending, previous.mpos, previous.spos, values, previousTime);
+				if (scan_mode == SCAN_MODE_MONITOR)
+				{
+					scan_flush();
+				}
+				mark = scan_book(SCAN_PHASE_SERIAL, mark);
+			}
+			else
+			{
+				mark = scan_book(pending ? SCAN_PHASE_SERIAL : SCAN_PHASE_ACQUISITION, mark);
+			}
+		}
+		mark = scan_book(SCAN_PHASE_ACQUISITION, mark);
+		previous = current;
+		previousTime = time;
+		pending = scan_units();
+		for (uint8_t unit = 0; unit < lidar_getUnits(); unit++)
+		{
+			values[unit] = lidar_getUnitResult(unit);
+			if (scan_mode == SCAN_MODE_MONITOR && !scan_change(scan_unitPosition(current.mpos, unit), values[unit]))
+			{
+				pending &= ~(1 << unit);
+			}
+		}
+
+		//Start the step to N+1
+		scan_next(&current);
+		if (current.spos != previous.spos)
+		{
+			servo_toPosition(current.spos);
+			mark = scan_book(SCAN_PHASE_SERVO, mark);
+		}
+		motor_toPosition(current.mpos);
+	}
+
+	scan_flush();
+	scan_profile.total = timer_micros() - start;
+	motor_calibrate();
+}
+
+
+/*! \brief Run the rotating mode
+ *
+ *  The stepper spins CW without end and the LIDAR-Lite measures whenever the rotor reaches a position of the
+ *  grid of the stride, which starts at position 0 and covers the whole turn. The servo stays in position.
+ *  There are no turnarounds: the speed is set once from a measure at standstill and the time to send
+ *  a point, with a margin of a quarter. Like scan_run() the last point is sent while the next one is
+ *  measured. A position the rotor has passed before the measure could start is skipped and counted.
+ *  With several LIDAR-Lite units a position gives a point per unit at scan_unitPosition(), the time to send
+ *  them all sets the speed.
+ *  The values of a point are taken while the rotor turns on, so a point averages the arc behind its position.
+ *  At the end of every revolution a frame marker follows its last point: "frame: r points: p missed: m sync: c"
+ *  or a record of SCAN_FRAME_LENGTH byte in the binary formats. p counts the points of all units, m the skipped
+ *  positions of the grid and c is the correction of the position at the pass of the index, see motor_getSync().
+ *  The first frame is the part of a turn from the start to position 0.
+ *  Every new command stops the spin, then the motor gets calibrated. The profile is booked like in scan_run().
+ *
+ *	\param avg Quantity of Values per point
+ */
+void scan_rotate(uint16_t avg){
+	uint16_t positions = motor_get_positions();
+	uint8_t stride = scan_window.mstride;
+	uint8_t spos = servo_get_position();
+	uint16_t target;
+	uint16_t ahead;
+	uint16_t previous = 0;
+	uint16_t values[LIDAR_UNITS_MAX];
+	uint8_t pending = 0;
+	char frame = 0;
+	uint16_t revolution = 0;
+	uint16_t points = 0;
+	uint16_t missed = 0;
+	uint16_t framePoints = 0;
+	uint16_t frameMissed = 0;
+	uint32_t pace;
+	uint32_t time = 0;
+	uint32_t previousTime = 0;
+	uint32_t start = timer_micros();
+	uint32_t mark = start;
+
+	for (uint8_t i = 0; i < SCAN_PHASES; i++)
+	{
+		scan_profile.phase[i] = 0;
+	}
+	scan_profile.points = 0;
+	servo_wait();
+	mark = scan_book(SCAN_PHASE_SERVO, mark);
+
+	//A point has to be measured and sent while the rotor turns one stride
+	lidar_startValueAVG(avg);
+	while (!lidar_isReady())
+	{
+		wdt_reset();
+	}
+	pace = timer_micros() - mark;
+	mark = scan_book(SCAN_PHASE_ACQUISITION, mark);
+	if (scan_pointTime() * lidar_getUnits() > pace)
+	{
+		pace = scan_pointTime() * lidar_getUnits();
+	}
+	motor_spin((pace + pace / 4) / stride);
+	target = motor_get_position() / stride * stride;
+	scan_around(&target, stride, positions);
+
+	while (1)
+	{
+		wdt_reset();
+		//Every new command stops the scan, it is executed afterwards
+		if (serial_commandPending())
+		{
+			break;
+		}
+
+		//Wait for the rotor at the next position of the grid, the positions it has passed are skipped
+		ahead = scan_ahead(target, positions);
+		if (ahead > positions / 2)
+		{
+			missed++;
+			if (scan_around(&target, stride, positions))
+			{
+				//The frame marker follows the last point, which may still wait for the UART
+				if (pending)
+				{
+					mark = scan_book(SCAN_PHASE_MOTOR, mark);
+					while (pending)
+					{
+						wdt_reset();
+						if (serial_tx_free() >= SCAN_LINE_LENGTH)
+						{
+							scan_send(&pending, previous, spos, values, previousTime);
+						}
+					}
+					mark = scan_book(SCAN_PHASE_SERIAL, mark);
+				}
+				if (frame)
+				{
+					scan_frame(revolution++, framePoints, frameMissed, motor_getSync());
+					frame = 0;
+				}
+				scan_frame(revolution++, points, missed, motor_getSync());
+				points = 0;
+				missed = 0;
+			}
+			continue;
+		}
+		if (ahead != 0)
+		{
+			mark = scan_book(SCAN_PHASE_MOTOR, mark);
+			continue;
+		}
+		mark = scan_book(SCAN_PHASE_MOTOR, mark);
+		time = mark;
+		lidar_startValueAVG(avg);
+
+		//Send the last point while this one is measured, the frame marker follows the last point of a revolution
+		while (pending || !lidar_isReady())
+		{
+			if (pending && serial_tx_free() >= SCAN_LINE_LENGTH)
+			{
+				scan_send(&pending, previous, spos, values, previousTime);
+				if (frame && !pending)
+				{
+					scan_frame(revolution++, framePoints, frameMissed, motor_getSync());
+					frame = 0;
+				}
+				mark = scan_book(SCAN_PHASE_SERIAL, mark);
+			}
+			else
+			{
+				mark = scan_book(pending ? SCAN_PHASE_SERIAL : SCAN_PHASE_ACQUISITION, mark);
+			}
+		}
+		mark = scan_book(SCAN_PHASE_ACQUISITION, mark);
+		for (uint8_t unit = 0; unit < lidar_getUnits(); unit++)
+		{
+			values[unit] = lidar_getUnitResult(unit);
+		}
+		previous = target;
+		previousTime = time;
+		pending = scan_units();
+		points += lidar_getUnits();
+		if (scan_around(&target, stride, positions))
+		{
+			framePoints = points;
+			frameMissed = missed;
+			points = 0;
+			missed = 0;
+			frame = 1;
+		}
+	}
+
+	scan_flush();
+	motor_stop();
+	scan_profile.total = timer_micros() - start;
+	motor_calibrate();
+}
+
+/*! \brief Stream the velocity
+ *
+ *  The LIDAR-Lite measures the velocity in the current direction with its own period, every value is
+ *  sent as soon as it is read: "vel: v sum: s t: t". The velocity v is the change of the distance
+ *  since the last value in cm, sum is the change since the start of the stream (32 bit, so long
+ *  streams do not overflow) and t the time of the value in us. Every new command stops the stream.
+ *
+ *	\param scale 0: 100 ms period, 0.1 m/s per count; 1: 10 ms period, 1 m/s per count
+ */
+void scan_velocity(uint8_t scale){
+	int8_t velocity;
+	int32_t sum = 0;
+	uint32_t time;
+
+	if (lidar_startVelocityStream(scale) != TWI_OK)
+	{
+		serial_write_string_P(PSTR("LIDAR not found!\r\n"));
+		return;
+	}
+	while (!serial_commandPending())
+	{
+		wdt_reset();
+		if (lidar_pollVelocity(&velocity, &time))
+		{
+			sum += velocity;
+			serial_write_string_P(PSTR("vel: "));
+			scan_write_signed(velocity);
+			serial_write_string_P(PSTR(" sum: "));
+			scan_write_signed(sum);
+			serial_write_string_P(PSTR(" t: "));
+			serial_write_long(time);
+			serial_write_string_P(PSTR("\r\n"));
+		}
+		else
+		{
+			_delay_us(LIDAR_POLL_DELAY_US);
+		}
+	}
+	lidar_stopVelocityStream();
+}
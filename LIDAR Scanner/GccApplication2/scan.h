@@ -0,0 +1,232 @@
+/*
+ * scan.h
+ *
+ * Created: 17.10.2026
+ */ 
+
+
+#ifndef SCAN_H_
+#define SCAN_H_
+
+/*! \def SCAN_MODE_2D
+ *
+ *  Define the radar mode 2D (motor only, servo stays in position)
+ */
+#define SCAN_MODE_2D	0
+
+/*! \def SCAN_MODE_3D
+ *
+ *  Define the radar mode 3D (motor first, servo row by row)
+ */
+#define SCAN_MODE_3D	1
+
+/*! \def SCAN_MODE_MONITOR
+ *
+ *  Define the monitor mode (2D, only points which changed by more than the threshold are sent)
+ */
+#define SCAN_MODE_MONITOR	2
+
+/*! \def SCAN_MONITOR_THRESHOLD
+ *
+ *  Define the default change of the range in cm which the monitor mode reports
+ */
+#define SCAN_MONITOR_THRESHOLD	10
+
+/*! \def SCAN_ORDER_AUTO
+ *
+ *  Define the order of the points with the shortest travel time of motor and servo for the window
+ */
+#define SCAN_ORDER_AUTO		0
+
+/*! \def SCAN_ORDER_ROWS
+ *
+ *  Define the order motor first: the motor serpentines along a row, the servo goes to the next row at its end
+ */
+#define SCAN_ORDER_ROWS		1
+
+/*! \def SCAN_ORDER_COLUMNS
+ *
+ *  Define the order servo first: the servo serpentines along a column, the motor goes to the next column at its end
+ */
+#define SCAN_ORDER_COLUMNS	2
+
+/*! \def SCAN_FORMAT_ASCII
+ *
+ *  Define the ASCII output format ("mpos: X sdeg: Y val: Z", with timestamp " t: T" is appended)
+ */
+#define SCAN_FORMAT_ASCII	0
+
+/*! \def SCAN_FORMAT_BINARY
+ *
+ *  Define the binary output format (framed scan records)
+ */
+#define SCAN_FORMAT_BINARY	1
+
+/*! \def SCAN_FORMAT_DELTA
+ *
+ *  Define the compressed output format (blocks of delta coded points)
+ */
+#define SCAN_FORMAT_DELTA	2
+
+/*! \def SCAN_SYNC
+ *
+ *  Define the first byte of every binary scan record
+ */
+#define SCAN_SYNC		0xA5
+
+/*! \def SCAN_RECORD_LENGTH
+ *
+ *  Define the length of a binary scan record in byte.
+ *  Layout: SCAN_SYNC, sequence, mpos, sdeg, value (low byte, high byte), CRC-8 over sequence to value.
+ *  Bit 8 of mpos is in SCAN_MPOS_HIGH of sdeg, the same holds for the other binary formats.
+ */
+#define SCAN_RECORD_LENGTH	7
+
+/*! \def SCAN_SYNC_TIME
+ *
+ *  Define the first byte of every binary scan record with timestamp
+ */
+#define SCAN_SYNC_TIME		0xA6
+
+/*! \def SCAN_RECORD_TIME_LENGTH
+ *
+ *  Define the length of a binary scan record with timestamp in byte.
+ *  Layout: SCAN_SYNC_TIME, sequence, mpos, sdeg, value (low byte, high byte), timestamp (4 byte, low byte first),
+ *  CRC-8 over sequence to timestamp
+ */
+#define SCAN_RECORD_TIME_LENGTH	11
+
+/*! \def SCAN_SYNC_DELTA
+ *
+ *  Define the first byte of every block of the delta format
+ */
+#define SCAN_SYNC_DELTA		0xA7
+
+/*! \def SCAN_MPOS_HIGH
+ *
+ *  Define the bit of the sdeg byte of the binary formats which holds bit 8 of mpos.
+ *  The servo needs 7 bit, the motor needs 9 bit in the half step mode.
+ */
+#define SCAN_MPOS_HIGH		0x80
+
+/*! \def SCAN_UNIT_SHIFT
+ *
+ *  Define the position of the unit of a point in the value of the binary formats. The distance needs 12 bit,
+ *  bit 12 and 13 hold the LIDAR-Lite unit which measured the point, see lidar_getUnits().
+ */
+#define SCAN_UNIT_SHIFT		12
+
+/*! \def SCAN_DELTA_POINTS
+ *
+ *  Define the maximum number of points in a block of the delta format. Every block starts with a keyframe,
+ *  so the host can resynchronise after this many points.
+ */
+#define SCAN_DELTA_POINTS	8
+
+/*! \def SCAN_DELTA_TIME
+ *
+ *  Define the flag in the header of a block for points with timestamp
+ */
+#define SCAN_DELTA_TIME		0x80
+
+/*! \def SCAN_BLOCK_LENGTH
+ *
+ *  Define the maximum length of a block of the delta format without the CRC in byte.
+ *  Layout: SCAN_SYNC_DELTA, sequence, header (number of points | SCAN_DELTA_TIME),
+ *  keyframe (mpos, sdeg, value low byte, value high byte, timestamp 4 byte low byte first),
+ *  for every further point the differences to the point before as zig-zag varints (mpos, sdeg, value)
+ *  and the time since the point before as varint, CRC-8 over sequence to the last point.
+ */
+#define SCAN_BLOCK_LENGTH	(3 + 8 + (SCAN_DELTA_POINTS - 1) * 12)
+
+/*! \def SCAN_SYNC_FRAME
+ *
+ *  Define the first byte of the frame marker of the rotating mode in the binary formats
+ */
+#define SCAN_SYNC_FRAME		0xA8
+
+/*! \def SCAN_FRAME_LENGTH
+ *
+ *  Define the length of a frame marker in the binary formats in byte.
+ *  Layout: SCAN_SYNC_FRAME, sequence, revolution, points, missed points (2 byte each, low byte first),
+ *  correction of the index (signed, MOTOR_SYNC_NONE or MOTOR_SYNC_LOST), CRC-8 over sequence to correction
+ */
+#define SCAN_FRAME_LENGTH	10
+
+/*! \def SCAN_LINE_LENGTH
+ *
+ *  Define the maximum length of a point in byte. The scan waits for this much space in the transmit buffer.
+ */
+#define SCAN_LINE_LENGTH	56
+
+/*! \def SCAN_PHASE_...
+ *
+ *  Define the phases of the scan profile. The time the scan loop waits for something is booked to its phase.
+ */
+#define SCAN_PHASE_MOTOR	0	/*!< Stepper moves and settles */
+#define SCAN_PHASE_SERVO	1	/*!< Servo moves */
+#define SCAN_PHASE_ACQUISITION	2	/*!< LIDAR-Lite measures, including the TWI transfers */
+#define SCAN_PHASE_SERIAL	3	/*!< Point is formatted or waits for space in the transmit buffer */
+#define SCAN_PHASES		4
+
+
+#include <avr/io.h>
+
+/*! \brief Point of a scan
+ *
+ *  Position of motor and servo of one measure.
+ */
+typedef struct {
+	uint16_t mpos;	/*!< Motor position in positions of the step mode */
+	uint16_t spos;	/*!< Servo position in degrees */
+} scan_point_t;
+
+/*! \brief Window of a scan
+ *
+ *  The motor moves from mstart to mend in steps of mstride. The start and the end are full steps, so the
+ *  window covers the same angles in every step mode, the stride counts positions of the step mode.
+ *  In SCAN_MODE_3D the servo moves
+ *  from sstart to send in steps of sstride, the order of the points is set by scan_setOrder().
+ *  SCAN_MODE_2D only uses the motor values.
+ */
+typedef struct {
+	uint8_t mstart;		/*!< First motor position in full steps */
+	uint8_t mend;		/*!< Last motor position in full steps */
+	uint8_t mstride;	/*!< Motor positions between two points */
+	uint8_t sstart;		/*!< First servo position in degrees */
+	uint8_t send;		/*!< Last servo position in degrees */
+	uint8_t sstride;	/*!< Servo degrees between two rows */
+} scan_window_t;
+
+/*! \brief Time budget of the last scan
+ *
+ *  Filled by scan_run(), all times in us.
+ */
+typedef struct {
+	uint32_t phase[SCAN_PHASES];	/*!< Time per phase, see SCAN_PHASE_... */
+	uint32_t total;			/*!< Time from the start to the end of the scan */
+	uint16_t points;		/*!< Number of points sent */
+} scan_profile_t;
+
+
+void send_data(uint16_t mpos, char sdeg, uint16_t val, uint32_t time, uint8_t unit);
+uint16_t scan_unitPosition(uint16_t mpos, uint8_t unit);
+void scan_flush(void);
+void scan_setFormat(char format);
+char scan_getFormat(void);
+void scan_setTimestamp(char enable);
+char scan_getTimestamp(void);
+const scan_profile_t* scan_getProfile(void);
+void scan_setWindow(const int16_t *values);
+const scan_window_t* scan_getWindow(void);
+void scan_setMonitorThreshold(int16_t cm);
+uint16_t scan_getMonitorThreshold(void);
+void scan_setOrder(char order);
+char scan_getOrder(void);
+uint32_t scan_estimate(char order);
+void scan_run(char mode, uint16_t avg);
+void scan_rotate(uint16_t avg);
+void scan_velocity(uint8_t scale);
+
+
+#endif /* SCAN_H_ */
@@ -7,6 +7,7 @@
 
 
 #include "serial.h"
+#include "timer.h"
 
 
 
@@ -15,35 +16,86 @@
  *  This is the buffer for serial reading. The ISR write any new character in this array.
  */
 
-volatile char buffer[BUFFER_SIZE];
+static volatile char buffer[BUFFER_SIZE];
 
 
-/*! \brief Readpointer for  buffer
+/*! \brief Readindex for  buffer
  *  
- *  This is the readpointer for the buffer. This position is the position of the next readable character.
+ *  This is the readindex for the buffer (free running, masked on access). This position is the position of the next readable character.
  */
 
-volatile char* readpointer;
+static volatile uint8_t readindex = 0;
 
 
-/*! \brief Writepointer for  buffer
+/*! \brief Writeindex for  buffer
  *  
- *  This is the writepointer for the buffer. This position in the array is the position for the next character in the array.
+ *  This is the writeindex for the buffer (free running, masked on access). This position in the array is the position for the next character in the array.
  */
 
-volatile char* writepointer;
+static volatile uint8_t writeindex = 0;
+
+
+/*! \brief Number of lost characters
+ *  
+ *  Characters which did not fit into the buffer or were overwritten in the UART (Data OverRun).
+ */
+
+static volatile uint16_t rx_overruns = 0;
+
+
+/*! \brief Number of received SERIAL_COMMAND_START characters */
+
+static volatile uint8_t rx_commandsIn = 0;
+
+
+/*! \brief Number of SERIAL_COMMAND_START characters read out of the buffer */
+
+static volatile uint8_t rx_commandsOut = 0;
+
+
+/*! \brief Transmit buffer
+ *  
+ *  Characters to send. The UDRE-ISR moves them into the DATA Register.
+ */
+
+static volatile uint8_t tx_buffer[TX_BUFFER_SIZE];
+
+
+/*! \brief Write index of the transmit buffer (free running, masked on access) */
+
+static volatile uint8_t tx_head = 0;
+
+
+/*! \brief Read index of the transmit buffer (free running, masked on access) */
+
+static volatile uint8_t tx_tail = 0;
+
+
+/*! \brief Highest fill level of the transmit buffer since the last reset */
+
+static volatile uint8_t tx_highWater = 0;
+
+
+/*! \brief Baud rates of the command "#u", BAUD and the rates without error at 16 MHz (U2X) */
+
+static const uint32_t serial_bauds[] = {BAUD, 250000, 500000, 1000000};
+
+
+/*! \brief Current baud rate */
+
+static uint32_t serial_baud = BAUD;
 
 
 /*! \brief Initialize the UART communication
  *
- *  This function initialize the communication for UART. The readpointer and the writepointer will be set on the first position of the array.
+ *  This function initialize the communication for UART. The readindex and the writeindex will be set on the first position of the array.
  *  After this, the BAUD-Rate will be set and the Interrupts will be enabled. 
  */
 
 void serial_init(void){
 	
-	readpointer = buffer;
-	writepointer = buffer;
+	readindex = 0;
+	writeindex = 0;
 	
 	//Set BAUD-Rate
 	UBRR0H = UBRRH_VALUE;
@@ -59,18 +111,55 @@ void serial_init(void){
 }
 
 
+//Number of characters in the transmit buffer
+static uint8_t serial_tx_used(void){
+	return (uint8_t)(tx_head - tx_tail);
+}
+
+//Append a character, the buffer must not be full
+static void serial_tx_put(unsigned char c){
+	uint8_t sreg = SREG;
+	cli();
+	tx_buffer[tx_head & TX_BUFFER_MASK] = c;
+	tx_head++;
+	if (serial_tx_used() > tx_highWater)
+	{
+		tx_highWater = serial_tx_used();
+	}
+	//Enable the Data Register Empty Interrupt
+	UCSR0B |= (1<<UDRIE0);
+	SREG = sreg;
+}
+
+//Move one character into the DATA Register by polling. Used when interrupts are disabled.
+static void serial_tx_poll(void){
+	while ( !(UCSR0A & (1 << UDRE0)) ){
+	}
+	UDR0 = tx_buffer[tx_tail & TX_BUFFER_MASK];
+	tx_tail++;
+	if (tx_head == tx_tail)
+	{
+		UCSR0B &= ~(1<<UDRIE0);
+	}
+}
+
+
 /*! \brief Send character
  *
- *  Send a character over the UART.
+ *  Send a character over the UART. The character is put into the transmit buffer,
+ *  the function only waits if the buffer is full.
  *  \param c charater to send
  */
 
 void serial_write_char(unsigned char c){
-	// Wait for empty DATA Register
-	while ( !(UCSR0A & (1 << UDRE0)) ){
+	// Wait for space in the transmit buffer
+	while (serial_tx_used() >= TX_BUFFER_SIZE){
+		if (!(SREG & (1<<SREG_I)))
+		{
+			serial_tx_poll();
+		}
 	}
-	//Write CHAR to DATA Register
-	UDR0 = c;
+	serial_tx_put(c);
 }
 
 
@@ -88,6 +177,22 @@ void serial_write_string(char *string){
 }
 
 
+/*! \brief Send string from flash
+ *
+ *  Send a string which is stored in the program memory, e.g. serial_write_string_P(PSTR("text")).
+ *  Constant texts stay out of the SRAM this way.
+ *  \param string pointer of the first character of the string in the program memory
+ */
+
+void serial_write_string_P(const char *string){
+	char c;
+	while ((c = pgm_read_byte(string)) != '\0'){
+		serial_write_char(c);
+		string ++;
+	}
+}
+
+
 /*! \brief Send integer
  *
  *  Send an integer over the UART.
@@ -102,24 +207,134 @@ void serial_write_int(uint16_t i){
 }
 
 
+/*! \brief Send long integer
+ *
+ *  Send an unsigned 32 bit integer over the UART, e.g. a timestamp.
+ *  \param i integer to send
+ */
+
+
+void serial_write_long(uint32_t i){
+	char buffer[NUMBER_OF_DIGITS_LONG+1];
+	ultoa(i, buffer, 10 );
+	serial_write_string(buffer);
+}
+
+
+/*! \brief Send character without waiting
+ *
+ *  Put a character into the transmit buffer if there is space.
+ *  \param c charater to send
+ *  \return 1 if the character was buffered, 0 if the buffer is full
+ */
+
+uint8_t serial_try_write_char(unsigned char c){
+	if (serial_tx_used() >= TX_BUFFER_SIZE)
+	{
+		return 0;
+	}
+	serial_tx_put(c);
+	return 1;
+}
+
+
+/*! \brief Send string without waiting
+ *
+ *  Put a string into the transmit buffer if there is space for all characters.
+ *  Nothing is sent if the string does not fit.
+ *  \param string pointer of the first character of the string
+ *  \return 1 if the string was buffered, 0 if the buffer is too full
+ */
+
+uint8_t serial_try_write_string(char *string){
+	uint8_t length = 0;
+	while (string[length] != '\0'){
+		length++;
+	}
+	if (length > serial_tx_free())
+	{
+		return 0;
+	}
+	serial_write_string(string);
+	return 1;
+}
+
+
+/*! \brief Send integer without waiting
+ *
+ *  Put an integer into the transmit buffer if there is space for all digits.
+ *  \param i integer to send
+ *  \return 1 if the integer was buffered, 0 if the buffer is too full
+ */
+
+uint8_t serial_try_write_int(uint16_t i){
+	char buffer[NUMBER_OF_DIGITS+1];
+	itoa(i, buffer, 10 );
+	return serial_try_write_string(buffer);
+}
+
+
+/*! \brief Free space of the transmit buffer
+ *
+ *  Can be used for backpressure: only send a block if it fits.
+ *  \return Number of characters which can be sent without waiting
+ */
+
+uint8_t serial_tx_free(void){
+	return TX_BUFFER_SIZE - serial_tx_used();
+}
+
+
+/*! \brief High-water mark of the transmit buffer
+ *
+ *  \return Highest fill level of the transmit buffer since the last reset
+ */
+
+uint8_t serial_tx_highWater(void){
+	return tx_highWater;
+}
+
+
+/*! \brief Reset the high-water mark of the transmit buffer
+ */
+
+void serial_tx_resetHighWater(void){
+	tx_highWater = serial_tx_used();
+}
+
+
+/*! \brief Wait until everything is sent
+ *
+ *  Wait until every character of the transmit buffer has been handed to the UART.
+ */
+
+void serial_flush(void){
+	while (tx_head != tx_tail){
+		if (!(SREG & (1<<SREG_I)))
+		{
+			serial_tx_poll();
+		}
+	}
+	while ( !(UCSR0A & (1 << UDRE0)) ){
+	}
+}
+
+
 /*! \brief Read char
  *
  *  Read a character out of the buffer
- *  \return Received character
+ *  \return Received character, '\0' if the buffer is empty
  */
 
 char serial_read_char(void){
 	char data;
-	if (writepointer != readpointer)
+	if (writeindex != readindex)
 	{
-		data = *readpointer;
-		if (readpointer == (buffer + BUFFER_SIZE-1))
-		{
-			readpointer = buffer;
-		}
-		else
+		data = buffer[readindex & BUFFER_MASK];
+		readindex++;
+		if (data == SERIAL_COMMAND_START)
 		{
-			readpointer++;
+			rx_commandsOut++;
 		}
 	}
 	else
@@ -130,6 +345,166 @@ char serial_read_char(void){
 }
 
 
+/*! \brief Check the buffer
+ *
+ *  \return Number of characters in the buffer
+ */
+
+uint8_t serial_available(void){
+	return (uint8_t)(writeindex - readindex);
+}
+
+
+/*! \brief Check for a new command
+ *
+ *  A long running action can use this to stop as soon as the next command arrives.
+ *  The command stays in the buffer.
+ *  \return 1 if a SERIAL_COMMAND_START was received that has not been read yet
+ */
+
+uint8_t serial_commandPending(void){
+	return rx_commandsIn != rx_commandsOut;
+}
+
+
+/*! \brief Number of lost characters
+ *
+ *  \return Number of received characters which were lost since the start
+ */
+
+uint16_t serial_rx_overruns(void){
+	uint16_t n;
+	uint8_t sreg = SREG;
+	cli();
+	n = rx_overruns;
+	SREG = sreg;
+	return n;
+}
+
+
+/*! \brief Baud rate of the table
+ *
+ *  \param index Index of the rate, 0 is BAUD
+ *  \return Baud rate, 0 if the index is unknown
+ */
+
+uint32_t serial_baudRate(uint8_t index){
+	if (index >= sizeof(serial_bauds) / sizeof(serial_bauds[0]))
+	{
+		return 0;
+	}
+	return serial_bauds[index];
+}
+
+
+/*! \brief Current baud rate
+ *
+ *  \return Baud rate
+ */
+
+uint32_t serial_getBaud(void){
+	return serial_baud;
+}
+
+
+/*! \brief Set the baud rate
+ *
+ *  The UART runs with U2X, so 250000, 500000 and 1000000 baud have no error at 16 MHz.
+ *  The transmit buffer is sent with the old rate first, characters which are received during the switch are dropped.
+ *  \param baud Baud rate
+ *  \return 1 if the rate was set, 0 if its error is above SERIAL_BAUD_TOLERANCE
+ */
+
+uint8_t serial_setBaud(uint32_t baud){
+	uint16_t ubrr = (F_CPU / 8 + baud / 2) / baud - 1;
+	uint32_t actual = F_CPU / 8 / (ubrr + 1UL);
+	uint32_t error = actual > baud ? actual - baud : baud - actual;
+	if (baud == 0 || ubrr > 0x0FFF || error * 100 > baud * SERIAL_BAUD_TOLERANCE)
+	{
+		return 0;
+	}
+
+	//Wait until the last character has left the shift register
+	serial_flush();
+	uint32_t frame = 10000000UL / serial_baud + 1;
+	uint32_t start = timer_micros();
+	while (timer_micros() - start < frame){
+	}
+
+	UCSR0A = (1<<U2X0);
+	UBRR0H = ubrr >> 8;
+	UBRR0L = ubrr & 0xFF;
+	serial_baud = baud;
+
+	uint8_t sreg = SREG;
+	cli();
+	readindex = writeindex;
+	rx_commandsOut = rx_commandsIn;
+	SREG = sreg;
+	return 1;
+}
+
+
+/*! \brief Switch the baud rate with a link test
+ *
+ *  After the switch the host sends the test block of SERIAL_LINK_LENGTH byte with the new rate, the controller
+ *  sends every byte back. If the echo is right, the host sends SERIAL_LINK_CONFIRM.
+ *  The old rate is restored if a byte of the block is wrong or missing or the confirmation does not arrive
+ *  within SERIAL_LINK_TIMEOUT_US, so a host which can not follow does not lose the controller.
+ *  \param baud New baud rate
+ *  \param link Result of the test
+ *  \return 1 if the new rate is kept, else 0
+ */
+
+uint8_t serial_link(uint32_t baud, serial_link_t *link){
+	uint32_t old = serial_baud;
+	uint32_t start;
+	uint32_t first = 0;
+	link->received = 0;
+	link->errors = 0;
+	link->confirmed = 0;
+	link->time = 0;
+	if (!serial_setBaud(baud))
+	{
+		return 0;
+	}
+
+	start = timer_micros();
+	while (link->received < SERIAL_LINK_LENGTH && timer_micros() - start < SERIAL_LINK_TIMEOUT_US){
+		if (serial_available())
+		{
+			uint8_t c = serial_read_char();
+			if (link->received == 0)
+			{
+				first = timer_micros();
+			}
+			if (c != (uint8_t)((link->received * 0x1D) ^ 0x55))
+			{
+				link->errors++;
+			}
+			serial_write_char(c);
+			link->received++;
+			link->time = timer_micros() - first;
+		}
+	}
+
+	start = timer_micros();
+	while (!link->confirmed && timer_micros() - start < SERIAL_LINK_TIMEOUT_US){
+		if (serial_available() && serial_read_char() == SERIAL_LINK_CONFIRM)
+		{
+			link->confirmed = 1;
+		}
+	}
+
+	if (link->received < SERIAL_LINK_LENGTH || link->errors || !link->confirmed)
+	{
+		serial_setBaud(old);
+		return 0;
+	}
+	return 1;
+}
+
+
 /*! \brief Read string
  *
  *  Read a sting out of the buffer with a peak of 20 characters
@@ -199,15 +574,38 @@ int16_t serial_read_int(){
  */
 
 ISR (USART_RX_vect){
-	cli();
-	*writepointer = UDR0;
-	if (writepointer == (buffer + BUFFER_SIZE-1))
+	//DOR0 has to be read before UDR0
+	uint8_t overrun = UCSR0A & (1<<DOR0);
+	char c = UDR0;
+	if (overrun)
 	{
-		writepointer = buffer;
+		rx_overruns++;
 	}
-	else
+	if ((uint8_t)(writeindex - readindex) >= BUFFER_SIZE)
 	{
-		writepointer++;
+		rx_overruns++;
+		return;
+	}
+	buffer[writeindex & BUFFER_MASK] = c;
+	writeindex++;
+	if (c == SERIAL_COMMAND_START)
+	{
+		rx_commandsIn++;
+	}
+}
+
+
+/*! \brief Interrupt Service Routine
+ *
+ *  Interrupt Service Routine for an UART Data Register Empty Interrupt.
+ *  Sends the next character of the transmit buffer and disables itself if the buffer is empty.
+ */
+
+ISR (USART_UDRE_vect){
+	UDR0 = tx_buffer[tx_tail & TX_BUFFER_MASK];
+	tx_tail++;
+	if (tx_head == tx_tail)
+	{
+		UCSR0B &= ~(1<<UDRIE0);
 	}
-	sei();
 }
\ No newline at end of file
@@ -32,6 +32,12 @@
 
 #define NUMBER_OF_DIGITS 5
 
+/*! \def NUMBER_OF_DIGITS_LONG
+ *
+ *  Define the peak of digits for a long integer
+ */
+#define NUMBER_OF_DIGITS_LONG 10
+
 /*! \def STRING_LENGTH
  *
  *  Define the peak of characters for a string
@@ -40,24 +46,99 @@
 
 /*! \def BUFFER_SIZE
  *
- *  Define the size of the array for the buffer
+ *  Define the size of the array for the buffer. Has to be a power of two.
  */
-#define BUFFER_SIZE		20
+#define BUFFER_SIZE		32
+
+/*! \def BUFFER_MASK
+ *
+ *  Mask for the indices of the buffer
+ */
+#define BUFFER_MASK		(BUFFER_SIZE - 1)
+
+/*! \def SERIAL_COMMAND_START
+ *
+ *  Define the character which starts a command. The ISR counts them, so a running action can check for new commands.
+ */
+#define SERIAL_COMMAND_START	'#'
+
+/*! \def TX_BUFFER_SIZE
+ *
+ *  Define the size of the transmit buffer. Has to be a power of two.
+ */
+#define TX_BUFFER_SIZE	64
+
+/*! \def TX_BUFFER_MASK
+ *
+ *  Mask for the indices of the transmit buffer
+ */
+#define TX_BUFFER_MASK	(TX_BUFFER_SIZE - 1)
+
+/*! \def SERIAL_BAUD_TOLERANCE
+ *
+ *  Define the maximum error of a baud rate in percent. Rates with a higher error for F_CPU are not used.
+ */
+#define SERIAL_BAUD_TOLERANCE	2
+
+/*! \def SERIAL_LINK_LENGTH
+ *
+ *  Define the length of the test block of the link test in byte. Byte i of the block is (i * 0x1D) ^ 0x55.
+ */
+#define SERIAL_LINK_LENGTH	32
+
+/*! \def SERIAL_LINK_CONFIRM
+ *
+ *  Define the character which the host sends to keep the new baud rate after the link test
+ */
+#define SERIAL_LINK_CONFIRM	'!'
+
+/*! \def SERIAL_LINK_TIMEOUT_US
+ *
+ *  Define the time the controller waits for the test block and for the confirmation of the host in us.
+ *  Both together are below the watchdog timeout.
+ */
+#define SERIAL_LINK_TIMEOUT_US	500000UL
 
 
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/setbaud.h>
 #include <stdlib.h>
 #include <util/delay.h>
 
 
+/*! \brief Result of the link test */
+typedef struct {
+	uint8_t received;	/*!< Bytes of the test block the controller received */
+	uint8_t errors;		/*!< Bytes of the test block which were wrong */
+	uint8_t confirmed;	/*!< Set if the host confirmed the new baud rate */
+	uint32_t time;		/*!< Time from the first to the last byte of the test block in us */
+} serial_link_t;
+
+
 void serial_init(void);
 void serial_write_char(unsigned char c);
 void serial_write_string(char *string);
+void serial_write_string_P(const char *string);
 void serial_write_int(uint16_t i);
+void serial_write_long(uint32_t i);
+uint8_t serial_try_write_char(unsigned char c);
+uint8_t serial_try_write_string(char *string);
+uint8_t serial_try_write_int(uint16_t i);
+uint8_t serial_tx_free(void);
+uint8_t serial_tx_highWater(void);
+void serial_tx_resetHighWater(void);
+void serial_flush(void);
 char serial_read_char(void);
+uint8_t serial_available(void);
+uint8_t serial_commandPending(void);
+uint16_t serial_rx_overruns(void);
+uint32_t serial_baudRate(uint8_t index);
+uint32_t serial_getBaud(void);
+uint8_t serial_setBaud(uint32_t baud);
+uint8_t serial_link(uint32_t baud, serial_link_t *link);
 char* serial_read_string();
 int16_t serial_read_int();
 
@@ -5,6 +5,7 @@
  **************************************************************************************************/
 
 #include "servo.h"
+#include "timer.h"
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/wdt.h>
@@ -12,6 +13,9 @@
 /** @brief	Position in degrees (0-180) */
 char servo_position  = 0;
 
+/** @brief	Time of timer_micros() when the servo has reached servo_position */
+static uint32_t servo_settled = 0;
+
 /**********************************************************************************************//**
  * @fn	void servo_timer_init()
  *
@@ -46,6 +50,8 @@ void servo_timer_init(){
 void servo_init(){
 	servo_timer_init();
 	OCR1A = POS_MAX;
+	//The position at power up is unknown
+	servo_settled = timer_micros() + SERVO_PERIOD_US + (uint32_t)SERVO_MAX_DEG * SERVO_US_PER_DEG;
 	
 }
 
@@ -53,6 +59,9 @@ void servo_init(){
  * @fn	void servo_toPosition(char deg)
  *
  * @brief	Sets the position of the servo.
+ *          Does not wait for the servo. The time it needs is modelled from the distance:
+ *          one period until the new pulse is seen and SERVO_US_PER_DEG for every degree.
+ *          Use servo_isSettled() or servo_wait() to wait for the servo.
  *
  * @author	Alex
  * @date	22.12.2015
@@ -63,13 +72,72 @@ void servo_init(){
 void servo_toPosition(char deg){
 	assert(deg <= 90);
 	char s = SERVO_MAX_DEG-deg;
-	if (s>=0 && s<=SERVO_MAX_DEG)
+	if (s>=0 && s<=SERVO_MAX_DEG && deg != servo_position)
 	{
 			OCR1A = POS_MIN + ((POS_MAX-POS_MIN)/(SERVO_MAX_DEG/10) * (s))/10;
+			uint8_t delta = (deg > servo_position) ? deg - servo_position : servo_position - deg;
+			uint32_t start = timer_micros() + SERVO_PERIOD_US;
+			if ((int32_t)(servo_settled - start) > 0)
+			{
+				//A running move is finished first
+				start = servo_settled;
+			}
+			servo_settled = start + (uint32_t)delta * SERVO_US_PER_DEG;
 			servo_position = deg;
 	}
 }
 
+/**********************************************************************************************//**
+ * @fn	uint32_t servo_moveTime(uint8_t deg)
+ *
+ * @brief	Returns the time a move needs.
+ *
+ * @param	deg	Distance of the move in degrees.
+ *
+ * @return	Time in us.
+ **************************************************************************************************/
+
+uint32_t servo_moveTime(uint8_t deg){
+	return SERVO_PERIOD_US + (uint32_t)deg * SERVO_US_PER_DEG;
+}
+
+/**********************************************************************************************//**
+ * @fn	uint32_t servo_settledAt(void)
+ *
+ * @brief	Returns the time when the servo has reached the last position.
+ *
+ * @return	Time of timer_micros().
+ **************************************************************************************************/
+
+uint32_t servo_settledAt(void){
+	return servo_settled;
+}
+
+/**********************************************************************************************//**
+ * @fn	char servo_isSettled(void)
+ *
+ * @brief	Checks if the servo has reached the last position.
+ *
+ * @return	1 if the servo has settled, else 0.
+ **************************************************************************************************/
+
+char servo_isSettled(void){
+	//The difference is right even if the time wraps
+	return (int32_t)(timer_micros() - servo_settled) >= 0;
+}
+
+/**********************************************************************************************//**
+ * @fn	void servo_wait(void)
+ *
+ * @brief	Waits until the servo has reached the last position.
+ **************************************************************************************************/
+
+void servo_wait(void){
+	while (!servo_isSettled())
+	{
+	}
+}
+
 /**********************************************************************************************//**
  * @fn	char servo_get_position()
  *
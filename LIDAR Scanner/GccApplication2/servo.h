@@ -73,6 +73,26 @@
 
 #define SERVO_MAX_DEG 180
 
+/**********************************************************************************************//**
+ * @def	SERVO_PERIOD_US();
+ *
+ * @brief	A macro that defines the period of the servo signal in us.
+ *          A new position is taken over with the next pulse, so this is the dead time of every move.
+ **************************************************************************************************/
+
+#define SERVO_PERIOD_US 20000
+
+/**********************************************************************************************//**
+ * @def	SERVO_US_PER_DEG();
+ *
+ * @brief	A macro that defines the slew time of the servo in us per degree.
+ *          0.15s/60 of the datasheet, the speed under load.
+ **************************************************************************************************/
+
+#define SERVO_US_PER_DEG 2500
+
+#include <avr/io.h>
+
 /**********************************************************************************************//**
  * @fn	void servo_timer_init()
  *
@@ -110,6 +130,46 @@ void servo_init();
 
 void servo_toPosition(char deg);
 
+/**********************************************************************************************//**
+ * @fn	uint32_t servo_moveTime(uint8_t deg)
+ *
+ * @brief	Returns the time a move needs.
+ *
+ * @param	deg	Distance of the move in degrees.
+ *
+ * @return	Time in us.
+ **************************************************************************************************/
+
+uint32_t servo_moveTime(uint8_t deg);
+
+/**********************************************************************************************//**
+ * @fn	uint32_t servo_settledAt(void)
+ *
+ * @brief	Returns the time when the servo has reached the last position.
+ *
+ * @return	Time of timer_micros().
+ **************************************************************************************************/
+
+uint32_t servo_settledAt(void);
+
+/**********************************************************************************************//**
+ * @fn	char servo_isSettled(void)
+ *
+ * @brief	Checks if the servo has reached the last position.
+ *
+ * @return	1 if the servo has settled, else 0.
+ **************************************************************************************************/
+
+char servo_isSettled(void);
+
+/**********************************************************************************************//**
+ * @fn	void servo_wait(void)
+ *
+ * @brief	Waits until the servo has reached the last position.
+ **************************************************************************************************/
+
+void servo_wait(void);
+
 /**********************************************************************************************//**
  * @fn	char servo_get_position()
  *
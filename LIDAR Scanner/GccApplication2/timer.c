@@ -0,0 +1,52 @@
+/*
+ * timer.c
+ *
+ * Created: 17.10.2026
+ */
+
+#include "timer.h"
+
+
+/*! \brief Number of timer0 overflows since timer_init() */
+static volatile uint32_t timer_overflows = 0;
+
+
+/*! \brief Initialize the timebase
+ *
+ *  The timebase counts the overflows of the timer0, which runs for the PWM of the stepper.
+ *  motor_timer_init() has to be called first.
+ */
+void timer_init(void){
+	TIMSK0 |= (1<<TOIE0);
+}
+
+/*! \brief Get the time
+ *
+ *  Microseconds since timer_init() with a resolution of 0.5 us. The value wraps after about 71 minutes,
+ *  differences of two values are always right.
+ *  Can also be called from an ISR.
+ *  \return Time in us
+ */
+uint32_t timer_micros(void){
+	uint32_t overflows;
+	uint8_t ticks;
+	uint8_t sreg = SREG;
+	cli();
+	overflows = timer_overflows;
+	ticks = TCNT0;
+	//An overflow which is not handled yet
+	if ((TIFR0 & (1<<TOV0)) && ticks < 255)
+	{
+		overflows++;
+	}
+	SREG = sreg;
+	return overflows * TIMER_OVERFLOW_US + ticks / TIMER_TICKS_PER_US;
+}
+
+/*! \brief Interrupt Service Routine
+ *
+ *  Timer0 overflow, counts the overflows for timer_micros().
+ */
+ISR (TIMER0_OVF_vect){
+	timer_overflows++;
+}
@@ -0,0 +1,30 @@
+/*
+ * timer.h
+ *
+ * Created: 17.10.2026
+ */ 
+
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+/*! \def TIMER_OVERFLOW_US
+ *
+ *  Define the period of the timer0 overflow in us (prescaler 8, 8 bit, set up by motor_timer_init())
+ */
+#define TIMER_OVERFLOW_US	128
+
+/*! \def TIMER_TICKS_PER_US
+ *
+ *  Define the timer0 counts per us
+ */
+#define TIMER_TICKS_PER_US	2
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+void timer_init(void);
+uint32_t timer_micros(void);
+
+#endif /* TIMER_H_ */
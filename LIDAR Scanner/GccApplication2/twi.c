@@ -3,12 +3,39 @@
  *
  * Created: 26.10.2015 19:14:56
  *  Author: Mathias Parys
- */ 
+ */
 
 #include "twi.h"
 
 uint8_t timeoutValue =	TIMEOUT_TRYS;
 
+/*! \brief TWI-Queue
+ *
+ *  Ring of the submitted transactions. The transaction at twi_tail is the one on the bus.
+ */
+static twi_transaction_t * volatile twi_queue[TWI_QUEUE_SIZE];
+
+/*! \brief Write index of the TWI-Queue */
+static volatile uint8_t twi_head = 0;
+
+/*! \brief Read index of the TWI-Queue */
+static volatile uint8_t twi_tail = 0;
+
+/*! \brief Byte index inside the transaction on the bus */
+static volatile uint8_t twi_index = 0;
+
+/*! \brief Set while the ISR owns the bus */
+static volatile uint8_t twi_running = 0;
+
+/*! \brief Selected bus speed (TWI_SPEED_STANDARD or TWI_SPEED_FAST) */
+static volatile uint8_t twi_speed = TWI_SPEED_STANDARD;
+
+/*! \brief Bus errors, arbitration losses and timeouts since twi_init() */
+static volatile uint16_t twi_errors = 0;
+
+/*! \brief Bus errors in a row, reset by every successful transaction */
+static volatile uint8_t twi_errorsInRow = 0;
+
 //initialize TWI
 
 /*! \brief Initialize the TWI-Communication
@@ -16,98 +43,219 @@ uint8_t timeoutValue =	TIMEOUT_TRYS;
  *  This function inizialize the TWI-communication.
  */
 void twi_init(void){
-	
+
 	//Initialize twi Prescaler
 	TWSR |= (0 << TWPS0);
 	TWSR |= (0 << TWPS1);
-	
+
 	//TWBR Abhngig von F_CPU, daher per Define berechnet
 	//set SCL to 100kHz
 	TWBR = TWBR_val;
-	
+
 	//Enable TWI anc ACKS
 	TWCR = (1<<TWEN) | (1<<TWEA);
 }
 
-static void twi_lockUp(){
-	//Release SDA and SCL to high
-	TWCR =0;
+/*! \brief Recover the bus
+ *
+ *  A slave which was interrupted in the middle of a byte may hold SDA low forever.
+ *  The TWI-module gets disabled and SCL is clocked by hand until the slave releases SDA,
+ *  then a STOP condition is generated, the pull-ups are restored and the TWI-module is enabled again.
+ */
+void twi_recover(void){
+	uint8_t sreg = SREG;
+	cli();
+	TWCR = 0;
+
+	//SCL and SDA are open drain: low is an output with the port bit cleared, released is an input.
+	//The direction is cleared first, so the pins are never driven high.
+	DDRC &= ~((1<<SCL) | (1<<SDA));
+	PORTC &= ~((1<<SCL) | (1<<SDA));
+	_delay_us(5);
+
+	for (uint8_t i = 0; i < TWI_RECOVERY_CLOCKS && !(PINC & (1<<SDA)); i++)
+	{
+		DDRC |= (1<<SCL);
+		_delay_us(5);
+		DDRC &= ~(1<<SCL);
+		_delay_us(5);
+	}
+
+	//STOP: SDA is pulled low while SCL is released, then SDA is released and rises while SCL is high
+	DDRC |= (1<<SDA);
+	_delay_us(5);
+	DDRC &= ~(1<<SDA);
+	_delay_us(5);
+
+	PORTC |= (1<<SCL) | (1<<SDA);
 	TWCR = (1<<TWEN) | (1<<TWEA);
-	
+	SREG = sreg;
 }
 
-// Stop TWI Communication
-static uint8_t twi_stop(void){
-	//Stop Communication
-	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
-	
+//Count a bus error and fall back to F_SCL if fast mode keeps failing
+static void twi_countError(void){
+	twi_errors++;
+	twi_errorsInRow++;
+	if (twi_speed == TWI_SPEED_FAST && twi_errorsInRow >= TWI_FALLBACK_ERRORS)
+	{
+		twi_speed = TWI_SPEED_STANDARD;
+		TWBR = TWBR_val;
+	}
+}
+
+//Send a START condition and hand the bus to the ISR
+static void twi_kick(void){
+	//A STOP of the last transaction may still be in progress
 	uint8_t timeout = timeoutValue;
-	while (TWCR & (1<<TWSTO)){
-		if (timeout > 0)
+	while ((TWCR & (1<<TWSTO)) && timeout > 0){
+		_delay_us(1);
+		timeout--;
+	}
+	twi_running = 1;
+	TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE);
+}
+
+//Finish the transaction on the bus and start the next one
+static void twi_finish(uint8_t status, uint8_t release){
+	twi_transaction_t *t = twi_queue[twi_tail & TWI_QUEUE_MASK];
+	twi_tail++;
+	if (status == TWI_OK)
+	{
+		twi_errorsInRow = 0;
+	}
+	else if (status == TWI_BUS_ERROR || status == TW_MT_ARB_LOST)
+	{
+		twi_countError();
+	}
+	if (status == TWI_BUS_ERROR)
+	{
+		//The bus is free after the recovery, no STOP needed
+		twi_recover();
+		release = 1;
+	}
+	t->status = status;
+	if (t->callback)
+	{
+		t->callback(status);
+	}
+
+	if (twi_head != twi_tail)
+	{
+		if (release)
 		{
-			_delay_us(TIMEOUT_DELAYWERT);
-			timeout--;
+			//Bus is lost, START as soon as it is free again
+			TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE);
 		}
 		else
 		{
-			return TWI_TIMEOUT_ERROR;
+			//STOP followed by START
+			TWCR = (1<<TWINT) | (1<<TWSTO) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE);
 		}
 	}
-	
-	return TWI_STOP_OK;
-}
-
-//Start TWI Communication
-static uint8_t twi_start(){
-	
-	uint8_t status = twi_get_status();
-	//uint8_t timeout =0;
-	//Send Start condition
-	TWCR |= (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
-	//Wait for TWINT Flag set; -> Start condition has been transmitted
-	uint8_t timeout = timeoutValue;
-	while( !(TWCR & (1<<TWINT)) ){
-		if (timeout > 0)
+	else
+	{
+		twi_running = 0;
+		if (release)
 		{
-			_delay_us(TIMEOUT_DELAYWERT);
-			timeout--;
+			TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
 		}
 		else
 		{
-			return TWI_CONNECTION_ERROR;
+			TWCR = (1<<TWINT) | (1<<TWSTO) | (1<<TWEN);
 		}
 	}
-	
+}
 
-	status = twi_get_status();
-	if ((status == TW_START) || (status == TW_REP_START))
+/*! \brief Get the status of the TWI-communication
+ *
+ *  Get the Status of the TWI/I2C Communication. Status are the upper 5 Bits
+ */
+uint8_t twi_get_status(void){
+	//status with mask.
+	return TW_STATUS;
+}
+
+/*! \brief Submit a transaction
+ *
+ *  Append a prepared transaction to the TWI-queue. If the bus is idle the transaction starts immediately.
+ *  The function does not wait, the result is reported in the status of the transaction and by the callback.
+ *  Can also be called from a callback.
+ *	\param transaction Prepared transaction
+ *	\return TWI_OK or TWI_QUEUE_FULL
+ */
+uint8_t twi_submit(twi_transaction_t *transaction){
+	uint8_t sreg = SREG;
+	cli();
+	if ((uint8_t)(twi_head - twi_tail) >= TWI_QUEUE_SIZE)
 	{
-		return TWI_OK;
+		SREG = sreg;
+		return TWI_QUEUE_FULL;
 	}
-	else
+	transaction->status = TWI_PENDING;
+	twi_queue[twi_head & TWI_QUEUE_MASK] = transaction;
+	twi_head++;
+	if (!twi_running)
 	{
-		if (status == TW_MT_ARB_LOST)
-		{
-			twi_lockUp();
-			return status;
-		} 
-		else
-		{
-			return status;
-		}
+		twi_kick();
 	}
+	SREG = sreg;
+	return TWI_OK;
 }
 
-static uint8_t twi_sendAdress(uint8_t address){	
-	//Write LIDAR-Address to TWDR
-	TWDR = address;
-	
-	//Clear TWINT; Start transmission
-	TWCR = (1<<TWINT) | (1<<TWEN);
-	
-	//Wait for TWINT-FLag; ACK has been received
-	uint8_t timeout = timeoutValue;
-	while( !(TWCR & (1<<TWINT)) ){
+/*! \brief Submit a write transaction
+ *
+ *  Write the Values in the registers of the device without waiting.
+ *	\param transaction Descriptor for the transaction
+ *	\param devaddr Address of the Device
+ *	\param regaddr Address of the Register
+ *	\param data	Data to write
+ *	\param length Length in Byte
+ *	\param callback Called on completion, may be 0
+ *	\return TWI_OK or TWI_QUEUE_FULL
+ */
+uint8_t twi_writeRegAsync(twi_transaction_t *transaction, uint8_t devaddr, uint8_t regaddr, uint8_t *data, uint8_t length, twi_callback_t callback){
+	transaction->devaddr = devaddr;
+	transaction->regaddr = regaddr;
+	transaction->data = data;
+	transaction->length = length;
+	transaction->type = TWI_TRANSACTION_WRITE;
+	transaction->callback = callback;
+	return twi_submit(transaction);
+}
+
+/*! \brief Submit a read transaction
+ *
+ *  Read values out of the device registers without waiting. The register address is sent first,
+ *  then the values are read after a repeated start.
+ *	\param transaction Descriptor for the transaction
+ *	\param devaddr	Address of the Device
+ *	\param regaddr	Address of the Register
+ *	\param data		Buffer for the data
+ *	\param length	Length of byte to read
+ *	\param callback Called on completion, may be 0
+ *	\return TWI_OK or TWI_QUEUE_FULL
+ */
+uint8_t twi_readRegAsync(twi_transaction_t *transaction, uint8_t devaddr, uint8_t regaddr, uint8_t *data, uint8_t length, twi_callback_t callback){
+	transaction->devaddr = devaddr;
+	transaction->regaddr = regaddr;
+	transaction->data = data;
+	transaction->length = length;
+	transaction->type = TWI_TRANSACTION_READ;
+	transaction->callback = callback;
+	return twi_submit(transaction);
+}
+
+/*! \brief Wait for a transaction
+ *
+ *  Wait until the transaction is finished. If the bus does not finish in time the queue gets aborted.
+ *  Global interrupts have to be enabled.
+ *	\param transaction Submitted transaction
+ *	\return Status of the transaction
+ */
+uint8_t twi_wait(twi_transaction_t *transaction){
+	uint16_t timeout = timeoutValue;
+	while (transaction->status == TWI_PENDING)
+	{
 		if (timeout > 0)
 		{
 			_delay_us(TIMEOUT_DELAYWERT);
@@ -115,129 +263,100 @@ static uint8_t twi_sendAdress(uint8_t address){
 		}
 		else
 		{
-			return TWI_TIMEOUT_ERROR;
+			twi_abort();
+			return TWI_CONNECTION_ERROR;
 		}
 	}
-	
-	//Check if the Device has acknowledged the READ / WRITE mode
-	if ((TW_STATUS == TW_MT_SLA_ACK) || (TW_STATUS == TW_MR_SLA_ACK)){
-		return TWI_OK;
-	}
-	if ((TW_STATUS == TW_MT_SLA_NACK) || (TW_STATUS == TW_MR_SLA_NACK))
-	{
-		uint8_t status = TW_STATUS;
-		twi_stop();
-		return status;
-	} 
-	else
-	{
-		uint8_t status = TW_STATUS;
-		twi_lockUp();
-		return status;
-	}
+	return transaction->status;
 }
 
-//Write to TWDR Register; Shift to SDA 
-static uint8_t twi_write(uint8_t data){
-	//Load DATA to TWDR Register
-	TWDR = data;
-	//Clear TWINT to start transmission
-	TWCR = (1 << TWINT) | (1 << TWEN);
-	//Wait for TWINT Flag; -> DATA transmitted and ACK/NACK received.
-uint8_t timeout = timeoutValue;
-while( !(TWCR & (1<<TWINT)) ){
-	if (timeout > 0)
-	{
-		_delay_us(TIMEOUT_DELAYWERT);
-		timeout--;
-	}
-	else
-	{
-		return TWI_TIMEOUT_ERROR;
-	}
+/*! \brief Check the TWI-Queue
+ *
+ *  \return 1 while transactions are queued or on the bus
+ */
+uint8_t twi_isBusy(void){
+	return twi_running;
 }
-	//Check TWI Status;
-	if (TW_STATUS == TW_MT_DATA_ACK ){ 
-		return TWI_WRITE_OK;
-	}
-	if (TW_STATUS == TW_MR_DATA_NACK)
+
+/*! \brief Abort all transactions
+ *
+ *  Recover the bus and finish every queued transaction with TWI_CONNECTION_ERROR, their callbacks are called
+ *  like by the ISR. The queue is emptied first, so a callback may submit a new transaction.
+ */
+void twi_abort(void){
+	twi_transaction_t *aborted[TWI_QUEUE_SIZE];
+	uint8_t count = 0;
+	uint8_t sreg = SREG;
+	cli();
+	twi_countError();
+	twi_recover();
+	twi_running = 0;
+	while (twi_head != twi_tail)
 	{
-		uint8_t status = TW_STATUS;
-		twi_stop();
-		return status;
-	} 
-	else
+		aborted[count] = twi_queue[twi_tail & TWI_QUEUE_MASK];
+		aborted[count++]->status = TWI_CONNECTION_ERROR;
+		twi_tail++;
+	}
+	for (uint8_t i = 0; i < count; i++)
 	{
-		uint8_t status = TW_STATUS;
-		twi_lockUp();
-		return status;
-		
+		if (aborted[i]->callback)
+		{
+			aborted[i]->callback(TWI_CONNECTION_ERROR);
+		}
 	}
+	SREG = sreg;
 }
 
-//Read with ACK signal
-static uint8_t twi_read_ack(void){
-	//READ with ACK
-	TWCR = ((1<<TWINT) | (1<<TWEN) | (1<<TWEA));
-uint8_t timeout = timeoutValue;
-while( !(TWCR & (1<<TWINT)) ){
-	if (timeout > 0)
+
+/*! \brief Set the bus speed
+ *
+ *  Waits until the TWI-queue is empty, then the new SCL frequency is used.
+ *  Fast mode falls back to F_SCL after TWI_FALLBACK_ERRORS bus errors in a row.
+ *	\param speed TWI_SPEED_STANDARD (100 kHz) or TWI_SPEED_FAST (400 kHz)
+ */
+void twi_setSpeed(uint8_t speed){
+	uint16_t timeout = timeoutValue;
+	while (twi_running && timeout > 0)
 	{
 		_delay_us(TIMEOUT_DELAYWERT);
 		timeout--;
 	}
-	else
+	if (twi_running)
 	{
-		return TWI_TIMEOUT_ERROR;
+		twi_abort();
 	}
-}
-	
-	if (TW_STATUS == TW_MT_ARB_LOST)
+	twi_errorsInRow = 0;
+	if (speed == TWI_SPEED_FAST)
 	{
-		uint8_t status = TW_STATUS;
-		twi_lockUp();
-		return status;
-	}
-	
-	//Return Status
-	return TW_STATUS;
-}
-
-//Read without ACK signal
-static uint8_t twi_read_nack(void){
-	//READ without ACK
-	TWCR = ((1<<TWINT) | (1<<TWEN));
-uint8_t timeout = timeoutValue;
-while( !(TWCR & (1<<TWINT)) ){
-	if (timeout > 0)
-	{
-		_delay_us(TIMEOUT_DELAYWERT);
-		timeout--;
+		twi_speed = TWI_SPEED_FAST;
+		TWBR = TWBR_FAST_val;
 	}
 	else
 	{
-		return TWI_TIMEOUT_ERROR;
+		twi_speed = TWI_SPEED_STANDARD;
+		TWBR = TWBR_val;
 	}
 }
-	
-	if (TW_STATUS == TW_MT_ARB_LOST)
-	{
-		uint8_t status = TW_STATUS;
-		twi_lockUp();
-		return status;
-	}
-	
-	//Return Status
-	return TW_STATUS;
+
+/*! \brief Get the bus speed
+ *
+ *	\return TWI_SPEED_STANDARD or TWI_SPEED_FAST, fast mode may have fallen back
+ */
+uint8_t twi_getSpeed(void){
+	return twi_speed;
 }
 
-/*! \brief Get the status of the TWI-communication
+/*! \brief Get the error counter
  *
- *  Get the Status of the TWI/I2C Communication. Status are the upper 5 Bits
+ *	\return Bus errors, arbitration losses and timeouts since twi_init()
  */
-uint8_t twi_get_status(void){
-	//status with mask. 
-	return TW_STATUS;	
+uint16_t twi_getErrors(void){
+	uint16_t errors;
+	uint8_t sreg = SREG;
+	cli();
+	errors = twi_errors;
+	SREG = sreg;
+	return errors;
 }
 
 
@@ -251,36 +370,18 @@ uint8_t twi_get_status(void){
  */
 uint8_t twi_writeReg(uint8_t devaddr, uint8_t regaddr, uint8_t data)
 {
-	//Start TWI/I2C Communication
-	uint8_t error =0;
-	error = twi_start();
-	if (error != TWI_OK) {
-		return error;
-	}
-	//Device-Address with write
-	error = twi_sendAdress(devaddr<<1);
-	if (error != TWI_OK)
-	{
-		return error;
-	}
-	//Send Register-Address for Write-Operation to Device
-	error = twi_write(regaddr);
-	if (error != TWI_WRITE_OK)
+	twi_transaction_t t;
+	uint16_t timeout = timeoutValue;
+	while (twi_writeRegAsync(&t, devaddr, regaddr, &data, 1, 0) == TWI_QUEUE_FULL)
 	{
-		return error;
-	}
-	
-	//Send Value to Device
-	error = twi_write(data);
-	if (error != TWI_WRITE_OK){
-		return error;
-	}
-	//End TWI/I2C Communication
-	error = twi_stop();
-	if (error != TWI_STOP_OK) {
-		return error;
+		if (timeout == 0)
+		{
+			return TWI_CONNECTION_ERROR;
+		}
+		_delay_us(TIMEOUT_DELAYWERT);
+		timeout--;
 	}
-	return TWI_WRITE_REG_OK;
+	return twi_wait(&t);
 }
 
 
@@ -294,63 +395,110 @@ uint8_t twi_writeReg(uint8_t devaddr, uint8_t regaddr, uint8_t data)
  */
 uint8_t twi_readReg(uint8_t devaddr, uint8_t regaddr, uint8_t* data, uint8_t length)
 {
-	//Start TWI/I2C Communication (Write-Mode)
-	uint8_t nack = length -1;
-	uint8_t error =0;
-	error = twi_start();
-	if (error) {
-		return error;
-	}
-	//Device-Address with write
-	error = twi_sendAdress(devaddr<<1);
-	if (error)
+	twi_transaction_t t;
+	uint16_t timeout = timeoutValue;
+	while (twi_readRegAsync(&t, devaddr, regaddr, data, length, 0) == TWI_QUEUE_FULL)
 	{
-		return error;
-	}
-	//Send Register-Address for Read-Operation to Device
-	error = twi_write(regaddr);
-	if (error)
-	{
-		return error;
-	}
-	
-	error = twi_start();
-	if (error) {
-		return error;
-	}
-	
-	//Switch Communication to Read-Mode
-	error = twi_sendAdress((devaddr<<1) + 0x01);
-	if (error) {
-		return error;
+		if (timeout == 0)
+		{
+			return TWI_CONNECTION_ERROR;
+		}
+		_delay_us(TIMEOUT_DELAYWERT);
+		timeout--;
 	}
-	
-	//Read Values from Device
-	for (uint8_t i = 0; i < (length); i++)
+	return twi_wait(&t);
+}
+
+/*! \brief Interrupt Service Routine
+ *
+ *  State machine of the TWI-queue. Every bus event of the transaction at twi_tail ends up here.
+ */
+ISR (TWI_vect){
+	twi_transaction_t *t = twi_queue[twi_tail & TWI_QUEUE_MASK];
+	uint8_t status = TW_STATUS;
+
+	switch (status)
 	{
-		if (i == nack)
+		case TW_START:
+		//Device-Address with write, the register address is always sent first
+		TWDR = (t->devaddr<<1);
+		TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWIE);
+		break;
+
+		case TW_REP_START:
+		//Switch Communication to Read-Mode
+		TWDR = (t->devaddr<<1) + 0x01;
+		TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWIE);
+		break;
+
+		case TW_MT_SLA_ACK:
+		//Send Register-Address to Device
+		twi_index = 0;
+		TWDR = t->regaddr;
+		TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWIE);
+		break;
+
+		case TW_MT_DATA_ACK:
+		if (t->type == TWI_TRANSACTION_READ)
+		{
+			//Register-Address sent, repeated start for reading
+			TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN) | (1<<TWIE);
+		}
+		else if (twi_index < t->length)
 		{
-			error = twi_read_nack();
-			if (error != TW_MR_DATA_NACK)
-			{
-				return error;
-			}
-		} 
+			TWDR = t->data[twi_index++];
+			TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWIE);
+		}
 		else
 		{
-			error = twi_read_ack();
-			if (error != TW_MR_DATA_ACK)
-			{
-				return error;
-			}
+			twi_finish(TWI_OK, 0);
 		}
-		data[i] = TWDR;
-	}
-	//Stop Communication
-	error = twi_stop();
-	if (error != TWI_STOP_OK)
-	{
-		return error;
+		break;
+
+		case TW_MR_SLA_ACK:
+		//READ with ACK unless only one byte is left
+		twi_index = 0;
+		if (t->length > 1)
+		{
+			TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA) | (1<<TWIE);
+		}
+		else
+		{
+			TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWIE);
+		}
+		break;
+
+		case TW_MR_DATA_ACK:
+		t->data[twi_index++] = TWDR;
+		if (twi_index < t->length - 1)
+		{
+			TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA) | (1<<TWIE);
+		}
+		else
+		{
+			TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWIE);
+		}
+		break;
+
+		case TW_MR_DATA_NACK:
+		t->data[twi_index++] = TWDR;
+		twi_finish(TWI_OK, 0);
+		break;
+
+		case TW_MT_SLA_NACK:
+		case TW_MR_SLA_NACK:
+		case TW_MT_DATA_NACK:
+		//Device busy or not present
+		twi_finish(status, 0);
+		break;
+
+		case TW_MT_ARB_LOST:
+		twi_finish(status, 1);
+		break;
+
+		default:
+		//Bus error, the STOP resets the hardware
+		twi_finish(TWI_BUS_ERROR, 0);
+		break;
 	}
-	return TWI_READ_REG_OK;
 }
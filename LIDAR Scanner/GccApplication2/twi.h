@@ -35,6 +35,42 @@
  */
 #define TWBR_val ((((F_CPU / F_SCL) / PRESCALER) - 16 ) / 2)
 
+/*! \def F_SCL_FAST
+ *
+ *  Define the SCL frequency in fast mode
+ */
+#define F_SCL_FAST 400000UL // SCL frequency in fast mode
+
+/*! \def TWBR_FAST_val
+ *
+ *  Define the Value for TWBR in fast mode
+ */
+#define TWBR_FAST_val ((((F_CPU / F_SCL_FAST) / PRESCALER) - 16 ) / 2)
+
+/*! \def TWI_SPEED_STANDARD
+ *
+ *  Define the bus speed F_SCL
+ */
+#define TWI_SPEED_STANDARD	0
+
+/*! \def TWI_SPEED_FAST
+ *
+ *  Define the bus speed F_SCL_FAST
+ */
+#define TWI_SPEED_FAST		1
+
+/*! \def TWI_FALLBACK_ERRORS
+ *
+ *  Define the quantity of bus errors in a row after which fast mode falls back to F_SCL
+ */
+#define TWI_FALLBACK_ERRORS	4
+
+/*! \def TWI_RECOVERY_CLOCKS
+ *
+ *  Define the peak of SCL clocks to release a slave which holds SDA low
+ */
+#define TWI_RECOVERY_CLOCKS	9
+
 /*! \def TWI_OK
  *
  *  Define the success value for TWI-Connection
@@ -107,6 +143,48 @@
  */
 #define TIMEOUT_TRYS		250
 
+/*! \def TWI_QUEUE_SIZE
+ *
+ *  Define the quantity of transactions the TWI-queue can hold (power of two)
+ */
+#define TWI_QUEUE_SIZE		4
+
+/*! \def TWI_QUEUE_MASK
+ *
+ *  Define the index mask for the TWI-queue
+ */
+#define TWI_QUEUE_MASK		(TWI_QUEUE_SIZE - 1)
+
+/*! \def TWI_QUEUE_FULL
+ *
+ *  Define the error code for a full TWI-queue
+ */
+#define TWI_QUEUE_FULL		6
+
+/*! \def TWI_BUS_ERROR
+ *
+ *  Define the error code for an illegal START or STOP condition on the bus
+ */
+#define TWI_BUS_ERROR		7
+
+/*! \def TWI_PENDING
+ *
+ *  Define the status of a transaction that is queued or in flight
+ */
+#define TWI_PENDING			0xFF
+
+/*! \def TWI_TRANSACTION_WRITE
+ *
+ *  Define the type of a register write transaction
+ */
+#define TWI_TRANSACTION_WRITE	0
+
+/*! \def TWI_TRANSACTION_READ
+ *
+ *  Define the type of a register read transaction (repeated start)
+ */
+#define TWI_TRANSACTION_READ	1
+
 /*! \def SCL
  *
  *  Define the SCL Pin
@@ -123,12 +201,46 @@
 #include <util/delay.h>
 #include <avr/io.h>
 #include <util/twi.h>
+#include <avr/interrupt.h>
+
+
+/*! \brief Completion callback of a TWI-transaction
+ *
+ *  The callback is called from the TWI-ISR with the final status of the transaction.
+ *  It may submit new transactions.
+ */
+typedef void (*twi_callback_t)(uint8_t status);
+
+/*! \brief TWI-transaction descriptor
+ *
+ *  Describes one register access of a device. The descriptor and the data buffer are owned by the caller
+ *  and have to stay valid until the status is no longer TWI_PENDING.
+ */
+typedef struct {
+	uint8_t devaddr;				/*!< Address of the Device */
+	uint8_t regaddr;				/*!< Address of the Register */
+	uint8_t *data;					/*!< Data to write or buffer for the read data */
+	uint8_t length;					/*!< Length in Byte */
+	uint8_t type;					/*!< TWI_TRANSACTION_WRITE or TWI_TRANSACTION_READ */
+	volatile uint8_t status;		/*!< TWI_PENDING, TWI_OK or an error code */
+	twi_callback_t callback;		/*!< Called on completion, may be 0 */
+} twi_transaction_t;
 
 
 void twi_init(void);
 uint8_t twi_get_status(void);
 uint8_t twi_writeReg(uint8_t devaddr, uint8_t regaddr, uint8_t data);
 uint8_t twi_readReg(uint8_t devaddr, uint8_t regaddr, uint8_t* data, uint8_t length);
+uint8_t twi_submit(twi_transaction_t *transaction);
+uint8_t twi_writeRegAsync(twi_transaction_t *transaction, uint8_t devaddr, uint8_t regaddr, uint8_t *data, uint8_t length, twi_callback_t callback);
+uint8_t twi_readRegAsync(twi_transaction_t *transaction, uint8_t devaddr, uint8_t regaddr, uint8_t *data, uint8_t length, twi_callback_t callback);
+uint8_t twi_wait(twi_transaction_t *transaction);
+uint8_t twi_isBusy(void);
+void twi_abort(void);
+void twi_recover(void);
+void twi_setSpeed(uint8_t speed);
+uint8_t twi_getSpeed(void);
+uint16_t twi_getErrors(void);
 
 
 #endif /* TWI_H_ */
\ No newline at end of file
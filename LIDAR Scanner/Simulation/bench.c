@@ -0,0 +1,1160 @@
+/*
+ * bench.c
+ *
+ * Created: 17.10.2026
+ *
+ * Virtual host. It boots the firmware in the simulation, measures the calibration, the latency of
+ * commands, optionally switches the baud rate with the link test and measures a radar scan, the
+ * rotating mode, the monitor mode or the velocity stream, reads the time budget of the scan and prints the results.
+ * The exit code is 0 if every phase passed.
+ */
+
+#include "sim.h"
+#include "room.h"
+#include "motor.h"
+#include "servo.h"
+#include "scan.h"
+#include "serial.h"
+#include "lidar.h"
+#include <util/crc16.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+int firmware_main(void);
+
+/*! \def BENCH_QUIET
+ *
+ *  Define the time without characters after which the firmware is seen as idle
+ */
+#define BENCH_QUIET		(20 * SIM_MS)
+
+/*! \def BENCH_TIMEOUT
+ *
+ *  Define the time without progress after which a phase fails
+ */
+#define BENCH_TIMEOUT	(10000 * SIM_MS)
+
+/*! \def BENCH_TOLERANCE
+ *
+ *  Define the maximum difference to the room model in cm for a correct point
+ */
+#define BENCH_TOLERANCE	5.0
+
+/*! \def BENCH_PASS
+ *
+ *  Define the share of correct points the scan needs to pass
+ */
+#define BENCH_PASS		0.9
+
+/*! \def BENCH_MONITOR_TIME
+ *
+ *  Define the time the monitor mode watches the static room and the room with the intruder
+ */
+#define BENCH_MONITOR_TIME	(3000 * SIM_MS)
+
+/*! \def BENCH_INTRUDER_...
+ *
+ *  Define the intruder for the monitor mode: position and radius in cm, it is in front of the wall at azimuth 90
+ */
+#define BENCH_INTRUDER_X		0.0
+#define BENCH_INTRUDER_Y		150.0
+#define BENCH_INTRUDER_RADIUS	15.0
+
+/*! \def BENCH_VELOCITY_...
+ *
+ *  Define the target of the velocity stream: the intruder starts at BENCH_VELOCITY_Y and approaches the
+ *  scanner with BENCH_VELOCITY_SPEED in cm/s after BENCH_VELOCITY_SETTLE, until it reaches BENCH_VELOCITY_STOP.
+ *  Samples before BENCH_VELOCITY_SETTLE are not rated, the servo is still moving then.
+ */
+#define BENCH_VELOCITY_Y		280.0
+#define BENCH_VELOCITY_STOP		80.0
+#define BENCH_VELOCITY_SPEED	50.0
+#define BENCH_VELOCITY_SETTLE	(500 * SIM_MS)
+
+/*! \brief Phases of the bench */
+enum {
+	BENCH_BOOT,			/*!< Waiting for "Type #? ..." */
+	BENCH_LATENCY,		/*!< Commands with a short answer */
+	BENCH_LINK,			/*!< Baud rate switch with link test */
+	BENCH_SETUP,		/*!< Output format and timestamp */
+	BENCH_SCAN,			/*!< Radar mode, monitor mode or velocity stream */
+	BENCH_CANCEL,		/*!< Waiting for the firmware after cancelling the scan */
+	BENCH_PROFILE,		/*!< Time budget of the scan */
+	BENCH_DONE
+};
+
+/*! \brief Options */
+static uint16_t bench_points = 300;
+static uint16_t bench_avg = 10;
+static uint8_t bench_runs = 8;
+static uint8_t bench_3d = 0;
+static uint8_t bench_rotate = 0;
+static uint8_t bench_format = SCAN_FORMAT_ASCII;
+static uint8_t bench_timestamp = 0;
+static int bench_window[6] = {0, MOTOR_MAX_STEPS/2, 1, 0, SERVO_MAX_DEG/2, 1};
+static uint8_t bench_mode = MOTOR_MODE_FULL;
+static uint8_t bench_verbose = 0;
+
+/*! \brief Threshold of the monitor mode (#m), 0 for the radar modes */
+static uint16_t bench_monitor = 0;
+
+/*! \brief Scale of the velocity stream (#v), 0xFF for the other modes */
+static uint8_t bench_velocity = 0xFF;
+
+/*! \brief Command which starts the scan */
+static char bench_scanCommand[16];
+
+/*! \brief Index of the baud rate for "#u", 0xFF for no switch, and set if the host does not follow the switch */
+static uint8_t bench_link = 0xFF;
+static uint8_t bench_linkStay = 0;
+
+static uint8_t bench_phase = BENCH_BOOT;
+static sim_time_t bench_deadline = BENCH_TIMEOUT;
+static sim_time_t bench_poll = 0;
+
+/*! \brief Set to save the settings with #c 1 after the setup, or to skip the setup because the
+ *  firmware loads them from the EEPROM */
+static uint8_t bench_configSave = 0;
+static uint8_t bench_configLoad = 0;
+
+/*! \brief Commands before the scan */
+static char bench_setupCommands[6][40];
+static uint8_t bench_setupCount = 0;
+static uint8_t bench_setup = 0;
+
+/*! \brief Received text line and the time of its first character */
+static char bench_line[128];
+static uint8_t bench_lineLength = 0;
+static sim_time_t bench_lineStart;
+
+/*! \brief Received binary scan record */
+static uint8_t bench_record[SCAN_BLOCK_LENGTH + 1];
+static uint8_t bench_recordLength = 0;
+static uint8_t bench_recordSize;
+
+/*! \brief Characters received during the scan */
+static uint32_t bench_bytes = 0;
+
+/*! \brief Time of the last received character */
+static sim_time_t bench_lastChar = 0;
+
+/*! \brief Time when the last command has arrived and set until the first character of the answer */
+static sim_time_t bench_sent = 0;
+static uint8_t bench_sending = 0;
+
+/*! \brief Link test: state, announced rate and the echo of the test block */
+enum {
+	BENCH_LINK_COMMAND,	/*!< "#u" not sent yet */
+	BENCH_LINK_ANNOUNCE,	/*!< Waiting for "Baud = " */
+	BENCH_LINK_BLOCK,	/*!< Announced, the test block is sent after a quiet time */
+	BENCH_LINK_ECHO,	/*!< Test block sent, receiving the echo */
+	BENCH_LINK_RESULT	/*!< Waiting for "Link baud = " */
+};
+static uint8_t bench_linkState = BENCH_LINK_COMMAND;
+static unsigned long bench_linkBaud = 0;
+static uint8_t bench_echo = 0;
+static uint8_t bench_echoErrors = 0;
+
+/*! \brief Monitor mode: first sweep, static room, waiting for the alert, watching the intruder */
+enum {
+	BENCH_MONITOR_LEARN,
+	BENCH_MONITOR_STATIC,
+	BENCH_MONITOR_ALERT,
+	BENCH_MONITOR_AFTER
+};
+static uint8_t bench_monitorState = BENCH_MONITOR_LEARN;
+static sim_time_t bench_monitorStart;
+static uint16_t bench_monitorCount;
+static uint32_t bench_monitorBytes;
+
+/*! \brief Results */
+static sim_time_t bench_calibrationStart;
+static sim_time_t bench_calibrationEnd;
+static sim_time_t bench_ready;
+static sim_time_t bench_latencySum = 0;
+static sim_time_t bench_latencyMax = 0;
+static uint8_t bench_latencyCount = 0;
+static uint16_t bench_count = 0;
+static sim_time_t bench_first;
+static sim_time_t bench_last;
+static double bench_errorSum = 0;
+static uint16_t bench_correct = 0;
+static uint16_t bench_crcErrors = 0;
+static uint16_t bench_outside = 0;
+static uint16_t bench_wrongFormat = 0;
+static uint8_t bench_configLoaded = 0;
+static uint8_t bench_seen[MOTOR_MAX_POSITIONS][SERVO_MAX_DEG/2 + 1];
+static uint16_t bench_seenCount = 0;
+static sim_time_t bench_pass = 0;
+static sim_time_t bench_cancelSent;
+static sim_time_t bench_cancelReady;
+static uint32_t bench_stampFirst;
+static uint32_t bench_stampLast;
+static uint16_t bench_stampCount = 0;
+static uint16_t bench_stampErrors = 0;
+static unsigned long bench_profile[SCAN_PHASES];
+static unsigned long bench_profileTotal;
+static unsigned int bench_profilePoints;
+static uint8_t bench_profileSent = 0;
+static unsigned long bench_linkResult[5];
+static uint16_t bench_staticEvents;
+static uint32_t bench_staticBytes;
+static sim_time_t bench_alert = 0;
+static sim_time_t bench_velocityStart;
+static sim_time_t bench_velocityOffset;
+static uint16_t bench_velocityCount = 0;
+static long bench_velocitySumFirst;
+static long bench_velocitySumLast;
+static double bench_velocityTruth;
+static double bench_velocitySquares = 0;
+static uint16_t bench_velocityMissed = 0;
+static uint16_t bench_frames = 0;
+static uint16_t bench_frameErrors = 0;
+static uint32_t bench_framePoints = 0;
+static uint32_t bench_frameMissed = 0;
+static uint16_t bench_frameCount = 0;
+static sim_time_t bench_frameFirst;
+static sim_time_t bench_frameLast;
+static uint16_t bench_syncCorrections = 0;
+static uint16_t bench_syncLost = 0;
+static uint8_t bench_units = 0;
+static uint16_t bench_unitPoints[LIDAR_UNITS_MAX];
+static uint16_t bench_wrongUnit = 0;
+
+
+static double bench_ms(sim_time_t t){
+	return t / (double)SIM_MS;
+}
+
+static void bench_send(const char *command){
+	bench_sent = sim_uart_send(command, strlen(command));
+	bench_sending = 1;
+}
+
+//Every stop of the scan gives a point per unit, only the cancel may cut the points of the last stop
+static uint8_t bench_evenUnits(void){
+	uint16_t min = 0xFFFF;
+	uint16_t max = 0;
+	for (uint8_t i = 0; i < sim_config.lidar_units; i++)
+	{
+		min = bench_unitPoints[i] < min ? bench_unitPoints[i] : min;
+		max = bench_unitPoints[i] > max ? bench_unitPoints[i] : max;
+	}
+	return max - min <= 1;
+}
+
+static void bench_finish(const char *failure){
+	double seconds = (bench_last - bench_first) / 1e9;
+	printf("calibration_ms        %.1f\n", bench_ms(bench_calibrationEnd - bench_calibrationStart));
+	printf("boot_ms               %.1f\n", bench_ms(bench_ready));
+	if (bench_latencyCount)
+	{
+		printf("command_latency_us    %.0f (max %.0f, n = %u)\n",
+			bench_latencySum / (double)bench_latencyCount / SIM_US, bench_latencyMax / (double)SIM_US, bench_latencyCount);
+	}
+	if (bench_phase > BENCH_LINK && bench_link != 0xFF)
+	{
+		printf("link_baud             %lu (received %lu, errors %lu, confirmed %lu)\n",
+			bench_linkResult[0], bench_linkResult[1], bench_linkResult[2], bench_linkResult[3]);
+		printf("link_echo_us          %lu\n", bench_linkResult[4]);
+	}
+	if (bench_count)
+	{
+		static const char *formats[] = {"ascii", "binary", "delta"};
+		printf("scan_mode             %s %s %s steps\n", bench_monitor ? "monitor" : (bench_3d ? "3D" : (bench_rotate ? "rotate" : "2D")), formats[bench_format],
+			bench_mode == MOTOR_MODE_HALF ? "half" : "full");
+		printf("scan_points           %u\n", bench_count);
+		printf("scan_points_per_s     %.1f\n", bench_count > 1 && seconds > 0 ? (bench_count - 1) / seconds : 0.0);
+		printf("scan_error_cm         %.2f (%.1f %% within %.0f cm)\n",
+			bench_errorSum / bench_count, 100.0 * bench_correct / bench_count, BENCH_TOLERANCE);
+		printf("scan_crc_errors       %u\n", bench_crcErrors);
+		printf("scan_bytes_per_point  %.2f\n", bench_bytes / (double)bench_count);
+		printf("scan_outside_window   %u\n", bench_outside);
+		printf("scan_wrong_format     %u\n", bench_wrongFormat);
+		if (sim_config.lidar_units > 1)
+		{
+			printf("scan_unit_points     ");
+			for (uint8_t i = 0; i < sim_config.lidar_units; i++)
+			{
+				printf(" %u", bench_unitPoints[i]);
+			}
+			printf(" (%u wrong units)\n", bench_wrongUnit);
+		}
+		if (bench_pass)
+		{
+			printf("scan_pass_ms          %.1f (%u points)\n", bench_ms(bench_pass), bench_seenCount);
+		}
+	}
+	if (bench_frames)
+	{
+		//The first frame is the part of a turn until position 0
+		uint16_t full = bench_frames - 1;
+		printf("rotate_frames         %u (%u errors)\n", bench_frames, bench_frameErrors);
+		if (full)
+		{
+			printf("rotate_revolution_ms  %.1f (%.1f points, %.1f missed)\n", bench_ms(bench_frameLast - bench_frameFirst) / full,
+				bench_framePoints / (double)full, bench_frameMissed / (double)full);
+		}
+		printf("rotate_sync           %u corrections (%u lost)\n", bench_syncCorrections, bench_syncLost);
+	}
+	if (bench_monitorState > BENCH_MONITOR_STATIC)
+	{
+		printf("monitor_static_events %u in %.0f ms (%.1f bytes/s)\n", bench_staticEvents, bench_ms(BENCH_MONITOR_TIME),
+			bench_staticBytes / (BENCH_MONITOR_TIME / 1e9));
+	}
+	if (bench_alert)
+	{
+		printf("monitor_alert_ms      %.1f\n", bench_ms(bench_alert));
+	}
+	if (bench_velocityCount > 1)
+	{
+		double displacement = bench_velocitySumLast - bench_velocitySumFirst;
+		printf("velocity_samples      %u (%u missed)\n", bench_velocityCount, bench_velocityMissed);
+		printf("velocity_mean         %.2f counts (truth %.2f, %s m/s per count)\n", displacement / (bench_velocityCount - 1),
+			bench_velocityTruth / (bench_velocityCount - 1), bench_velocity ? "1" : "0.1");
+		printf("velocity_rms_counts   %.2f\n", sqrt(bench_velocitySquares / (bench_velocityCount - 1)));
+		printf("velocity_displacement %.0f cm (truth %.1f)\n", displacement, bench_velocityTruth);
+	}
+	if (bench_stampCount > 1)
+	{
+		printf("scan_stamp_interval_us %.0f (%u not increasing)\n",
+			(uint32_t)(bench_stampLast - bench_stampFirst) / (double)(bench_stampCount - 1), bench_stampErrors);
+	}
+	if (bench_phase >= BENCH_PROFILE)
+	{
+		printf("cancel_to_ready_ms    %.1f\n", bench_ms(bench_cancelReady - bench_cancelSent));
+	}
+	if (bench_phase == BENCH_DONE && bench_profileSent)
+	{
+		static const char *names[SCAN_PHASES] = {"motor", "servo", "acquisition", "serial"};
+		printf("profile_points        %u in %.1f ms\n", bench_profilePoints, bench_profileTotal / 1000.0);
+		for (uint8_t i = 0; i < SCAN_PHASES; i++)
+		{
+			printf("profile_%-13s %.1f ms (%.1f %%)\n", names[i], bench_profile[i] / 1000.0,
+				bench_profileTotal ? 100.0 * bench_profile[i] / bench_profileTotal : 0.0);
+		}
+	}
+	printf("motor_steps           %u (%u too fast)\n", sim_motor_steps(), sim_motor_fastSteps());
+	printf("motor_snap            %d half steps\n", sim_motor_snap());
+	if (sim_config.slip_steps)
+	{
+		printf("motor_slips           %u\n", sim_motor_slips());
+	}
+	printf("lidar_units           %u (%u found)\n", sim_config.lidar_units, bench_units);
+	printf("lidar_acquisitions    %u (%u while the servo moved)\n", sim_lidar_acquisitions(), sim_lidar_unsettled());
+	printf("twi_transactions      %u\n", sim_twi_transactions());
+	if (sim_config.twi_stuck)
+	{
+		printf("twi_recoveries        %u\n", sim_twi_recoveries());
+	}
+	printf("uart_lost             %u\n", sim_uart_lost());
+	printf("eeprom_writes         %u\n", sim_eeprom_writes());
+	printf("sim_time_ms           %.1f\n", bench_ms(sim_now()));
+
+	int code = 0;
+	if (failure)
+	{
+		printf("FAIL: %s\n", failure);
+		code = 1;
+	}
+	else if (sim_config.twi_stuck && (sim_twi_stuck() || !sim_twi_recoveries()))
+	{
+		printf("FAIL: bus not recovered\n");
+		code = 1;
+	}
+	else if (bench_count && bench_correct < BENCH_PASS * bench_count)
+	{
+		printf("FAIL: scan does not match the room\n");
+		code = 1;
+	}
+	else if (bench_outside)
+	{
+		printf("FAIL: points outside of the window\n");
+		code = 1;
+	}
+	else if (bench_units != sim_config.lidar_units || bench_wrongUnit || (bench_count && !bench_monitor && !bench_evenUnits()))
+	{
+		printf("FAIL: points of the LIDAR-Lite units\n");
+		code = 1;
+	}
+	else if (bench_wrongFormat || (bench_count && bench_timestamp && !bench_stampCount))
+	{
+		printf("FAIL: points not in the format of the settings\n");
+		code = 1;
+	}
+	else if (bench_rotate && (bench_frames < 2 || bench_frameErrors || bench_syncLost))
+	{
+		printf("FAIL: frames of the rotating mode\n");
+		code = 1;
+	}
+	else if (bench_configLoad && !bench_configLoaded)
+	{
+		printf("FAIL: configuration not loaded\n");
+		code = 1;
+	}
+	else if (bench_configLoad && sim_motor_snap())
+	{
+		printf("FAIL: rotor moved when the coils were energized\n");
+		code = 1;
+	}
+	else if (bench_velocity != 0xFF && (bench_velocityMissed || bench_stampErrors ||
+		fabs(bench_velocitySumLast - bench_velocitySumFirst - bench_velocityTruth) > 2 * BENCH_TOLERANCE))
+	{
+		printf("FAIL: velocity does not match the target\n");
+		code = 1;
+	}
+	else
+	{
+		printf("PASS\n");
+	}
+	fflush(stdout);
+	_exit(code);
+}
+
+static void bench_stamp(uint32_t time){
+	if (bench_stampCount == 0)
+	{
+		bench_stampFirst = time;
+	}
+	else if ((int32_t)(time - bench_stampLast) <= 0)
+	{
+		bench_stampErrors++;
+	}
+	bench_stampLast = time;
+	bench_stampCount++;
+}
+
+static void bench_point(uint16_t mpos, uint8_t spos, uint16_t value, uint8_t unit){
+	//Start and end of the window are full steps, the stride counts positions of the step mode
+	uint16_t positions = MOTOR_MAX_STEPS << bench_mode;
+	int mstart = bench_window[0] << bench_mode;
+	int mend = bench_window[1] << bench_mode;
+	int stride = bench_window[2];
+	if (bench_monitor && bench_mode == MOTOR_MODE_HALF)
+	{
+		//The monitor mode keeps to the full steps
+		stride = (stride + 1) & ~1;
+	}
+	//The window is scanned by unit 0, the others are mounted evenly around the rotor
+	uint16_t offset = unit * (MOTOR_MAX_STEPS / sim_config.lidar_units) << bench_mode;
+	uint16_t base = (mpos + positions - offset % positions) % positions;
+	if (unit >= sim_config.lidar_units)
+	{
+		bench_wrongUnit++;
+		return;
+	}
+	bench_unitPoints[unit]++;
+	if (bench_rotate)
+	{
+		//The grid of the rotating mode covers the whole turn from position 0
+		mstart = 0;
+		mend = positions - 1;
+	}
+	double truth = room_range(mpos * 360.0 / positions, spos);
+	double error = fabs(value - truth);
+	if (bench_count == 0)
+	{
+		bench_first = sim_now();
+	}
+	bench_last = sim_now();
+	bench_count++;
+	if (base < mstart || base > mend || (base - mstart) % stride != 0 ||
+		(bench_3d && (spos < bench_window[3] || spos > bench_window[4] || (spos - bench_window[3]) % bench_window[5] != 0)))
+	{
+		bench_outside++;
+	}
+	else if (mpos >= mstart && mpos <= mend && (mpos - mstart) % stride == 0 && !bench_seen[mpos][bench_3d ? spos : 0])
+	{
+		//Time until every point of the window was measured once, by any unit
+		uint16_t columns = (mend - mstart) / stride + 1;
+		uint16_t rows = bench_3d ? (bench_window[4] - bench_window[3]) / bench_window[5] + 1 : 1;
+		bench_seen[mpos][bench_3d ? spos : 0] = 1;
+		if (++bench_seenCount == columns * rows)
+		{
+			bench_pass = bench_last - bench_first;
+		}
+	}
+	bench_errorSum += error;
+	if (error <= BENCH_TOLERANCE)
+	{
+		bench_correct++;
+	}
+	bench_deadline = sim_now() + BENCH_TIMEOUT;
+
+	if (bench_monitorState == BENCH_MONITOR_ALERT && value < BENCH_INTRUDER_Y &&
+		fabs(mpos * 360.0 / positions - 90.0) < 15.0)
+	{
+		//First point on the intruder
+		bench_alert = sim_now() - bench_monitorStart;
+		bench_monitorStart = sim_now();
+		bench_monitorState = BENCH_MONITOR_AFTER;
+	}
+	if (bench_count == bench_points && !bench_monitor)
+	{
+		//Every new command cancels the scan
+		bench_cancelSent = sim_uart_send("#", 1);
+		sim_uart_send("?\r\n", 3);
+		bench_phase = BENCH_CANCEL;
+	}
+}
+
+//Frame marker of the rotating mode. It has to follow the last point of its revolution, every revolution
+//after the first one covers the whole grid with its points and the missed points. The points of all units are counted.
+static void bench_frame(unsigned int revolution, unsigned int points, unsigned int missed, int sync){
+	uint16_t positions = MOTOR_MAX_STEPS << bench_mode;
+	unsigned int grid = (positions + bench_window[2] - 1) / bench_window[2];
+	if (revolution != bench_frames || points != (unsigned int)(bench_count - bench_frameCount) ||
+		points % sim_config.lidar_units != 0 ||
+		(revolution > 0 && (points / sim_config.lidar_units + missed != grid || sync == MOTOR_SYNC_NONE)))
+	{
+		bench_frameErrors++;
+	}
+	if (revolution == 0)
+	{
+		bench_frameFirst = sim_now();
+	}
+	else
+	{
+		bench_framePoints += points / sim_config.lidar_units;
+		bench_frameMissed += missed;
+	}
+	if (sync == MOTOR_SYNC_LOST)
+	{
+		bench_syncLost++;
+	}
+	else if (sync != MOTOR_SYNC_NONE && sync != 0)
+	{
+		bench_syncCorrections++;
+	}
+	bench_frameLast = sim_now();
+	bench_frameCount = bench_count;
+	bench_frames++;
+}
+
+//Position of the velocity target at a time of the simulation
+static double bench_velocity_target(sim_time_t now){
+	double t = ((double)now - bench_velocityStart - BENCH_VELOCITY_SETTLE) / 1e9;
+	double y = BENCH_VELOCITY_Y - BENCH_VELOCITY_SPEED * (t > 0 ? t : 0);
+	return y > BENCH_VELOCITY_STOP ? y : BENCH_VELOCITY_STOP;
+}
+
+static void bench_velocity_sample(int velocity, long sum, uint32_t time){
+	//Period of the sensor: burst delay in 0.5 ms plus the acquisition
+	double period = (bench_velocity ? LIDAR_VELOCITY_DELAY_FAST : LIDAR_VELOCITY_DELAY_SLOW) * 500.0 + sim_config.lidar_acq_us;
+	bench_deadline = sim_now() + BENCH_TIMEOUT;
+	if (bench_lineStart < bench_velocityStart + BENCH_VELOCITY_SETTLE)
+	{
+		//The servo is still moving
+		return;
+	}
+	if (bench_velocityCount == 0)
+	{
+		//The line follows the measure within a few ms, that is the offset of the clocks
+		bench_velocityOffset = bench_lineStart - (sim_time_t)time * SIM_US;
+		bench_velocitySumFirst = sum;
+	}
+	else
+	{
+		double interval = (uint32_t)(time - bench_stampLast);
+		//Range to the target changes like its position, it is straight ahead
+		double truth = bench_velocity_target((sim_time_t)time * SIM_US + bench_velocityOffset) -
+			bench_velocity_target((sim_time_t)bench_stampLast * SIM_US + bench_velocityOffset);
+		long k = lround(interval / period);
+		if (k > 1)
+		{
+			bench_velocityMissed += k - 1;
+		}
+		bench_velocityTruth += truth;
+		bench_velocitySquares += (velocity - truth) * (velocity - truth);
+	}
+	bench_stamp(time);
+	bench_velocitySumLast = sum;
+	if (++bench_velocityCount == bench_points)
+	{
+		bench_cancelSent = sim_uart_send("#", 1);
+		sim_uart_send("?\r\n", 3);
+		bench_phase = BENCH_CANCEL;
+	}
+}
+
+//Read a varint of a block, returns 0 if the block ends before
+static uint8_t bench_varint(uint8_t *index, uint8_t length, uint32_t *value){
+	uint8_t shift = 0;
+	*value = 0;
+	while (*index < length)
+	{
+		uint8_t b = bench_record[(*index)++];
+		*value |= (uint32_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+		{
+			return 1;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+static int32_t bench_zigzag(uint32_t v){
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+//Decode the first length bytes of a block of the delta format, the points are only used if points is set.
+//Returns the length of the block with the CRC, 0 if it is not complete yet
+static uint8_t bench_delta(uint8_t length, uint8_t points){
+	if (length < 3)
+	{
+		return 0;
+	}
+	uint8_t count = bench_record[2] & ~SCAN_DELTA_TIME;
+	uint8_t timestamp = bench_record[2] & SCAN_DELTA_TIME;
+	uint8_t index = timestamp ? 11 : 7;
+	if (length < index)
+	{
+		return 0;
+	}
+	int32_t mpos = bench_record[3] | ((bench_record[4] & SCAN_MPOS_HIGH) << 1);
+	int32_t spos = bench_record[4] & ~SCAN_MPOS_HIGH;
+	int32_t value = bench_record[5] | (bench_record[6] << 8);
+	uint32_t time = bench_record[7] | (bench_record[8] << 8) | ((uint32_t)bench_record[9] << 16) | ((uint32_t)bench_record[10] << 24);
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (i > 0)
+		{
+			uint32_t dm, ds, dv, dt = 0;
+			if (!bench_varint(&index, length, &dm) || !bench_varint(&index, length, &ds) ||
+				!bench_varint(&index, length, &dv) || (timestamp && !bench_varint(&index, length, &dt)))
+			{
+				return 0;
+			}
+			mpos += bench_zigzag(dm);
+			spos += bench_zigzag(ds);
+			value += bench_zigzag(dv);
+			time += dt;
+		}
+		if (points)
+		{
+			if (timestamp)
+			{
+				bench_stamp(time);
+			}
+			bench_point(mpos, spos, value & ((1 << SCAN_UNIT_SHIFT) - 1), value >> SCAN_UNIT_SHIFT);
+		}
+	}
+	return index < length ? index + 1 : 0;
+}
+
+static void bench_record_done(void){
+	uint8_t crc = 0;
+	for (uint8_t i = 1; i < bench_recordSize - 1; i++)
+	{
+		crc = _crc8_ccitt_update(crc, bench_record[i]);
+	}
+	if (crc != bench_record[bench_recordSize - 1])
+	{
+		bench_crcErrors++;
+		return;
+	}
+	if (bench_phase == BENCH_SCAN && bench_record[0] == SCAN_SYNC_FRAME)
+	{
+		bench_frame(bench_record[2] | (bench_record[3] << 8), bench_record[4] | (bench_record[5] << 8),
+			bench_record[6] | (bench_record[7] << 8), (int8_t)bench_record[8]);
+		return;
+	}
+	if (bench_phase == BENCH_SCAN && (bench_record[0] == SCAN_SYNC_DELTA) != (bench_format == SCAN_FORMAT_DELTA))
+	{
+		bench_wrongFormat++;
+	}
+	if (bench_phase == BENCH_SCAN && bench_record[0] == SCAN_SYNC_DELTA)
+	{
+		bench_delta(bench_recordSize, 1);
+	}
+	else if (bench_phase == BENCH_SCAN)
+	{
+		if (bench_record[0] == SCAN_SYNC_TIME)
+		{
+			bench_stamp(bench_record[6] | (bench_record[7] << 8) | ((uint32_t)bench_record[8] << 16) | ((uint32_t)bench_record[9] << 24));
+		}
+		uint16_t value = bench_record[4] | (bench_record[5] << 8);
+		bench_point(bench_record[2] | ((bench_record[3] & SCAN_MPOS_HIGH) << 1), bench_record[3] & ~SCAN_MPOS_HIGH,
+			value & ((1 << SCAN_UNIT_SHIFT) - 1), value >> SCAN_UNIT_SHIFT);
+	}
+}
+
+static void bench_line_done(void){
+	unsigned int mpos, spos, value;
+	unsigned int revolution, missed;
+	const char *id;
+	char sync[8];
+	unsigned long time;
+	int velocity;
+	long sum;
+	if (bench_verbose)
+	{
+		fprintf(stderr, "%10.3f  %s\n", bench_ms(bench_lineStart), bench_line);
+	}
+
+	switch (bench_phase)
+	{
+		case BENCH_BOOT:
+		if (strncmp(bench_line, "Calibrating", 11) == 0)
+		{
+			bench_calibrationStart = bench_lineStart;
+		}
+		else if (strncmp(bench_line, "CONFIG LOADED", 13) == 0)
+		{
+			bench_configLoaded = 1;
+		}
+		else if (strncmp(bench_line, "LIDAR Ready", 11) == 0)
+		{
+			bench_calibrationEnd = bench_lineStart;
+		}
+		else if (sscanf(bench_line, "LIDAR units = %u", &value) == 1)
+		{
+			bench_units = value;
+		}
+		else if (strncmp(bench_line, "Type #?", 7) == 0)
+		{
+			bench_ready = sim_now();
+			bench_phase = BENCH_LATENCY;
+			bench_deadline = sim_now() + BENCH_TIMEOUT;
+		}
+		break;
+
+		case BENCH_SCAN:
+		if (sscanf(bench_line, "vel: %d sum: %ld t: %lu", &velocity, &sum, &time) == 3)
+		{
+			bench_velocity_sample(velocity, sum, time);
+		}
+		if (sscanf(bench_line, "frame: %u points: %u missed: %u sync: %7s", &revolution, &value, &missed, sync) == 4)
+		{
+			if (bench_format != SCAN_FORMAT_ASCII)
+			{
+				bench_wrongFormat++;
+			}
+			bench_frame(revolution, value, missed, strcmp(sync, "none") == 0 ? MOTOR_SYNC_NONE :
+				(strcmp(sync, "lost") == 0 ? MOTOR_SYNC_LOST : atoi(sync)));
+		}
+		switch (sscanf(bench_line, "mpos: %u sdeg: %u val: %u t: %lu", &mpos, &spos, &value, &time))
+		{
+			case 4:
+			bench_stamp(time);
+			//no break
+			case 3:
+			if (bench_format != SCAN_FORMAT_ASCII)
+			{
+				bench_wrongFormat++;
+			}
+			//The unit is only sent with more than one
+			id = strstr(bench_line, " id: ");
+			if ((id != 0) != (sim_config.lidar_units > 1))
+			{
+				bench_wrongFormat++;
+			}
+			bench_point(mpos, spos, value, id ? atoi(id + 5) : 0);
+			break;
+		}
+		break;
+
+		case BENCH_LINK:
+		if (sscanf(bench_line, "Baud = %lu", &bench_linkBaud) == 1)
+		{
+			bench_linkState = BENCH_LINK_BLOCK;
+		}
+		else if (strncmp(bench_line, "Unknown baud rate", 17) == 0)
+		{
+			bench_finish("link test");
+		}
+		else if (sscanf(bench_line, "Link baud = %lu received = %lu errors = %lu confirmed = %lu time (us) = %lu",
+			&bench_linkResult[0], &bench_linkResult[1], &bench_linkResult[2], &bench_linkResult[3], &bench_linkResult[4]) == 5)
+		{
+			unsigned long expected = bench_linkStay ? sim_config.host_baud : bench_linkBaud;
+			bench_phase = BENCH_SETUP;
+			if (bench_linkResult[0] != expected || bench_linkResult[3] == bench_linkStay)
+			{
+				bench_finish("link test");
+			}
+		}
+		break;
+
+		case BENCH_CANCEL:
+		if (strncmp(bench_line, "Possible actions", 16) == 0)
+		{
+			bench_cancelReady = bench_lineStart;
+			//The velocity stream has no time budget
+			bench_phase = bench_velocity != 0xFF ? BENCH_DONE : BENCH_PROFILE;
+		}
+		break;
+
+		case BENCH_PROFILE:
+		sscanf(bench_line, "Profile (us) points = %u total = %lu", &bench_profilePoints, &bench_profileTotal);
+		if (sscanf(bench_line, " motor = %lu servo = %lu acquisition = %lu serial = %lu",
+			&bench_profile[SCAN_PHASE_MOTOR], &bench_profile[SCAN_PHASE_SERVO],
+			&bench_profile[SCAN_PHASE_ACQUISITION], &bench_profile[SCAN_PHASE_SERIAL]) == 4)
+		{
+			bench_phase = BENCH_DONE;
+		}
+		break;
+	}
+}
+
+//Called for every character of the firmware
+static void bench_receive(uint8_t c){
+	bench_lastChar = sim_now();
+	if (bench_phase == BENCH_SCAN)
+	{
+		bench_bytes++;
+	}
+	if (bench_sending)
+	{
+		//First character of the answer
+		bench_sending = 0;
+		if (bench_phase == BENCH_LATENCY)
+		{
+			sim_time_t latency = sim_now() - bench_sent;
+			bench_latencySum += latency;
+			if (latency > bench_latencyMax)
+			{
+				bench_latencyMax = latency;
+			}
+			bench_latencyCount++;
+		}
+	}
+
+	if (bench_phase == BENCH_LINK && bench_linkState == BENCH_LINK_ECHO)
+	{
+		//Echo of the test block, confirmed if every byte is right
+		if (c != (uint8_t)((bench_echo * 0x1D) ^ 0x55))
+		{
+			bench_echoErrors++;
+		}
+		if (++bench_echo == SERIAL_LINK_LENGTH)
+		{
+			bench_linkState = BENCH_LINK_RESULT;
+			if (!bench_echoErrors)
+			{
+				char confirm = SERIAL_LINK_CONFIRM;
+				sim_uart_send(&confirm, 1);
+			}
+		}
+		return;
+	}
+
+	if (bench_recordLength == 0 && bench_format != SCAN_FORMAT_ASCII && bench_lineLength == 0 &&
+		(c == SCAN_SYNC || c == SCAN_SYNC_TIME || c == SCAN_SYNC_DELTA || c == SCAN_SYNC_FRAME))
+	{
+		//The length of a delta block is known when it is decoded
+		bench_recordSize = c == SCAN_SYNC ? SCAN_RECORD_LENGTH : (c == SCAN_SYNC_TIME ? SCAN_RECORD_TIME_LENGTH :
+			(c == SCAN_SYNC_FRAME ? SCAN_FRAME_LENGTH : sizeof(bench_record)));
+	}
+	else if (bench_recordLength == 0)
+	{
+		bench_recordSize = 0;
+	}
+	if (bench_recordSize)
+	{
+		bench_record[bench_recordLength++] = c;
+		if (bench_record[0] == SCAN_SYNC_DELTA && bench_delta(bench_recordLength, 0) == bench_recordLength)
+		{
+			bench_recordSize = bench_recordLength;
+		}
+		if (bench_recordLength == bench_recordSize)
+		{
+			bench_recordLength = 0;
+			bench_record_done();
+		}
+		return;
+	}
+
+	if (c == '\n' || c == '\r')
+	{
+		if (bench_lineLength)
+		{
+			bench_line[bench_lineLength] = '\0';
+			bench_line_done();
+			bench_lineLength = 0;
+		}
+		return;
+	}
+	if (bench_lineLength == 0)
+	{
+		bench_lineStart = sim_now();
+	}
+	if (bench_lineLength < sizeof(bench_line) - 1)
+	{
+		bench_line[bench_lineLength++] = c;
+	}
+}
+
+//Steps of the monitor mode, the firmware is quiet most of the time
+static void bench_monitor_tick(void){
+	switch (bench_monitorState)
+	{
+		case BENCH_MONITOR_LEARN:
+		if (bench_pass)
+		{
+			bench_monitorState = BENCH_MONITOR_STATIC;
+			bench_monitorStart = sim_now();
+			bench_monitorCount = bench_count;
+			bench_monitorBytes = bench_bytes;
+		}
+		break;
+
+		case BENCH_MONITOR_STATIC:
+		if (sim_now() - bench_monitorStart >= BENCH_MONITOR_TIME)
+		{
+			bench_staticEvents = bench_count - bench_monitorCount;
+			bench_staticBytes = bench_bytes - bench_monitorBytes;
+			room_setIntruder(BENCH_INTRUDER_X, BENCH_INTRUDER_Y, BENCH_INTRUDER_RADIUS);
+			bench_monitorState = BENCH_MONITOR_ALERT;
+			bench_monitorStart = sim_now();
+			bench_deadline = sim_now() + BENCH_TIMEOUT;
+		}
+		break;
+
+		case BENCH_MONITOR_AFTER:
+		if (sim_now() - bench_monitorStart >= BENCH_MONITOR_TIME)
+		{
+			bench_cancelSent = sim_uart_send("#", 1);
+			sim_uart_send("?\r\n", 3);
+			bench_phase = BENCH_CANCEL;
+		}
+		break;
+	}
+}
+
+//Called every millisecond
+static void bench_tick(void){
+	if (sim_now() > bench_deadline)
+	{
+		bench_finish("timeout");
+	}
+	if (bench_phase == BENCH_SCAN && bench_monitor)
+	{
+		bench_monitor_tick();
+	}
+	if (bench_phase == BENCH_SCAN && bench_velocity != 0xFF)
+	{
+		room_setIntruder(BENCH_INTRUDER_X, bench_velocity_target(sim_now()), BENCH_INTRUDER_RADIUS);
+	}
+	if (sim_now() - bench_lastChar < BENCH_QUIET || bench_sending)
+	{
+		return;
+	}
+
+	switch (bench_phase)
+	{
+		case BENCH_LATENCY:
+		if (bench_latencyCount < bench_runs)
+		{
+			char command[16];
+			//The CR ends the argument, the latency is measured from its arrival
+			snprintf(command, sizeof(command), "#6 %u\r", bench_avg);
+			bench_send(command);
+			bench_deadline = sim_now() + BENCH_TIMEOUT;
+		}
+		else
+		{
+			bench_phase = bench_link != 0xFF ? BENCH_LINK : BENCH_SETUP;
+		}
+		break;
+
+		case BENCH_LINK:
+		if (bench_linkState == BENCH_LINK_COMMAND)
+		{
+			char command[16];
+			snprintf(command, sizeof(command), "#u %u\r", bench_link);
+			bench_send(command);
+			bench_linkState = BENCH_LINK_ANNOUNCE;
+		}
+		else if (bench_linkState == BENCH_LINK_BLOCK && !bench_linkStay)
+		{
+			//The firmware has switched after the announcement, now the host follows
+			char block[SERIAL_LINK_LENGTH];
+			for (uint8_t i = 0; i < SERIAL_LINK_LENGTH; i++)
+			{
+				block[i] = (i * 0x1D) ^ 0x55;
+			}
+			sim_config.host_baud = bench_linkBaud;
+			sim_uart_send(block, SERIAL_LINK_LENGTH);
+			bench_linkState = BENCH_LINK_ECHO;
+		}
+		bench_deadline = sim_now() + BENCH_TIMEOUT;
+		break;
+
+		case BENCH_SETUP:
+		if (bench_setup < bench_setupCount)
+		{
+			bench_send(bench_setupCommands[bench_setup++]);
+		}
+		else
+		{
+			bench_phase = BENCH_SCAN;
+			bench_send(bench_scanCommand);
+			if (bench_velocity != 0xFF)
+			{
+				bench_velocityStart = sim_now();
+			}
+		}
+		bench_deadline = sim_now() + BENCH_TIMEOUT;
+		break;
+
+		case BENCH_PROFILE:
+		if (!bench_profileSent)
+		{
+			bench_send("#p\r\n");
+			bench_profileSent = 1;
+			bench_deadline = sim_now() + BENCH_TIMEOUT;
+		}
+		break;
+
+		case BENCH_DONE:
+		bench_finish(0);
+		break;
+	}
+}
+
+static sim_time_t bench_next(void){
+	return bench_poll;
+}
+
+static void bench_event(void){
+	bench_poll += SIM_MS;
+	bench_tick();
+}
+
+static const sim_peripheral_t bench_host = {
+	0, 0, bench_next, bench_event, 0
+};
+
+static void bench_usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -n points  points of the scan (%u)\n"
+		"  -a avg     values per point, sent with #6 (%u)\n"
+		"  -3         3D scan (#5) instead of 2D (#2)\n"
+		"  -R         rotating mode (#r) instead of 2D (#2), the stride of -w sets the grid\n"
+		"  -m cm      monitor mode (#m) with the threshold, an intruder appears after the first sweep\n"
+		"  -V scale   velocity stream (#v) at azimuth 90, the intruder approaches, -n samples\n"
+		"  -b         binary scan records (#0 1)\n"
+		"  -d         delta compressed scan blocks (#0 2)\n"
+		"  -T         timestamp of the points (#t 1)\n"
+		"  -w window  scan window \"ms me mk ss se sk\" (#w)\n"
+		"  -H         half steps (#h 1), 400 motor positions\n"
+		"  -u index   switch the baud rate with the link test (#u)\n"
+		"  -U         the host does not follow the switch, the firmware has to fall back\n"
+		"  -s seed    seed of the random numbers (%u)\n"
+		"  -r steps   rotor position at power up in full steps (%d)\n"
+		"  -S steps   the rotor does not follow every n-th step, the rotating mode has to resync\n"
+		"  -e file    EEPROM content, loaded at power up and saved after every write\n"
+		"  -c         save the settings (#c 1) after the setup\n"
+		"  -C         skip the setup, the settings have to come from the EEPROM\n"
+		"  -q us      acquisition time of the LIDAR-Lite (%u)\n"
+		"  -L units   LIDAR-Lite units on the bus, mounted evenly around the rotor (%u)\n"
+		"  -W         reset of the MCU alone, unit 0 still has the address of the last run\n"
+		"  -o rate    probability of an outlier (%.3f)\n"
+		"  -I n       a slave holds SDA low in the n-th transaction, the firmware has to recover the bus\n"
+		"  -t us      real time per simulation step (%u)\n"
+		"  -v         print the text of the firmware\n",
+		name, bench_points, bench_avg, sim_config.seed, sim_config.rotor_start,
+		sim_config.lidar_acq_us, sim_config.lidar_units, sim_config.lidar_spike_rate, sim_config.tick_us);
+	exit(2);
+}
+
+int main(int argc, char **argv){
+	int opt;
+	while ((opt = getopt(argc, argv, "n:a:3Rm:V:bdTw:Hu:Us:r:S:e:cCq:L:Wo:I:t:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': bench_points = atoi(optarg); break;
+			case 'a': bench_avg = atoi(optarg); break;
+			case '3': bench_3d = 1; break;
+			case 'R': bench_rotate = 1; break;
+			case 'm': bench_monitor = atoi(optarg); break;
+			case 'V': bench_velocity = atoi(optarg) != 0; break;
+			case 'b': bench_format = SCAN_FORMAT_BINARY; break;
+			case 'd': bench_format = SCAN_FORMAT_DELTA; break;
+			case 'T': bench_timestamp = 1; break;
+			case 'w':
+			if (sscanf(optarg, "%d %d %d %d %d %d", &bench_window[0], &bench_window[1], &bench_window[2],
+				&bench_window[3], &bench_window[4], &bench_window[5]) != 6 || bench_window[2] < 1 || bench_window[5] < 1)
+			{
+				bench_usage(argv[0]);
+			}
+			snprintf(bench_setupCommands[bench_setupCount++], sizeof(bench_setupCommands[0]), "#w %s\r", optarg);
+			break;
+			case 'H': bench_mode = MOTOR_MODE_HALF; break;
+			case 'u': bench_link = atoi(optarg); break;
+			case 'U': bench_linkStay = 1; break;
+			case 's': sim_config.seed = strtoul(optarg, 0, 0); break;
+			case 'r': sim_config.rotor_start = atoi(optarg); break;
+			case 'S': sim_config.slip_steps = atoi(optarg); break;
+			case 'e': sim_config.eeprom_file = optarg; break;
+			case 'c': bench_configSave = 1; break;
+			case 'C': bench_configLoad = 1; break;
+			case 'q': sim_config.lidar_acq_us = atoi(optarg); break;
+			case 'L': sim_config.lidar_units = atoi(optarg); break;
+			case 'W': sim_config.lidar_warm = 1; break;
+			case 'o': sim_config.lidar_spike_rate = atof(optarg); break;
+			case 'I': sim_config.twi_stuck = strtoul(optarg, 0, 0); break;
+			case 't': sim_config.tick_us = atoi(optarg); break;
+			case 'v': bench_verbose = 1; break;
+			default: bench_usage(argv[0]);
+		}
+	}
+	if (bench_points == 0 || bench_avg == 0 || (bench_linkStay && bench_link == 0xFF) || (bench_configSave && bench_configLoad) || (bench_monitor && bench_3d) ||
+		(bench_rotate && (bench_monitor || bench_3d || bench_velocity != 0xFF)) ||
+		sim_config.lidar_units < 1 || sim_config.lidar_units > LIDAR_UNITS_MAX ||
+		(bench_velocity != 0xFF && (bench_monitor || bench_3d || bench_format != SCAN_FORMAT_ASCII)))
+	{
+		bench_usage(argv[0]);
+	}
+	if (bench_velocity != 0xFF)
+	{
+		//Beam horizontal at azimuth 90, towards the intruder. #3 has no answer, so it is sent with the stream.
+		snprintf(bench_scanCommand, sizeof(bench_scanCommand), "#3 50 0\r#v %u\r", bench_velocity);
+	}
+	else if (bench_monitor)
+	{
+		snprintf(bench_scanCommand, sizeof(bench_scanCommand), "#m %u\r", bench_monitor);
+	}
+	else if (bench_rotate)
+	{
+		strcpy(bench_scanCommand, "#r\r\n");
+	}
+	else
+	{
+		strcpy(bench_scanCommand, bench_3d ? "#5\r\n" : "#2\r\n");
+	}
+	if (bench_format != SCAN_FORMAT_ASCII)
+	{
+		snprintf(bench_setupCommands[bench_setupCount++], sizeof(bench_setupCommands[0]), "#0 %u\r", bench_format);
+	}
+	if (bench_timestamp)
+	{
+		strcpy(bench_setupCommands[bench_setupCount++], "#t 1\r");
+	}
+	if (bench_mode == MOTOR_MODE_HALF)
+	{
+		strcpy(bench_setupCommands[bench_setupCount++], "#h 1\r");
+	}
+	if (bench_configSave)
+	{
+		strcpy(bench_setupCommands[bench_setupCount++], "#c 1\r");
+	}
+	else if (bench_configLoad)
+	{
+		//The settings come from the EEPROM
+		bench_setupCount = 0;
+	}
+
+	sim_config.receive = bench_receive;
+	sim_init();
+	sim_register(&bench_host);
+	firmware_main();
+	bench_finish("firmware returned");
+	return 1;
+}
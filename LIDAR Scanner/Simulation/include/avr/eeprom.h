@@ -0,0 +1,23 @@
+/*
+ * eeprom.h
+ *
+ * Created: 17.10.2026
+ *
+ * EEPROM of the simulation. Writes take the time of the real EEPROM and can be kept in a file.
+ */
+
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E2END	0x3FF
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t length);
+void eeprom_update_block(const void *src, void *dst, size_t length);
+
+#endif /* SIM_AVR_EEPROM_H_ */
@@ -0,0 +1,21 @@
+/*
+ * interrupt.h
+ *
+ * Created: 17.10.2026
+ *
+ * Interrupts of the simulation. An ISR is a normal function which the simulator calls
+ * when the interrupt is pending and the global interrupt flag is set.
+ */
+
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define ISR(vector, ...)	void vector(void); void vector(void)
+
+void sei(void);
+void cli(void);
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
@@ -0,0 +1,299 @@
+/*
+ * io.h
+ *
+ * Created: 17.10.2026
+ *
+ * Register level HAL of the simulation. Every register is a macro which calls into the simulator,
+ * so the firmware sources compile without changes. The simulator processes the writes since the last
+ * access and updates the value of the register before the firmware reads or writes it.
+ */
+
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+/*! \brief 8 bit registers of the ATmega328P which are simulated */
+enum {
+	SIM_TWBR, SIM_TWSR, SIM_TWAR, SIM_TWDR, SIM_TWCR,
+	SIM_UCSR0A, SIM_UCSR0B, SIM_UCSR0C, SIM_UBRR0L, SIM_UBRR0H, SIM_UDR0,
+	SIM_PINB, SIM_DDRB, SIM_PORTB, SIM_PINC, SIM_DDRC, SIM_PORTC, SIM_PIND, SIM_DDRD, SIM_PORTD,
+	SIM_TCCR0A, SIM_TCCR0B, SIM_TCNT0, SIM_OCR0A, SIM_OCR0B, SIM_TIMSK0, SIM_TIFR0,
+	SIM_TCCR1A, SIM_TCCR1B, SIM_TCCR1C, SIM_TIMSK1, SIM_TIFR1,
+	SIM_TCCR2A, SIM_TCCR2B, SIM_TCNT2, SIM_OCR2A, SIM_OCR2B, SIM_TIMSK2, SIM_TIFR2,
+	SIM_ADMUX, SIM_ADCSRA, SIM_ADCSRB,
+	SIM_SREG, SIM_MCUSR,
+	SIM_IO8_COUNT
+};
+
+/*! \brief 16 bit registers of the ATmega328P which are simulated */
+enum {
+	SIM_TCNT1, SIM_OCR1A, SIM_OCR1B, SIM_ICR1, SIM_ADCW,
+	SIM_IO16_COUNT
+};
+
+volatile uint8_t *sim_io8(uint8_t id);
+volatile uint16_t *sim_io16(uint8_t id);
+
+#define TWBR	(*sim_io8(SIM_TWBR))
+#define TWSR	(*sim_io8(SIM_TWSR))
+#define TWAR	(*sim_io8(SIM_TWAR))
+#define TWDR	(*sim_io8(SIM_TWDR))
+#define TWCR	(*sim_io8(SIM_TWCR))
+
+#define UCSR0A	(*sim_io8(SIM_UCSR0A))
+#define UCSR0B	(*sim_io8(SIM_UCSR0B))
+#define UCSR0C	(*sim_io8(SIM_UCSR0C))
+#define UBRR0L	(*sim_io8(SIM_UBRR0L))
+#define UBRR0H	(*sim_io8(SIM_UBRR0H))
+#define UDR0	(*sim_io8(SIM_UDR0))
+
+#define PINB	(*sim_io8(SIM_PINB))
+#define DDRB	(*sim_io8(SIM_DDRB))
+#define PORTB	(*sim_io8(SIM_PORTB))
+#define PINC	(*sim_io8(SIM_PINC))
+#define DDRC	(*sim_io8(SIM_DDRC))
+#define PORTC	(*sim_io8(SIM_PORTC))
+#define PIND	(*sim_io8(SIM_PIND))
+#define DDRD	(*sim_io8(SIM_DDRD))
+#define PORTD	(*sim_io8(SIM_PORTD))
+
+#define TCCR0A	(*sim_io8(SIM_TCCR0A))
+#define TCCR0B	(*sim_io8(SIM_TCCR0B))
+#define TCNT0	(*sim_io8(SIM_TCNT0))
+#define OCR0A	(*sim_io8(SIM_OCR0A))
+#define OCR0B	(*sim_io8(SIM_OCR0B))
+#define TIMSK0	(*sim_io8(SIM_TIMSK0))
+#define TIFR0	(*sim_io8(SIM_TIFR0))
+
+#define TCCR1A	(*sim_io8(SIM_TCCR1A))
+#define TCCR1B	(*sim_io8(SIM_TCCR1B))
+#define TCCR1C	(*sim_io8(SIM_TCCR1C))
+#define TIMSK1	(*sim_io8(SIM_TIMSK1))
+#define TIFR1	(*sim_io8(SIM_TIFR1))
+#define TCNT1	(*sim_io16(SIM_TCNT1))
+#define OCR1A	(*sim_io16(SIM_OCR1A))
+#define OCR1B	(*sim_io16(SIM_OCR1B))
+#define ICR1	(*sim_io16(SIM_ICR1))
+
+#define TCCR2A	(*sim_io8(SIM_TCCR2A))
+#define TCCR2B	(*sim_io8(SIM_TCCR2B))
+#define TCNT2	(*sim_io8(SIM_TCNT2))
+#define OCR2A	(*sim_io8(SIM_OCR2A))
+#define OCR2B	(*sim_io8(SIM_OCR2B))
+#define TIMSK2	(*sim_io8(SIM_TIMSK2))
+#define TIFR2	(*sim_io8(SIM_TIFR2))
+
+#define ADMUX	(*sim_io8(SIM_ADMUX))
+#define ADCSRA	(*sim_io8(SIM_ADCSRA))
+#define ADCSRB	(*sim_io8(SIM_ADCSRB))
+#define ADCW	(*sim_io16(SIM_ADCW))
+#define ADC		ADCW
+
+#define SREG	(*sim_io8(SIM_SREG))
+#define MCUSR	(*sim_io8(SIM_MCUSR))
+
+/* TWCR */
+#define TWINT	7
+#define TWEA	6
+#define TWSTA	5
+#define TWSTO	4
+#define TWWC	3
+#define TWEN	2
+#define TWIE	0
+
+/* TWSR */
+#define TWPS1	1
+#define TWPS0	0
+
+/* UCSR0A */
+#define RXC0	7
+#define TXC0	6
+#define UDRE0	5
+#define FE0		4
+#define DOR0	3
+#define UPE0	2
+#define U2X0	1
+#define MPCM0	0
+
+/* UCSR0B */
+#define RXCIE0	7
+#define TXCIE0	6
+#define UDRIE0	5
+#define RXEN0	4
+#define TXEN0	3
+#define UCSZ02	2
+#define RXB80	1
+#define TXB80	0
+
+/* UCSR0C */
+#define UMSEL01	7
+#define UMSEL00	6
+#define UPM01	5
+#define UPM00	4
+#define USBS0	3
+#define UCSZ01	2
+#define UCSZ00	1
+#define UCPOL0	0
+
+/* Port pins */
+#define PINB0	0
+#define PINB1	1
+#define PINB2	2
+#define PINB3	3
+#define PINB4	4
+#define PINB5	5
+#define PINB6	6
+#define PINB7	7
+#define PINC0	0
+#define PINC1	1
+#define PINC2	2
+#define PINC3	3
+#define PINC4	4
+#define PINC5	5
+#define PINC6	6
+#define PIND0	0
+#define PIND1	1
+#define PIND2	2
+#define PIND3	3
+#define PIND4	4
+#define PIND5	5
+#define PIND6	6
+#define PIND7	7
+#define PB0		0
+#define PB1		1
+#define PB2		2
+#define PB3		3
+#define PB4		4
+#define PB5		5
+#define PB6		6
+#define PB7		7
+#define PC0		0
+#define PC1		1
+#define PC2		2
+#define PC3		3
+#define PC4		4
+#define PC5		5
+#define PC6		6
+#define PD0		0
+#define PD1		1
+#define PD2		2
+#define PD3		3
+#define PD4		4
+#define PD5		5
+#define PD6		6
+#define PD7		7
+#define PORTB0	0
+#define PORTB1	1
+#define PORTB2	2
+#define PORTC4	4
+#define PORTC5	5
+#define DDB0	0
+#define DDB1	1
+#define DDC4	4
+#define DDC5	5
+
+/* TCCR0A, TCCR0B, TIMSK0, TIFR0 */
+#define COM0A1	7
+#define COM0A0	6
+#define COM0B1	5
+#define COM0B0	4
+#define WGM01	1
+#define WGM00	0
+#define FOC0A	7
+#define FOC0B	6
+#define WGM02	3
+#define CS02	2
+#define CS01	1
+#define CS00	0
+#define OCIE0B	2
+#define OCIE0A	1
+#define TOIE0	0
+#define OCF0B	2
+#define OCF0A	1
+#define TOV0	0
+
+/* TCCR1A, TCCR1B, TIMSK1, TIFR1 */
+#define COM1A1	7
+#define COM1A0	6
+#define COM1B1	5
+#define COM1B0	4
+#define WGM11	1
+#define WGM10	0
+#define ICNC1	7
+#define ICES1	6
+#define WGM13	4
+#define WGM12	3
+#define CS12	2
+#define CS11	1
+#define CS10	0
+#define ICIE1	5
+#define OCIE1B	2
+#define OCIE1A	1
+#define TOIE1	0
+#define ICF1	5
+#define OCF1B	2
+#define OCF1A	1
+#define TOV1	0
+
+/* TCCR2A, TCCR2B, TIMSK2, TIFR2 */
+#define COM2A1	7
+#define COM2A0	6
+#define COM2B1	5
+#define COM2B0	4
+#define WGM21	1
+#define WGM20	0
+#define FOC2A	7
+#define FOC2B	6
+#define WGM22	3
+#define CS22	2
+#define CS21	1
+#define CS20	0
+#define OCIE2B	2
+#define OCIE2A	1
+#define TOIE2	0
+#define OCF2B	2
+#define OCF2A	1
+#define TOV2	0
+
+/* ADMUX, ADCSRA */
+#define REFS1	7
+#define REFS0	6
+#define ADLAR	5
+#define MUX3	3
+#define MUX2	2
+#define MUX1	1
+#define MUX0	0
+#define ADEN	7
+#define ADSC	6
+#define ADATE	5
+#define ADIF	4
+#define ADIE	3
+#define ADPS2	2
+#define ADPS1	1
+#define ADPS0	0
+
+/* SREG */
+#define SREG_I	7
+#define SREG_T	6
+#define SREG_H	5
+#define SREG_S	4
+#define SREG_V	3
+#define SREG_N	2
+#define SREG_Z	1
+#define SREG_C	0
+
+/* MCUSR */
+#define WDRF	3
+#define BORF	2
+#define EXTRF	1
+#define PORF	0
+
+#define _BV(bit)	(1 << (bit))
+#define bit_is_set(sfr, bit)	((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)	(!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit)	do { } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit)	do { } while (bit_is_set(sfr, bit))
+
+#endif /* SIM_AVR_IO_H_ */
@@ -0,0 +1,19 @@
+/*
+ * pgmspace.h
+ *
+ * Created: 17.10.2026
+ *
+ * Program memory of the simulation. Flash and SRAM share the address space of the host.
+ */
+
+
+#ifndef SIM_AVR_PGMSPACE_H_
+#define SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(address)	(*(const uint8_t *)(address))
+
+#endif /* SIM_AVR_PGMSPACE_H_ */
@@ -0,0 +1,19 @@
+/*
+ * stdlib.h
+ *
+ * Created: 17.10.2026
+ *
+ * The conversion functions of the avr-libc which are not part of the C library of the host.
+ */
+
+#include_next <stdlib.h>
+
+#ifndef SIM_STDLIB_H_
+#define SIM_STDLIB_H_
+
+char *itoa(int value, char *string, int radix);
+char *utoa(unsigned int value, char *string, int radix);
+char *ltoa(long value, char *string, int radix);
+char *ultoa(unsigned long value, char *string, int radix);
+
+#endif /* SIM_STDLIB_H_ */
@@ -0,0 +1,69 @@
+/*
+ * crc16.h
+ *
+ * Created: 17.10.2026
+ *
+ * C versions of the CRC functions of the avr-libc.
+ */
+
+
+#ifndef SIM_UTIL_CRC16_H_
+#define SIM_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a){
+	crc ^= a;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (crc & 1)
+		{
+			crc = (crc >> 1) ^ 0xA001;
+		}
+		else
+		{
+			crc = (crc >> 1);
+		}
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data){
+	crc = crc ^ ((uint16_t)data << 8);
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (crc & 0x8000)
+		{
+			crc = (crc << 1) ^ 0x1021;
+		}
+		else
+		{
+			crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data){
+	data ^= (uint8_t)(crc & 0xFF);
+	data ^= (uint8_t)(data << 4);
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data){
+	uint8_t value = crc ^ data;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (value & 0x80)
+		{
+			value = (value << 1) ^ 0x07;
+		}
+		else
+		{
+			value <<= 1;
+		}
+	}
+	return value;
+}
+
+#endif /* SIM_UTIL_CRC16_H_ */
@@ -0,0 +1,25 @@
+/*
+ * delay.h
+ *
+ * Created: 17.10.2026
+ *
+ * Delays of the simulation. They advance the simulated time instead of spinning.
+ */
+
+
+#ifndef SIM_UTIL_DELAY_H_
+#define SIM_UTIL_DELAY_H_
+
+#include <stdint.h>
+
+void sim_delay_ns(uint64_t ns);
+
+static inline void _delay_us(double us){
+	sim_delay_ns((uint64_t)(us * 1000.0));
+}
+
+static inline void _delay_ms(double ms){
+	sim_delay_ns((uint64_t)(ms * 1000000.0));
+}
+
+#endif /* SIM_UTIL_DELAY_H_ */
@@ -0,0 +1,88 @@
+/*
+ * room.c
+ *
+ * Created: 17.10.2026
+ *
+ * A box shaped room with a pillar and an optional intruder, a second pillar which can appear at run time. The scanner is the origin, x points to azimuth 0,
+ * z points up (elevation 90).
+ */
+
+#include "room.h"
+#include <math.h>
+
+/*! \brief Walls in cm */
+static const double room_min[3] = { -150.0, -100.0, -100.0 };
+static const double room_max[3] = { 450.0, 300.0, 150.0 };
+
+/*! \brief Pillar from floor to ceiling */
+static const double room_pillarX = 200.0;
+static const double room_pillarY = 120.0;
+static const double room_pillarRadius = 25.0;
+
+/*! \brief Intruder from floor to ceiling, no intruder if the radius is 0 */
+static double room_intruderX = 0.0;
+static double room_intruderY = 0.0;
+static double room_intruderRadius = 0.0;
+
+
+//Ray against the circle of a pillar in the plane, returns the distance or INFINITY
+static double room_pillar(const double *dir, double x, double y, double radius){
+	double b = dir[0] * x + dir[1] * y;
+	double c = x * x + y * y - radius * radius;
+	double h = dir[0] * dir[0] + dir[1] * dir[1];
+	double disc = b * b - h * c;
+	if (h > 1e-9 && disc >= 0)
+	{
+		double t = (b - sqrt(disc)) / h;
+		if (t > 0)
+		{
+			return t;
+		}
+	}
+	return INFINITY;
+}
+
+
+/*! \brief Distance to the next surface
+ *
+ *  \param azimuth Angle of the rotor in degrees
+ *  \param elevation Angle above the horizon in degrees
+ *  \return Distance in cm
+ */
+double room_range(double azimuth, double elevation){
+	double a = azimuth * M_PI / 180.0;
+	double e = elevation * M_PI / 180.0;
+	double dir[3] = { cos(e) * cos(a), cos(e) * sin(a), sin(e) };
+	double range = INFINITY;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (dir[i] > 1e-9)
+		{
+			range = fmin(range, room_max[i] / dir[i]);
+		}
+		else if (dir[i] < -1e-9)
+		{
+			range = fmin(range, room_min[i] / dir[i]);
+		}
+	}
+
+	range = fmin(range, room_pillar(dir, room_pillarX, room_pillarY, room_pillarRadius));
+	if (room_intruderRadius > 0)
+	{
+		range = fmin(range, room_pillar(dir, room_intruderX, room_intruderY, room_intruderRadius));
+	}
+	return range;
+}
+
+/*! \brief Place the intruder
+ *
+ *  \param x Position in cm
+ *  \param y Position in cm
+ *  \param radius Radius in cm, 0 removes the intruder
+ */
+void room_setIntruder(double x, double y, double radius){
+	room_intruderX = x;
+	room_intruderY = y;
+	room_intruderRadius = radius;
+}
@@ -0,0 +1,16 @@
+/*
+ * room.h
+ *
+ * Created: 17.10.2026
+ *
+ * Synthetic room around the scanner.
+ */
+
+
+#ifndef ROOM_H_
+#define ROOM_H_
+
+double room_range(double azimuth, double elevation);
+void room_setIntruder(double x, double y, double radius);
+
+#endif /* ROOM_H_ */
@@ -0,0 +1,497 @@
+/*
+ * sim.c
+ *
+ * Created: 17.10.2026
+ */
+
+#include "sim.h"
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+sim_config_t sim_config = {
+	.seed = 1,
+	.tick_us = 20,
+	.rotor_start = 120,
+	.lidar_acq_us = 2000,
+	.lidar_noise_cm = 2.0,
+	.lidar_spike_rate = 0.0,
+	.lidar_units = 1,
+	.lidar_warm = 0,
+	.twi_stuck = 0,
+	.servo_deg_per_s = 400.0,
+	.step_min_us = 1500,
+	.slip_steps = 0,
+	.host_baud = 56000,
+	.eeprom_file = 0,
+	.receive = 0
+};
+
+/*! \brief Registers as seen by the firmware */
+static volatile uint8_t sim_reg8[SIM_IO8_COUNT];
+static volatile uint16_t sim_reg16[SIM_IO16_COUNT];
+
+/*! \brief Registers after the last sync, a difference is a write of the firmware */
+static uint8_t sim_shadow8[SIM_IO8_COUNT];
+static uint16_t sim_shadow16[SIM_IO16_COUNT];
+
+/*! \brief Set for every register the firmware accessed since the last sync */
+static uint8_t sim_access8[SIM_IO8_COUNT];
+
+/*! \brief Virtual time */
+static sim_time_t sim_time = 0;
+
+/*! \brief Set while the simulator runs, the signal only counts then */
+static volatile sig_atomic_t sim_busy = 0;
+
+/*! \brief Signals which are not processed yet */
+static volatile sig_atomic_t sim_ticks = 0;
+
+/*! \brief Writes which can only be detected by the next access of the firmware */
+static volatile sig_atomic_t sim_deferred = 0;
+
+/*! \brief Vector of the running ISR, 0 in the main program */
+static volatile uint8_t sim_running = 0;
+
+/*! \brief Watchdog */
+static sim_time_t sim_wdtPeriod = 0;
+static sim_time_t sim_wdtDeadline = SIM_NEVER;
+
+/*! \brief State of the random numbers */
+static uint32_t sim_seed;
+
+#define SIM_PERIPHERALS_MAX	8
+static const sim_peripheral_t *sim_peripherals[SIM_PERIPHERALS_MAX];
+static uint8_t sim_peripheralCount = 0;
+
+//Interrupt vectors, the firmware defines the ones it uses
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER0_OVF_vect(void) __attribute__((weak));
+void USART_RX_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void USART_TX_vect(void) __attribute__((weak));
+void ADC_vect(void) __attribute__((weak));
+void TWI_vect(void) __attribute__((weak));
+
+/*! \brief Vector table in the order of the priority */
+static const struct {
+	uint8_t vector;
+	void (*isr)(void);
+} sim_vectors[] = {
+	{ SIM_VECT_TIMER2_COMPA, TIMER2_COMPA_vect },
+	{ SIM_VECT_TIMER0_OVF, TIMER0_OVF_vect },
+	{ SIM_VECT_USART_RX, USART_RX_vect },
+	{ SIM_VECT_USART_UDRE, USART_UDRE_vect },
+	{ SIM_VECT_USART_TX, USART_TX_vect },
+	{ SIM_VECT_ADC, ADC_vect },
+	{ SIM_VECT_TWI, TWI_vect }
+};
+
+
+/*! \brief Register a peripheral
+ *
+ *  \param peripheral Callbacks of the peripheral
+ */
+void sim_register(const sim_peripheral_t *peripheral){
+	if (sim_peripheralCount >= SIM_PERIPHERALS_MAX)
+	{
+		sim_fail("too many peripherals");
+	}
+	sim_peripherals[sim_peripheralCount++] = peripheral;
+}
+
+/*! \brief Get the time
+ *
+ *  \return Virtual time in ns
+ */
+sim_time_t sim_now(void){
+	return sim_time;
+}
+
+/*! \brief Get the running ISR
+ *
+ *  \return Vector of the running ISR, 0 in the main program
+ */
+uint8_t sim_vector(void){
+	return sim_running;
+}
+
+/*! \brief Hold back the signal
+ *
+ *  A peripheral which waits for the firmware to store a value into a register it just accessed
+ *  holds back the signal until the next access.
+ *  \param count +1 to hold back, -1 to release
+ */
+void sim_defer(int8_t count){
+	sim_deferred += count;
+}
+
+/*! \brief Stop the simulation with an error
+ *
+ *  \param reason Text for the message
+ */
+void sim_fail(const char *reason){
+	fflush(stdout);
+	fprintf(stderr, "sim: %s at %.3f ms\n", reason, sim_time / (double)SIM_MS);
+	_exit(2);
+}
+
+/*! \brief Random number
+ *
+ *  xorshift32, the sequence only depends on sim_config.seed.
+ *  \return 32 bit random number
+ */
+uint32_t sim_random(void){
+	sim_seed ^= sim_seed << 13;
+	sim_seed ^= sim_seed >> 17;
+	sim_seed ^= sim_seed << 5;
+	return sim_seed;
+}
+
+/*! \brief Normal distributed random number
+ *
+ *  \return Random number with mean 0 and standard deviation 1
+ */
+double sim_gauss(void){
+	double u1 = (sim_random() + 1.0) / 4294967297.0;
+	double u2 = (sim_random() + 1.0) / 4294967297.0;
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/*! \brief Value of a register */
+uint8_t sim_get8(uint8_t id){
+	return sim_reg8[id];
+}
+
+/*! \brief Change a register by the hardware, this is not seen as a write of the firmware */
+void sim_set8(uint8_t id, uint8_t value){
+	sim_reg8[id] = value;
+	sim_shadow8[id] = value;
+}
+
+/*! \brief Check for a write of the firmware
+ *
+ *  \param id Register
+ *  \param old Value before the write, may be 0
+ *  \return 1 if the firmware changed the register since the last sync
+ */
+uint8_t sim_changed8(uint8_t id, uint8_t *old){
+	if (old)
+	{
+		*old = sim_shadow8[id];
+	}
+	return sim_reg8[id] != sim_shadow8[id];
+}
+
+/*! \brief Check for an access of the firmware
+ *
+ *  \return 1 if the firmware read or wrote the register since the last sync
+ */
+uint8_t sim_accessed8(uint8_t id){
+	return sim_access8[id];
+}
+
+/*! \brief Value of a 16 bit register */
+uint16_t sim_get16(uint8_t id){
+	return sim_reg16[id];
+}
+
+/*! \brief Change a 16 bit register by the hardware */
+void sim_set16(uint8_t id, uint16_t value){
+	sim_reg16[id] = value;
+	sim_shadow16[id] = value;
+}
+
+/*! \brief Check for a write of the firmware to a 16 bit register */
+uint8_t sim_changed16(uint8_t id){
+	return sim_reg16[id] != sim_shadow16[id];
+}
+
+//Process the writes of the firmware since the last sync
+static void sim_sync(void){
+	for (uint8_t i = 0; i < sim_peripheralCount; i++)
+	{
+		if (sim_peripherals[i]->sync)
+		{
+			sim_peripherals[i]->sync();
+		}
+	}
+	for (uint8_t i = 0; i < SIM_IO8_COUNT; i++)
+	{
+		sim_shadow8[i] = sim_reg8[i];
+		sim_access8[i] = 0;
+	}
+	for (uint8_t i = 0; i < SIM_IO16_COUNT; i++)
+	{
+		sim_shadow16[i] = sim_reg16[i];
+	}
+}
+
+//Time of the next event of all peripherals
+static sim_time_t sim_next(void){
+	sim_time_t next = sim_wdtDeadline;
+	for (uint8_t i = 0; i < sim_peripheralCount; i++)
+	{
+		if (sim_peripherals[i]->next)
+		{
+			sim_time_t t = sim_peripherals[i]->next();
+			if (t < next)
+			{
+				next = t;
+			}
+		}
+	}
+	return next;
+}
+
+//Run the ISRs of the pending interrupts
+static void sim_dispatch(void){
+	while (!sim_running && (sim_reg8[SIM_SREG] & (1<<SREG_I)))
+	{
+		uint8_t found = 0;
+		for (uint8_t v = 0; v < sizeof(sim_vectors) / sizeof(sim_vectors[0]) && !found; v++)
+		{
+			for (uint8_t i = 0; i < sim_peripheralCount; i++)
+			{
+				const sim_peripheral_t *p = sim_peripherals[i];
+				if (p->irq && p->irq(sim_vectors[v].vector, 0))
+				{
+					if (!sim_vectors[v].isr)
+					{
+						sim_fail("interrupt without ISR");
+					}
+					p->irq(sim_vectors[v].vector, 1);
+					sim_set8(SIM_SREG, sim_reg8[SIM_SREG] & ~(1<<SREG_I));
+					sim_running = sim_vectors[v].vector;
+					sim_busy = 0;
+					sim_vectors[v].isr();
+					sim_busy = 1;
+					sim_sync();
+					sim_running = 0;
+					sim_set8(SIM_SREG, sim_reg8[SIM_SREG] | (1<<SREG_I));
+					found = 1;
+					break;
+				}
+			}
+		}
+		if (!found)
+		{
+			break;
+		}
+	}
+}
+
+//Advance the time to until and process the events on the way
+static void sim_advance(sim_time_t until){
+	while (1)
+	{
+		sim_time_t t = sim_next();
+		if (t > until)
+		{
+			break;
+		}
+		if (t > sim_time)
+		{
+			sim_time = t;
+		}
+		if (sim_wdtDeadline <= sim_time)
+		{
+			sim_fail("watchdog reset");
+		}
+		for (uint8_t i = 0; i < sim_peripheralCount; i++)
+		{
+			const sim_peripheral_t *p = sim_peripherals[i];
+			if (p->next && p->event && p->next() <= sim_time)
+			{
+				p->event();
+			}
+		}
+		sim_dispatch();
+	}
+	if (until > sim_time)
+	{
+		sim_time = until;
+	}
+}
+
+//Let the time jump to the next event for every signal, then run the pending ISRs
+static void sim_service(void){
+	while (sim_ticks > 0)
+	{
+		__atomic_sub_fetch(&sim_ticks, 1, __ATOMIC_SEQ_CST);
+		sim_time_t t = sim_next();
+		if (t > sim_time + SIM_STEP_MAX)
+		{
+			t = sim_time + SIM_STEP_MAX;
+		}
+		sim_advance(t);
+	}
+	sim_dispatch();
+}
+
+//Real time signal
+static void sim_signal(int signum){
+	(void)signum;
+	__atomic_add_fetch(&sim_ticks, 1, __ATOMIC_SEQ_CST);
+	if (sim_busy || sim_deferred || sim_running || !(sim_reg8[SIM_SREG] & (1<<SREG_I)))
+	{
+		//The next access of the firmware processes it
+		return;
+	}
+	sim_busy = 1;
+	sim_sync();
+	sim_service();
+	sim_busy = 0;
+}
+
+/*! \brief Access an 8 bit register
+ *
+ *  Called by the register macros of avr/io.h.
+ *  \param id Register
+ *  \return Address of the register
+ */
+volatile uint8_t *sim_io8(uint8_t id){
+	sim_busy = 1;
+	sim_sync();
+	sim_service();
+	for (uint8_t i = 0; i < sim_peripheralCount; i++)
+	{
+		if (sim_peripherals[i]->refresh)
+		{
+			sim_peripherals[i]->refresh(id);
+		}
+	}
+	sim_access8[id] = 1;
+	sim_busy = 0;
+	return &sim_reg8[id];
+}
+
+/*! \brief Access a 16 bit register
+ *
+ *  \param id Register
+ *  \return Address of the register
+ */
+volatile uint16_t *sim_io16(uint8_t id){
+	sim_busy = 1;
+	sim_sync();
+	sim_service();
+	sim_busy = 0;
+	return &sim_reg16[id];
+}
+
+void sim_delay_ns(uint64_t ns){
+	sim_busy = 1;
+	sim_sync();
+	sim_advance(sim_time + ns);
+	sim_ticks = 0;
+	sim_dispatch();
+	sim_busy = 0;
+}
+
+void cli(void){
+	sim_busy = 1;
+	sim_sync();
+	sim_set8(SIM_SREG, sim_reg8[SIM_SREG] & ~(1<<SREG_I));
+	sim_busy = 0;
+}
+
+void sei(void){
+	sim_busy = 1;
+	sim_sync();
+	sim_set8(SIM_SREG, sim_reg8[SIM_SREG] | (1<<SREG_I));
+	sim_service();
+	sim_busy = 0;
+}
+
+void wdt_enable(uint8_t timeout){
+	sim_wdtPeriod = (15 * SIM_MS) << timeout;
+	sim_wdtDeadline = sim_time + sim_wdtPeriod;
+}
+
+void wdt_disable(void){
+	sim_wdtDeadline = SIM_NEVER;
+}
+
+void wdt_reset(void){
+	if (sim_wdtDeadline != SIM_NEVER)
+	{
+		sim_wdtDeadline = sim_time + sim_wdtPeriod;
+	}
+}
+
+char *ultoa(unsigned long value, char *string, int radix){
+	char digits[33];
+	uint8_t n = 0;
+	do
+	{
+		uint8_t d = value % radix;
+		digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+		value /= radix;
+	} while (value);
+	for (uint8_t i = 0; i < n; i++)
+	{
+		string[i] = digits[n - 1 - i];
+	}
+	string[n] = '\0';
+	return string;
+}
+
+char *ltoa(long value, char *string, int radix){
+	if (value < 0 && radix == 10)
+	{
+		string[0] = '-';
+		ultoa(-(unsigned long)value, string + 1, radix);
+		return string;
+	}
+	return ultoa((unsigned long)value, string, radix);
+}
+
+//int has 16 bit on the AVR
+char *itoa(int value, char *string, int radix){
+	return ltoa((int16_t)value, string, radix);
+}
+
+char *utoa(unsigned int value, char *string, int radix){
+	return ultoa((uint16_t)value, string, radix);
+}
+
+/*! \brief Initialize the simulation
+ *
+ *  Set up the peripherals with sim_config and start the real time signal.
+ *  Has to be called before the firmware starts.
+ */
+void sim_init(void){
+	sim_seed = sim_config.seed ? sim_config.seed : 1;
+	//Reset values
+	sim_set8(SIM_UCSR0A, (1<<UDRE0));
+	sim_set8(SIM_UCSR0C, (1<<UCSZ01) | (1<<UCSZ00));
+	sim_set8(SIM_TWSR, 0xF8);
+	sim_set8(SIM_TWBR, 0);
+	sim_set8(SIM_PINC, 0xFF);
+
+	sim_timer_init();
+	sim_motor_init();
+	sim_uart_init();
+	sim_twi_init();
+	sim_lidar_init();
+	sim_eeprom_init();
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = sim_signal;
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &action, 0);
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = sim_config.tick_us;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_REAL, &timer, 0);
+}
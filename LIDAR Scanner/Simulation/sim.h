@@ -0,0 +1,145 @@
+/*
+ * sim.h
+ *
+ * Created: 17.10.2026
+ *
+ * Host simulation of the scanner. The firmware runs natively and accesses the registers through
+ * the headers in include/. The simulator keeps a virtual time in ns and models the peripherals,
+ * the mechanics and the LIDAR-Lite around it.
+ *
+ * The CPU time of the firmware is not modelled: code between two accesses to the hardware takes no
+ * time. A periodic signal lets the virtual time jump to the next event, so the firmware can spin
+ * on a variable which is set by an ISR.
+ */
+
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/*! \def SIM_F_CPU
+ *
+ *  Define the CPU Clock of the simulated controller
+ */
+#define SIM_F_CPU	16000000UL
+
+/*! \def SIM_US
+ *
+ *  Define one microsecond in simulated time
+ */
+#define SIM_US		1000ULL
+
+/*! \def SIM_MS
+ *
+ *  Define one millisecond in simulated time
+ */
+#define SIM_MS		1000000ULL
+
+/*! \def SIM_NEVER
+ *
+ *  Define the time of an event which is not scheduled
+ */
+#define SIM_NEVER	UINT64_MAX
+
+/*! \def SIM_STEP_MAX
+ *
+ *  Define the maximum jump of the virtual time per signal
+ */
+#define SIM_STEP_MAX	(1 * SIM_MS)
+
+/*! \def SIM_VECT_...
+ *
+ *  Define the interrupt vectors, a lower number has a higher priority
+ */
+#define SIM_VECT_TIMER2_COMPA	8
+#define SIM_VECT_TIMER0_OVF		17
+#define SIM_VECT_USART_RX		19
+#define SIM_VECT_USART_UDRE		20
+#define SIM_VECT_USART_TX		21
+#define SIM_VECT_ADC			22
+#define SIM_VECT_TWI			25
+
+/*! \brief Time in ns */
+typedef uint64_t sim_time_t;
+
+/*! \brief Simulated peripheral
+ *
+ *  Every callback may be 0.
+ */
+typedef struct {
+	void (*sync)(void);								/*!< Process the register writes of the firmware */
+	void (*refresh)(uint8_t id);					/*!< Update the 8 bit register id before the firmware accesses it */
+	sim_time_t (*next)(void);						/*!< Time of the next event */
+	void (*event)(void);							/*!< Process the events which are due */
+	uint8_t (*irq)(uint8_t vector, uint8_t ack);	/*!< Check for a pending interrupt, ack is set when the ISR is entered */
+} sim_peripheral_t;
+
+/*! \brief Parameters of the models */
+typedef struct {
+	uint32_t seed;				/*!< Seed of the random numbers */
+	uint32_t tick_us;			/*!< Period of the real time signal */
+	int16_t rotor_start;		/*!< Position of the rotor at power up in full steps */
+	uint32_t lidar_acq_us;		/*!< Duration of one acquisition of the LIDAR-Lite */
+	double lidar_noise_cm;		/*!< Standard deviation of the range */
+	double lidar_spike_rate;	/*!< Probability of an outlier */
+	uint8_t lidar_units;		/*!< Number of LIDAR-Lite units on the bus */
+	uint8_t lidar_warm;			/*!< Unit 0 kept its address over a reset of the MCU */
+	uint32_t twi_stuck;			/*!< The slave holds SDA low in the first read from the n-th transaction on, 0 for never */
+	double servo_deg_per_s;		/*!< Slew rate of the servo */
+	uint32_t step_min_us;		/*!< Shortest time between two steps the stepper can follow */
+	uint32_t slip_steps;		/*!< The rotor does not follow every slip_steps-th step, 0 for never */
+	uint32_t host_baud;			/*!< Baud rate of the host */
+	const char *eeprom_file;	/*!< File with the content of the EEPROM, 0 for an erased EEPROM */
+	void (*receive)(uint8_t c);	/*!< Called for every character the firmware sends */
+} sim_config_t;
+
+extern sim_config_t sim_config;
+
+void sim_init(void);
+void sim_register(const sim_peripheral_t *peripheral);
+sim_time_t sim_now(void);
+uint8_t sim_vector(void);
+void sim_defer(int8_t count);
+void sim_fail(const char *reason);
+uint32_t sim_random(void);
+double sim_gauss(void);
+
+uint8_t sim_get8(uint8_t id);
+void sim_set8(uint8_t id, uint8_t value);
+uint8_t sim_changed8(uint8_t id, uint8_t *old);
+uint8_t sim_accessed8(uint8_t id);
+uint16_t sim_get16(uint8_t id);
+void sim_set16(uint8_t id, uint16_t value);
+uint8_t sim_changed16(uint8_t id);
+
+void sim_timer_init(void);
+void sim_motor_init(void);
+int32_t sim_motor_rotor(void);
+uint32_t sim_motor_steps(void);
+uint32_t sim_motor_fastSteps(void);
+uint32_t sim_motor_slips(void);
+int8_t sim_motor_snap(void);
+double sim_motor_azimuth(void);
+double sim_motor_elevation(void);
+uint8_t sim_motor_servoMoving(void);
+void sim_uart_init(void);
+sim_time_t sim_uart_send(const char *data, uint16_t length);
+uint32_t sim_uart_lost(void);
+void sim_twi_init(void);
+uint32_t sim_twi_transactions(void);
+uint32_t sim_twi_recoveries(void);
+uint8_t sim_twi_stuck(void);
+void sim_lidar_init(void);
+uint8_t sim_lidar_address(uint8_t address);
+void sim_lidar_start(uint8_t read);
+uint8_t sim_lidar_write(uint8_t data);
+uint8_t sim_lidar_read(void);
+void sim_lidar_stop(void);
+uint32_t sim_lidar_acquisitions(void);
+uint32_t sim_lidar_unsettled(void);
+void sim_eeprom_init(void);
+uint32_t sim_eeprom_writes(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,106 @@
+/*
+ * sim_eeprom.c
+ *
+ * Created: 17.10.2026
+ *
+ * EEPROM with 1 KB. The addresses of the firmware are byte offsets, an erased byte reads 0xFF.
+ * Every written byte takes SIM_EEPROM_WRITE_US. With sim_config.eeprom_file the content is loaded
+ * at power up and saved after every write, so the next run sees it.
+ */
+
+#include "sim.h"
+#include <avr/eeprom.h>
+#include <util/delay.h>
+#include <stdio.h>
+#include <string.h>
+
+/*! \def SIM_EEPROM_WRITE_US
+ *
+ *  Define the time of an erase and write of one byte
+ */
+#define SIM_EEPROM_WRITE_US	3400
+
+static uint8_t sim_eeprom[E2END + 1];
+
+/*! \brief Number of written bytes */
+static uint32_t sim_eepromWrites = 0;
+
+
+//Address of the firmware as offset, fails outside of the EEPROM
+static uint16_t sim_eeprom_offset(const void *address, size_t length){
+	uintptr_t offset = (uintptr_t)address;
+	if (offset + length > sizeof(sim_eeprom))
+	{
+		sim_fail("EEPROM address out of range");
+	}
+	return (uint16_t)offset;
+}
+
+static void sim_eeprom_save(void){
+	if (sim_config.eeprom_file)
+	{
+		FILE *file = fopen(sim_config.eeprom_file, "wb");
+		if (!file || fwrite(sim_eeprom, 1, sizeof(sim_eeprom), file) != sizeof(sim_eeprom))
+		{
+			sim_fail("EEPROM file not written");
+		}
+		fclose(file);
+	}
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address){
+	return sim_eeprom[sim_eeprom_offset(address, 1)];
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value){
+	eeprom_update_block(&value, address, 1);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t length){
+	memcpy(dst, &sim_eeprom[sim_eeprom_offset(src, length)], length);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t length){
+	uint16_t offset = sim_eeprom_offset(dst, length);
+	const uint8_t *data = src;
+	uint8_t written = 0;
+	for (size_t i = 0; i < length; i++)
+	{
+		if (sim_eeprom[offset + i] != data[i])
+		{
+			sim_eeprom[offset + i] = data[i];
+			sim_eepromWrites++;
+			written = 1;
+			sim_delay_ns(SIM_EEPROM_WRITE_US * SIM_US);
+		}
+	}
+	if (written)
+	{
+		sim_eeprom_save();
+	}
+}
+
+/*! \brief Number of bytes written since power up */
+uint32_t sim_eeprom_writes(void){
+	return sim_eepromWrites;
+}
+
+/*! \brief Load the content
+ *
+ *  The EEPROM is erased if there is no file yet.
+ */
+void sim_eeprom_init(void){
+	memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+	if (sim_config.eeprom_file)
+	{
+		FILE *file = fopen(sim_config.eeprom_file, "rb");
+		if (file)
+		{
+			if (fread(sim_eeprom, 1, sizeof(sim_eeprom), file) != sizeof(sim_eeprom))
+			{
+				sim_fail("EEPROM file too short");
+			}
+			fclose(file);
+		}
+	}
+}
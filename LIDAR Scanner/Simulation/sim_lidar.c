@@ -0,0 +1,308 @@
+/*
+ * sim_lidar.c
+ *
+ * Created: 17.10.2026
+ *
+ * Virtual LIDAR-Lite units. They measure the room model in the direction of the rotor and the servo,
+ * unit u is turned by u / sim_config.lidar_units of a turn like in scan_unitPosition().
+ * Registers with bit 7 in the address are read and written with auto increment.
+ * Unit 0 is always powered, the others by their enable pins of lidar.h. A unit answers at LIDARLite_ADDRESS
+ * until it gets a new address with its serial number and disables the default address.
+ * With sim_config.lidar_warm unit 0 keeps the address of the last run, like after a reset of the MCU alone.
+ */
+
+#include "sim.h"
+#include "room.h"
+#include "lidar.h"
+#include "motor.h"
+#include <string.h>
+#include <math.h>
+
+/*! \def SIM_LIDAR_...
+ *
+ *  Define the registers which are not used by the firmware
+ */
+#define SIM_LIDAR_DISTANCE_HIGH	0x0F
+#define SIM_LIDAR_DISTANCE_LOW	0x10
+#define SIM_LIDAR_VELOCITY_MODE	0x80
+#define SIM_LIDAR_SERIAL		(REGISTER_SERIAL & 0x7F)
+
+/*! \def SIM_LIDAR_DELAY_NS
+ *
+ *  Define the unit of REGISTER_BURST_DELAY
+ */
+#define SIM_LIDAR_DELAY_NS	(500 * SIM_US)
+
+/*! \brief State of a unit */
+typedef struct {
+	uint8_t reg[128];
+	uint8_t pointer;			/*!< Register pointer, bit 7 enables the auto increment */
+	uint8_t powered;
+	sim_time_t start;			/*!< Acquisition: start, end and the measures which are left */
+	sim_time_t end;
+	uint16_t left;
+	int16_t distance;			/*!< Last measured distance in cm */
+} sim_lidar_unit_t;
+
+static sim_lidar_unit_t sim_lidarUnits[LIDAR_UNITS_MAX];
+
+/*! \brief Unit of the running transaction */
+static sim_lidar_unit_t *sim_lidarSelected = 0;
+
+/*! \brief Set until the register address of a write transaction is received */
+static uint8_t sim_lidarFirst = 0;
+
+static uint32_t sim_lidarAcquisitions = 0;
+
+/*! \brief Number of acquisitions while the servo was moving */
+static uint32_t sim_lidarUnsettled = 0;
+
+
+//Number of units on the bus
+static uint8_t sim_lidar_units(void){
+	return sim_config.lidar_units < LIDAR_UNITS_MAX ? sim_config.lidar_units : LIDAR_UNITS_MAX;
+}
+
+//Power up state of a unit, every unit has its own serial number
+static void sim_lidar_reset(sim_lidar_unit_t *u, uint8_t powered){
+	uint8_t n = u - sim_lidarUnits;
+	memset(u, 0, sizeof(*u));
+	u->reg[REGISTER_BURST_COUNT] = 1;
+	u->reg[SIM_LIDAR_SERIAL] = 0x5A + n;
+	u->reg[SIM_LIDAR_SERIAL + 1] = 0x10 + 0x11 * n;
+	u->end = SIM_NEVER;
+	u->powered = powered;
+}
+
+//Start the acquisition after delay
+static void sim_lidar_acquire(sim_lidar_unit_t *u, sim_time_t delay){
+	u->start = sim_now() + delay;
+	u->end = u->start + sim_config.lidar_acq_us * SIM_US;
+}
+
+//Measure the room in the direction of a unit
+static int16_t sim_lidar_measure(sim_lidar_unit_t *u){
+	uint8_t n = u - sim_lidarUnits;
+	double offset = n * (MOTOR_MAX_STEPS / sim_lidar_units()) * 360.0 / MOTOR_MAX_STEPS;
+	double d = room_range(fmod(sim_motor_azimuth() + offset, 360.0), sim_motor_elevation());
+	d += sim_gauss() * sim_config.lidar_noise_cm;
+	if (sim_config.lidar_spike_rate > 0 && sim_random() < sim_config.lidar_spike_rate * 4294967296.0)
+	{
+		d = sim_random() % MAX_VALUE;
+	}
+	d += (int8_t)u->reg[CALIBRATION_REGISTER];
+	if (d < 1)
+	{
+		d = 1;
+	}
+	if (d > MAX_VALUE)
+	{
+		d = MAX_VALUE;
+	}
+	return (int16_t)(d + 0.5);
+}
+
+static void sim_lidar_register(sim_lidar_unit_t *u, uint8_t reg, uint8_t value){
+	reg &= 0x7F;
+	u->reg[reg] = value;
+	if (reg == REGISTER_MEASURE && value != 0)
+	{
+		uint8_t count = u->reg[REGISTER_BURST_COUNT];
+		u->left = count == 0xFF ? 0xFFFF : (count > 1 ? count : 1);
+		sim_lidar_acquire(u, 0);
+	}
+	else if (reg == REGISTER_MEASURE)
+	{
+		u->left = 0;
+		u->end = SIM_NEVER;
+	}
+}
+
+static uint8_t sim_lidar_busy(sim_lidar_unit_t *u){
+	return u->left && sim_now() >= u->start && sim_now() < u->end;
+}
+
+//The new address is only taken if the serial number was written back
+static uint8_t sim_lidar_matches(sim_lidar_unit_t *u, uint8_t address){
+	uint8_t unlocked = u->reg[REGISTER_SERIAL_LOW] == u->reg[SIM_LIDAR_SERIAL]
+		&& u->reg[REGISTER_SERIAL_HIGH] == u->reg[SIM_LIDAR_SERIAL + 1];
+	uint8_t control = u->reg[REGISTER_ADDRESS_CONTROL];
+	if (address == LIDARLite_ADDRESS)
+	{
+		return !(unlocked && (control & ADDRESS_DISABLE_DEFAULT));
+	}
+	return unlocked && u->reg[REGISTER_ADDRESS] != 0 && address == u->reg[REGISTER_ADDRESS];
+}
+
+/*! \brief Address the sensors
+ *
+ *  \param address 7 bit address
+ *  \return 1 if a unit answers
+ */
+uint8_t sim_lidar_address(uint8_t address){
+	sim_lidarSelected = 0;
+	for (uint8_t n = 0; n < sim_lidar_units(); n++)
+	{
+		if (sim_lidarUnits[n].powered && sim_lidar_matches(&sim_lidarUnits[n], address))
+		{
+			sim_lidarSelected = &sim_lidarUnits[n];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*! \brief Start of a transaction
+ *
+ *  \param read 1 for a read transaction
+ */
+void sim_lidar_start(uint8_t read){
+	sim_lidarFirst = !read;
+}
+
+/*! \brief Byte of a write transaction
+ *
+ *  \return 1 for ACK
+ */
+uint8_t sim_lidar_write(uint8_t data){
+	sim_lidar_unit_t *u = sim_lidarSelected;
+	if (sim_lidarFirst)
+	{
+		sim_lidarFirst = 0;
+		u->pointer = data;
+		return 1;
+	}
+	sim_lidar_register(u, u->pointer, data);
+	if (u->pointer & 0x80)
+	{
+		u->pointer++;
+	}
+	return 1;
+}
+
+/*! \brief Byte of a read transaction
+ *
+ *  \return Value of the register at the pointer
+ */
+uint8_t sim_lidar_read(void){
+	sim_lidar_unit_t *u = sim_lidarSelected;
+	uint8_t reg = u->pointer & 0x7F;
+	uint8_t value = u->reg[reg];
+	if (reg == REGISTER_STATUS)
+	{
+		value = sim_lidar_busy(u) ? STATUS_BUSY : 0;
+	}
+	if (u->pointer & 0x80)
+	{
+		u->pointer++;
+	}
+	return value;
+}
+
+/*! \brief STOP or repeated START */
+void sim_lidar_stop(void){
+	sim_lidarFirst = 0;
+}
+
+/*! \brief Number of finished acquisitions of all units */
+uint32_t sim_lidar_acquisitions(void){
+	return sim_lidarAcquisitions;
+}
+
+/*! \brief Number of finished acquisitions while the servo was moving */
+uint32_t sim_lidar_unsettled(void){
+	return sim_lidarUnsettled;
+}
+
+//Switch the units 1 and up with their enable pins, a unit loses its address when it is switched off
+static void sim_lidar_sync(void){
+	static const uint8_t pins[LIDAR_UNITS_MAX - 1] = {LIDAR_ENABLE_1, LIDAR_ENABLE_2, LIDAR_ENABLE_3};
+	if (!sim_changed8(SIM_PORTC, 0) && !sim_changed8(SIM_DDRC, 0))
+	{
+		return;
+	}
+	uint8_t high = sim_get8(SIM_DDRC) & sim_get8(SIM_PORTC);
+	for (uint8_t n = 1; n < sim_lidar_units(); n++)
+	{
+		uint8_t powered = (high >> pins[n - 1]) & 1;
+		if (powered != sim_lidarUnits[n].powered)
+		{
+			sim_lidar_reset(&sim_lidarUnits[n], powered);
+		}
+	}
+}
+
+//Unit with the next acquisition to finish
+static sim_lidar_unit_t* sim_lidar_first(void){
+	sim_lidar_unit_t *first = &sim_lidarUnits[0];
+	for (uint8_t n = 1; n < sim_lidar_units(); n++)
+	{
+		sim_lidar_unit_t *u = &sim_lidarUnits[n];
+		if (u->left && (!first->left || u->end < first->end))
+		{
+			first = u;
+		}
+	}
+	return first;
+}
+
+static sim_time_t sim_lidar_next(void){
+	sim_lidar_unit_t *u = sim_lidar_first();
+	return u->left ? u->end : SIM_NEVER;
+}
+
+static void sim_lidar_event(void){
+	sim_lidar_unit_t *u = sim_lidar_first();
+	int16_t d = sim_lidar_measure(u);
+	if (u->reg[REGISTER_ACQ_MODE] & SIM_LIDAR_VELOCITY_MODE)
+	{
+		u->reg[REGISTER_MEASURE_VELOCITY] = (uint8_t)(int8_t)(d - u->distance);
+	}
+	u->distance = d;
+	u->reg[SIM_LIDAR_DISTANCE_HIGH] = d >> 8;
+	u->reg[SIM_LIDAR_DISTANCE_LOW] = d & 0xFF;
+	sim_lidarAcquisitions++;
+	if (sim_motor_servoMoving())
+	{
+		sim_lidarUnsettled++;
+	}
+
+	if (u->left != 0xFFFF)
+	{
+		u->left--;
+	}
+	if (u->left)
+	{
+		sim_time_t delay = 0;
+		if (u->reg[REGISTER_ACQ_MODE] & ACQ_MODE_BURST_DELAY)
+		{
+			delay = u->reg[REGISTER_BURST_DELAY] * SIM_LIDAR_DELAY_NS;
+		}
+		sim_lidar_acquire(u, delay);
+	}
+	else
+	{
+		u->end = SIM_NEVER;
+	}
+}
+
+static const sim_peripheral_t sim_lidar = {
+	sim_lidar_sync, 0, sim_lidar_next, sim_lidar_event, 0
+};
+
+/*! \brief Register the sensors */
+void sim_lidar_init(void){
+	for (uint8_t n = 0; n < LIDAR_UNITS_MAX; n++)
+	{
+		sim_lidar_reset(&sim_lidarUnits[n], n == 0);
+	}
+	if (sim_config.lidar_warm)
+	{
+		uint8_t *reg = sim_lidarUnits[0].reg;
+		reg[REGISTER_SERIAL_LOW] = reg[SIM_LIDAR_SERIAL];
+		reg[REGISTER_SERIAL_HIGH] = reg[SIM_LIDAR_SERIAL + 1];
+		reg[REGISTER_ADDRESS] = LIDAR_UNIT_ADDRESS;
+		reg[REGISTER_ADDRESS_CONTROL] = ADDRESS_DISABLE_DEFAULT;
+	}
+	sim_register(&sim_lidar);
+}
@@ -0,0 +1,286 @@
+/*
+ * sim_motor.c
+ *
+ * Created: 17.10.2026
+ *
+ * Mechanics of the scanner: the stepper decoded from the coil pins, the light barrier at the ADC
+ * and the servo at the PWM of timer1. The servo sees a new position with the next pulse.
+ * The rotor is modelled in half steps, a full step moves it by two.
+ */
+
+#include "sim.h"
+#include "motor.h"
+#include "servo.h"
+
+/*! \def SIM_POSITIONS
+ *
+ *  Define the half steps per rotation
+ */
+#define SIM_POSITIONS	MOTOR_MAX_POSITIONS
+
+/*! \def SIM_INDEX
+ *
+ *  Define the rotor position of the light barrier in half steps. motor_calibrate() sets this position
+ *  when it finds the barrier, so the positions of the firmware are the positions of the model.
+ */
+#define SIM_INDEX	(SIM_POSITIONS / 4)
+
+/*! \def SIM_ADC_...
+ *
+ *  Define the values of the light barrier: at the index, next to it and everywhere else
+ */
+#define SIM_ADC_INDEX	20
+#define SIM_ADC_EDGE	150
+#define SIM_ADC_OPEN	700
+
+/*! \brief Position of the rotor in half steps, not wrapped */
+static int32_t sim_rotor;
+
+/*! \brief Phase of the coils after the last step, -1 if no valid pattern was set yet */
+static int8_t sim_phase = -1;
+
+/*! \brief Statistics of the stepper */
+static uint32_t sim_steps = 0;
+static uint32_t sim_fastSteps = 0;
+static uint32_t sim_slips = 0;
+static int8_t sim_snap = 0;
+static sim_time_t sim_lastStep = 0;
+
+/*! \brief End of the running conversion */
+static sim_time_t sim_adcDone = SIM_NEVER;
+
+/*! \brief Servo, the angle moves from sim_servoFrom towards sim_servoTo since sim_servoStart */
+static double sim_servoFrom = 0;
+static double sim_servoTo = 0;
+static sim_time_t sim_servoStart = 0;
+
+
+//Phase of the half step sequence for the coil pins, -1 for no valid pattern.
+//The current of a coil is +1, -1 or 0 if both pins are low, at least one coil has to carry current.
+static int8_t sim_motor_phase(void){
+	static const int8_t phases[3][3] = {
+		//b = -1, 0, +1
+		{4, 5, 6},		//a = -1
+		{3, -1, 7},		//a = 0
+		{2, 1, 0}		//a = +1
+	};
+	uint8_t d = sim_get8(SIM_PORTD);
+	uint8_t a1 = (d >> MOTA1) & 1;
+	uint8_t a2 = (d >> MOTA2) & 1;
+	uint8_t b1 = (sim_get8(SIM_PORTB) >> MOTB1) & 1;
+	uint8_t b2 = (d >> MOTB2) & 1;
+	if (!((d >> STBY) & 1) || (a1 && a2) || (b1 && b2))
+	{
+		return -1;
+	}
+	return phases[a1 - a2 + 1][b1 - b2 + 1];
+}
+
+//Period of the servo signal
+static sim_time_t sim_servo_period(void){
+	static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+	uint16_t prescaler = prescalers[sim_get8(SIM_TCCR1B) & 0x07];
+	if (prescaler == 0)
+	{
+		return 0;
+	}
+	return (sim_time_t)(sim_get16(SIM_ICR1) + 1) * prescaler * 1000000000ULL / SIM_F_CPU;
+}
+
+//Angle of the servo in degrees for an OCR1A value, same scale as servo_toPosition()
+static double sim_servo_angle(uint16_t ocr){
+	double s = (ocr - POS_MIN) * 10.0 / ((POS_MAX - POS_MIN) / (SERVO_MAX_DEG / 10));
+	return SERVO_MAX_DEG - s;
+}
+
+/*! \brief Position of the rotor
+ *
+ *  \return Position in half steps, 0 to MOTOR_MAX_POSITIONS - 1
+ */
+int32_t sim_motor_rotor(void){
+	int32_t p = sim_rotor % SIM_POSITIONS;
+	return p < 0 ? p + SIM_POSITIONS : p;
+}
+
+/*! \brief Number of steps done, full or half steps */
+uint32_t sim_motor_steps(void){
+	return sim_steps;
+}
+
+/*! \brief Number of steps which came faster than sim_config.step_min_us */
+uint32_t sim_motor_fastSteps(void){
+	return sim_fastSteps;
+}
+
+/*! \brief Number of steps the rotor did not follow, see sim_config.slip_steps */
+uint32_t sim_motor_slips(void){
+	return sim_slips;
+}
+
+/*! \brief Half steps the rotor moved when the coils were energized the first time */
+int8_t sim_motor_snap(void){
+	return sim_snap;
+}
+
+/*! \brief Azimuth of the rotor in degrees */
+double sim_motor_azimuth(void){
+	return sim_motor_rotor() * 360.0 / SIM_POSITIONS;
+}
+
+/*! \brief Elevation of the servo in degrees, including the slew */
+double sim_motor_elevation(void){
+	if (sim_now() < sim_servoStart)
+	{
+		return sim_servoFrom;
+	}
+	double moved = (sim_now() - sim_servoStart) / 1e9 * sim_config.servo_deg_per_s;
+	if (sim_servoTo > sim_servoFrom)
+	{
+		return sim_servoFrom + moved < sim_servoTo ? sim_servoFrom + moved : sim_servoTo;
+	}
+	return sim_servoFrom - moved > sim_servoTo ? sim_servoFrom - moved : sim_servoTo;
+}
+
+/*! \brief Check the servo
+ *
+ *  \return 1 if the servo has not reached the position of OCR1A yet
+ */
+uint8_t sim_motor_servoMoving(void){
+	return sim_motor_elevation() != sim_servoTo;
+}
+
+//Value of the light barrier
+static uint16_t sim_motor_barrier(void){
+	int32_t d = sim_motor_rotor() - SIM_INDEX;
+	if (d < 0)
+	{
+		d = -d;
+	}
+	if (d > SIM_POSITIONS / 2)
+	{
+		d = SIM_POSITIONS - d;
+	}
+	//The edge reaches one full step to both sides
+	uint16_t value = d == 0 ? SIM_ADC_INDEX : (d <= 2 ? SIM_ADC_EDGE : SIM_ADC_OPEN);
+	return value + sim_random() % 5;
+}
+
+static void sim_motor_sync(void){
+	if (sim_changed8(SIM_PORTB, 0) || sim_changed8(SIM_PORTD, 0))
+	{
+		int8_t phase = sim_motor_phase();
+		if (phase >= 0 && sim_phase >= 0 && phase != sim_phase)
+		{
+			int8_t d = (phase - sim_phase) & 0x07;
+			if (d > 4)
+			{
+				d -= 8;
+			}
+			if (d < -2 || d > 2)
+			{
+				//The field turned more than a full step, the rotor stays
+				sim_fastSteps++;
+			}
+			else
+			{
+				//A half step needs half the time of a full step
+				uint8_t half = (d == 1 || d == -1);
+				if (sim_steps && sim_now() - sim_lastStep < (sim_config.step_min_us * SIM_US >> half))
+				{
+					sim_fastSteps++;
+				}
+				sim_steps++;
+				if (sim_config.slip_steps && sim_steps % sim_config.slip_steps == 0)
+				{
+					//The rotor lags behind the field from now on
+					sim_slips++;
+				}
+				else
+				{
+					sim_rotor += d;
+				}
+				sim_lastStep = sim_now();
+			}
+		}
+		else if (phase >= 0 && sim_phase < 0)
+		{
+			//First field after power up: the rotor snaps to the nearest detent of the phase
+			int8_t d = (phase - sim_rotor) & 0x07;
+			if (d > 4)
+			{
+				d -= 8;
+			}
+			sim_rotor += d;
+			sim_snap = d;
+		}
+		if (phase >= 0)
+		{
+			sim_phase = phase;
+		}
+	}
+
+	uint8_t old;
+	if (sim_changed8(SIM_ADCSRA, &old))
+	{
+		uint8_t adcsra = sim_get8(SIM_ADCSRA);
+		if ((adcsra & (1<<ADEN)) && (adcsra & (1<<ADSC)) && sim_adcDone == SIM_NEVER)
+		{
+			//13 ADC clocks, 25 for the first conversion
+			uint16_t prescaler = 1 << (adcsra & 0x07);
+			uint8_t clocks = (old & (1<<ADEN)) ? 13 : 25;
+			sim_adcDone = sim_now() + (sim_time_t)clocks * prescaler * 1000000000ULL / SIM_F_CPU;
+		}
+		if (adcsra & (1<<ADIF))
+		{
+			//Writing a one clears the flag
+			sim_set8(SIM_ADCSRA, adcsra & ~(1<<ADIF));
+		}
+	}
+
+	if (sim_changed16(SIM_OCR1A))
+	{
+		sim_time_t period = sim_servo_period();
+		sim_servoFrom = sim_motor_elevation();
+		sim_servoTo = sim_servo_angle(sim_get16(SIM_OCR1A));
+		sim_servoStart = period ? (sim_now() / period + 1) * period : sim_now();
+	}
+}
+
+static sim_time_t sim_motor_next(void){
+	return sim_adcDone;
+}
+
+static void sim_motor_event(void){
+	uint16_t value = 0;
+	if ((sim_get8(SIM_ADMUX) & 0x0F) == 1)
+	{
+		value = sim_motor_barrier();
+	}
+	sim_set16(SIM_ADCW, value);
+	sim_set8(SIM_ADCSRA, (sim_get8(SIM_ADCSRA) & ~(1<<ADSC)) | (1<<ADIF));
+	sim_adcDone = SIM_NEVER;
+}
+
+static uint8_t sim_motor_irq(uint8_t vector, uint8_t ack){
+	uint8_t adcsra = sim_get8(SIM_ADCSRA);
+	if (vector == SIM_VECT_ADC && (adcsra & (1<<ADIE)) && (adcsra & (1<<ADIF)))
+	{
+		if (ack)
+		{
+			sim_set8(SIM_ADCSRA, adcsra & ~(1<<ADIF));
+		}
+		return 1;
+	}
+	return 0;
+}
+
+static const sim_peripheral_t sim_motor = {
+	sim_motor_sync, 0, sim_motor_next, sim_motor_event, sim_motor_irq
+};
+
+/*! \brief Register the mechanics */
+void sim_motor_init(void){
+	sim_rotor = sim_config.rotor_start * 2;
+	sim_servoFrom = sim_servoTo = SERVO_MAX_DEG / 2;
+	sim_register(&sim_motor);
+}
@@ -0,0 +1,168 @@
+/*
+ * sim_timer.c
+ *
+ * Created: 17.10.2026
+ *
+ * Timer0 (overflow) and timer2 (CTC with OCR2A). The PWM outputs are not simulated.
+ */
+
+#include "sim.h"
+
+/*! \brief Prescalers of the clock select bits */
+static const uint16_t sim_timer0Prescaler[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static const uint16_t sim_timer2Prescaler[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+/*! \brief Timer0 */
+static sim_time_t sim_t0Tick = 0;
+static sim_time_t sim_t0Start;
+static sim_time_t sim_t0Overflow = SIM_NEVER;
+static uint8_t sim_t0Flag = 0;
+
+/*! \brief Timer2 */
+static sim_time_t sim_t2Tick = 0;
+static sim_time_t sim_t2Start;
+static uint8_t sim_t2Flag = 0;
+
+
+//Duration of one count for the clock select bits
+static sim_time_t sim_timer_tick(const uint16_t *prescaler, uint8_t tccrb){
+	uint16_t p = prescaler[tccrb & 0x07];
+	return p ? (sim_time_t)p * 1000000000ULL / SIM_F_CPU : 0;
+}
+
+//Time of the next compare match of timer2
+static sim_time_t sim_timer2_compare(void){
+	if (!sim_t2Tick)
+	{
+		return SIM_NEVER;
+	}
+	sim_time_t t = sim_t2Start + ((sim_time_t)sim_get8(SIM_OCR2A) + 1) * sim_t2Tick;
+	if (t < sim_now())
+	{
+		//OCR2A was set below the counter, the counter overflows first
+		t += 256 * sim_t2Tick;
+	}
+	return t;
+}
+
+static void sim_timer_sync(void){
+	if (sim_changed8(SIM_TCCR0B, 0))
+	{
+		sim_time_t tick = sim_timer_tick(sim_timer0Prescaler, sim_get8(SIM_TCCR0B));
+		if (tick && !sim_t0Tick)
+		{
+			sim_t0Start = sim_now();
+			sim_t0Overflow = sim_now() + 256 * tick;
+		}
+		else if (!tick)
+		{
+			sim_t0Overflow = SIM_NEVER;
+		}
+		sim_t0Tick = tick;
+	}
+	if (sim_changed8(SIM_TIFR0, 0) && (sim_get8(SIM_TIFR0) & (1<<TOV0)))
+	{
+		sim_t0Flag = 0;
+	}
+
+	if (sim_changed8(SIM_TCCR2B, 0))
+	{
+		sim_time_t tick = sim_timer_tick(sim_timer2Prescaler, sim_get8(SIM_TCCR2B));
+		if (tick && !sim_t2Tick)
+		{
+			sim_t2Start = sim_now() - (sim_time_t)sim_get8(SIM_TCNT2) * tick;
+		}
+		sim_t2Tick = tick;
+	}
+	if (sim_accessed8(SIM_TIFR2) && (sim_get8(SIM_TIFR2) & (1<<OCF2A)))
+	{
+		//Writing a one clears the flag
+		sim_t2Flag = 0;
+	}
+}
+
+static void sim_timer_refresh(uint8_t id){
+	switch (id)
+	{
+		case SIM_TCNT0:
+		if (sim_t0Tick)
+		{
+			sim_set8(SIM_TCNT0, ((sim_now() - sim_t0Start) / sim_t0Tick) & 0xFF);
+		}
+		break;
+
+		case SIM_TIFR0:
+		sim_set8(SIM_TIFR0, sim_t0Flag ? (1<<TOV0) : 0);
+		break;
+
+		case SIM_TCNT2:
+		if (sim_t2Tick)
+		{
+			sim_set8(SIM_TCNT2, ((sim_now() - sim_t2Start) / sim_t2Tick) & 0xFF);
+		}
+		break;
+
+		case SIM_TIFR2:
+		sim_set8(SIM_TIFR2, sim_t2Flag ? (1<<OCF2A) : 0);
+		break;
+	}
+}
+
+static sim_time_t sim_timer_next(void){
+	sim_time_t t = sim_timer2_compare();
+	return sim_t0Overflow < t ? sim_t0Overflow : t;
+}
+
+static void sim_timer_event(void){
+	if (sim_t0Overflow <= sim_now())
+	{
+		sim_t0Flag = 1;
+		sim_t0Overflow += 256 * sim_t0Tick;
+	}
+	sim_time_t t = sim_timer2_compare();
+	if (t <= sim_now())
+	{
+		//CTC, the counter restarts at the compare match
+		sim_t2Flag = 1;
+		sim_t2Start = t;
+	}
+}
+
+static uint8_t sim_timer_irq(uint8_t vector, uint8_t ack){
+	switch (vector)
+	{
+		case SIM_VECT_TIMER0_OVF:
+		if (sim_t0Flag && (sim_get8(SIM_TIMSK0) & (1<<TOIE0)))
+		{
+			if (ack)
+			{
+				sim_t0Flag = 0;
+			}
+			return 1;
+		}
+		return 0;
+
+		case SIM_VECT_TIMER2_COMPA:
+		if (sim_t2Flag && (sim_get8(SIM_TIMSK2) & (1<<OCIE2A)))
+		{
+			if (ack)
+			{
+				sim_t2Flag = 0;
+			}
+			return 1;
+		}
+		return 0;
+
+		default:
+		return 0;
+	}
+}
+
+static const sim_peripheral_t sim_timer = {
+	sim_timer_sync, sim_timer_refresh, sim_timer_next, sim_timer_event, sim_timer_irq
+};
+
+/*! \brief Register the timers */
+void sim_timer_init(void){
+	sim_register(&sim_timer);
+}
@@ -0,0 +1,270 @@
+/*
+ * sim_twi.c
+ *
+ * Created: 17.10.2026
+ *
+ * TWI master driven by TWCR. Every action of the master takes its time on the bus before TWINT is
+ * set with the new status. The only devices on the bus are the virtual LIDAR-Lite units.
+ * A slave may get stuck in a read and hold SDA low until SCL is clocked by hand.
+ */
+
+#include "sim.h"
+#include <util/twi.h>
+
+/*! \brief State of the master */
+enum {
+	SIM_TWI_IDLE,		/*!< Bus is free */
+	SIM_TWI_ADDRESS,	/*!< START sent, TWDR holds the address */
+	SIM_TWI_TRANSMIT,	/*!< Master transmitter */
+	SIM_TWI_RECEIVE		/*!< Master receiver */
+};
+
+static uint8_t sim_twiState = SIM_TWI_IDLE;
+
+/*! \brief Set while TWINT is set by the hardware and not cleared by the firmware */
+static uint8_t sim_twint = 0;
+
+/*! \brief End of the running action and its status */
+static sim_time_t sim_twiDone = SIM_NEVER;
+static uint8_t sim_twiStatus;
+
+/*! \brief Set if the action ends with the STOP only, TWINT is not set then */
+static uint8_t sim_twiStop = 0;
+
+/*! \brief Set if the addressed device answered */
+static uint8_t sim_twiSelected = 0;
+
+static uint32_t sim_twiTransactions = 0;
+
+/*! \brief SCL clocks a stuck slave needs to finish its byte and release SDA */
+#define SIM_TWI_STUCK_CLOCKS	5
+
+/*! \brief Remaining SCL clocks until the stuck slave releases SDA, 0 if SDA is free */
+static uint8_t sim_twiHeld = 0;
+
+/*! \brief Level of SCL at the last sync */
+static uint8_t sim_twiScl = 1;
+
+static uint32_t sim_twiRecoveries = 0;
+
+
+//Duration of one SCL period
+static sim_time_t sim_twi_bit(void){
+	uint8_t prescaler = 1 << (2 * (sim_get8(SIM_TWSR) & 0x03));
+	return (sim_time_t)(16 + 2 * sim_get8(SIM_TWBR) * prescaler) * 1000000000ULL / SIM_F_CPU;
+}
+
+static void sim_twi_schedule(uint8_t bits, uint8_t status){
+	sim_twiDone = sim_now() + bits * sim_twi_bit();
+	sim_twiStatus = status;
+}
+
+static void sim_twi_release(void){
+	if (sim_twiSelected)
+	{
+		sim_lidar_stop();
+		sim_twiSelected = 0;
+	}
+	sim_twiState = SIM_TWI_IDLE;
+}
+
+//The firmware wrote TWCR
+static void sim_twi_control(uint8_t v){
+	if (!(v & (1<<TWEN)))
+	{
+		sim_twi_release();
+		sim_twint = 0;
+		sim_twiDone = SIM_NEVER;
+		sim_twiStop = 0;
+		return;
+	}
+	if (!(v & (1<<TWINT)) || sim_twiDone != SIM_NEVER)
+	{
+		//Only the enable bits changed
+		return;
+	}
+	sim_twint = 0;
+	sim_set8(SIM_TWCR, v & ~(1<<TWINT));
+
+	if (v & (1<<TWSTO))
+	{
+		sim_twi_release();
+		if (v & (1<<TWSTA))
+		{
+			sim_twi_schedule(2, TW_START);
+		}
+		else
+		{
+			sim_twiStop = 1;
+			sim_twi_schedule(1, 0);
+		}
+		return;
+	}
+	if (v & (1<<TWSTA))
+	{
+		if (sim_twiHeld)
+		{
+			//No START while SDA is held low
+			sim_twi_release();
+			sim_twi_schedule(1, TW_BUS_ERROR);
+			return;
+		}
+		uint8_t status = sim_twiState == SIM_TWI_IDLE ? TW_START : TW_REP_START;
+		if (sim_twiSelected)
+		{
+			sim_lidar_stop();
+			sim_twiSelected = 0;
+		}
+		sim_twi_schedule(1, status);
+		return;
+	}
+
+	uint8_t data = sim_get8(SIM_TWDR);
+	switch (sim_twiState)
+	{
+		case SIM_TWI_ADDRESS:
+		sim_twiSelected = sim_lidar_address(data >> 1);
+		if (data & TW_READ)
+		{
+			sim_twiState = SIM_TWI_RECEIVE;
+			sim_twi_schedule(9, sim_twiSelected ? TW_MR_SLA_ACK : TW_MR_SLA_NACK);
+		}
+		else
+		{
+			sim_twiState = SIM_TWI_TRANSMIT;
+			sim_twi_schedule(9, sim_twiSelected ? TW_MT_SLA_ACK : TW_MT_SLA_NACK);
+		}
+		if (sim_twiSelected)
+		{
+			sim_lidar_start(data & TW_READ);
+			sim_twiTransactions++;
+		}
+		break;
+
+		case SIM_TWI_TRANSMIT:
+		if (sim_twiSelected && sim_lidar_write(data))
+		{
+			sim_twi_schedule(9, TW_MT_DATA_ACK);
+		}
+		else
+		{
+			sim_twi_schedule(9, TW_MT_DATA_NACK);
+		}
+		break;
+
+		case SIM_TWI_RECEIVE:
+		if (sim_twiSelected && sim_config.twi_stuck && sim_twiTransactions >= sim_config.twi_stuck && !sim_twiRecoveries && !sim_twiHeld)
+		{
+			sim_twiHeld = SIM_TWI_STUCK_CLOCKS;
+			sim_twi_schedule(9, TW_BUS_ERROR);
+			break;
+		}
+		sim_set8(SIM_TWDR, sim_twiSelected ? sim_lidar_read() : 0xFF);
+		sim_twi_schedule(9, (v & (1<<TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK);
+		break;
+
+		default:
+		//TWINT cleared without a START
+		sim_twi_schedule(1, TW_BUS_ERROR);
+		break;
+	}
+}
+
+static void sim_twi_sync(void){
+	if (sim_changed8(SIM_DDRC, 0) || sim_changed8(SIM_PORTC, 0))
+	{
+		//Only a pin driven low pulls the open drain line, a pin driven high is a short
+		uint8_t out = sim_get8(SIM_DDRC) & ~sim_get8(SIM_PORTC);
+		uint8_t scl = !(out & (1<<PINC5));
+		if (sim_get8(SIM_DDRC) & sim_get8(SIM_PORTC) & ((1<<PINC5) | (1<<PINC4)))
+		{
+			sim_fail("TWI pin driven high");
+		}
+		if (sim_twiHeld && scl && !sim_twiScl && --sim_twiHeld == 0)
+		{
+			sim_twiRecoveries++;
+		}
+		sim_twiScl = scl;
+	}
+	//TWCR is only written while TWINT is set, a write of the same value is still a write then
+	if (sim_changed8(SIM_TWCR, 0) || (sim_twint && sim_accessed8(SIM_TWCR)))
+	{
+		if (sim_twint)
+		{
+			sim_defer(-1);
+		}
+		sim_twi_control(sim_get8(SIM_TWCR));
+	}
+}
+
+static void sim_twi_refresh(uint8_t id){
+	if (id == SIM_TWCR && sim_twint && !sim_accessed8(SIM_TWCR))
+	{
+		//Wait for the value of the firmware before the signal may sync
+		sim_defer(1);
+	}
+	else if (id == SIM_PINC)
+	{
+		//Pins driven low or released to the pull ups
+		uint8_t out = sim_get8(SIM_DDRC) & ~sim_get8(SIM_PORTC);
+		sim_set8(SIM_PINC, ~out & ~(sim_twiHeld ? (1<<PINC4) : 0));
+	}
+}
+
+static sim_time_t sim_twi_next(void){
+	return sim_twiDone;
+}
+
+static void sim_twi_event(void){
+	uint8_t v = sim_get8(SIM_TWCR);
+	sim_twiDone = SIM_NEVER;
+	if (sim_twiStop)
+	{
+		sim_twiStop = 0;
+		sim_set8(SIM_TWCR, v & ~(1<<TWSTO));
+		return;
+	}
+	switch (sim_twiStatus)
+	{
+		case TW_START:
+		case TW_REP_START:
+		sim_twiState = SIM_TWI_ADDRESS;
+		break;
+
+		case TW_BUS_ERROR:
+		sim_twi_release();
+		break;
+	}
+	sim_set8(SIM_TWSR, (sim_get8(SIM_TWSR) & 0x03) | sim_twiStatus);
+	sim_set8(SIM_TWCR, (v & ~(1<<TWSTO)) | (1<<TWINT));
+	sim_twint = 1;
+}
+
+static uint8_t sim_twi_irq(uint8_t vector, uint8_t ack){
+	(void)ack;
+	return vector == SIM_VECT_TWI && sim_twint && (sim_get8(SIM_TWCR) & (1<<TWIE));
+}
+
+/*! \brief Number of transactions which were acknowledged by a device */
+uint32_t sim_twi_transactions(void){
+	return sim_twiTransactions;
+}
+
+/*! \brief Number of times a stuck slave was clocked free */
+uint32_t sim_twi_recoveries(void){
+	return sim_twiRecoveries;
+}
+
+/*! \brief Set while a stuck slave holds SDA low */
+uint8_t sim_twi_stuck(void){
+	return sim_twiHeld != 0;
+}
+
+static const sim_peripheral_t sim_twi = {
+	sim_twi_sync, sim_twi_refresh, sim_twi_next, sim_twi_event, sim_twi_irq
+};
+
+/*! \brief Register the TWI */
+void sim_twi_init(void){
+	sim_register(&sim_twi);
+}
@@ -0,0 +1,255 @@
+/*
+ * sim_uart.c
+ *
+ * Created: 17.10.2026
+ *
+ * USART0 with the double buffered transmitter, the two level receive FIFO and the host on the other
+ * side of the line. Characters are lost if the baud rates of both sides differ by more than 3 %.
+ */
+
+#include "sim.h"
+#include <stdio.h>
+
+/*! \def SIM_HOST_BUFFER
+ *
+ *  Define the size of the buffer for the characters of the host
+ */
+#define SIM_HOST_BUFFER	4096
+
+/*! \brief Characters the host sends */
+static uint8_t sim_hostBuffer[SIM_HOST_BUFFER];
+static uint16_t sim_hostHead = 0;
+static uint16_t sim_hostTail = 0;
+
+/*! \brief End of the character on the line to the controller */
+static sim_time_t sim_rxDone = SIM_NEVER;
+
+/*! \brief Receive FIFO */
+static uint8_t sim_rxFifo[2];
+static uint8_t sim_rxCount = 0;
+static uint8_t sim_rxOverrun = 0;
+
+/*! \brief Transmitter */
+static uint8_t sim_udr;
+static uint8_t sim_udrFull = 0;
+static uint8_t sim_shift;
+static sim_time_t sim_txDone = SIM_NEVER;
+static uint8_t sim_txComplete = 0;
+
+/*! \brief Set if the firmware writes UDR0 with the current access */
+static uint8_t sim_udrWrite = 0;
+
+/*! \brief Characters lost because of a wrong baud rate */
+static uint32_t sim_lost = 0;
+
+
+//Baud rate of the controller
+static double sim_uart_baud(void){
+	uint16_t ubrr = ((sim_get8(SIM_UBRR0H) & 0x0F) << 8) | sim_get8(SIM_UBRR0L);
+	uint8_t divider = (sim_get8(SIM_UCSR0A) & (1<<U2X0)) ? 8 : 16;
+	return (double)SIM_F_CPU / (divider * (ubrr + 1.0));
+}
+
+//Duration of a character with start and stop bit
+static sim_time_t sim_uart_frame(void){
+	return (sim_time_t)(10e9 / sim_uart_baud());
+}
+
+//Check the baud rates of the controller and the host
+static uint8_t sim_uart_match(void){
+	double ratio = sim_uart_baud() / sim_config.host_baud;
+	return ratio > 0.97 && ratio < 1.03;
+}
+
+static void sim_uart_transmit(uint8_t c){
+	sim_shift = c;
+	sim_txDone = sim_now() + sim_uart_frame();
+}
+
+static void sim_uart_sync(void){
+	uint8_t old;
+	if (sim_changed8(SIM_UCSR0A, &old))
+	{
+		uint8_t a = sim_get8(SIM_UCSR0A);
+		if (a & (1<<TXC0))
+		{
+			sim_txComplete = 0;
+		}
+	}
+	if (sim_udrWrite)
+	{
+		sim_udrWrite = 0;
+		sim_defer(-1);
+		if (!(sim_get8(SIM_UCSR0B) & (1<<TXEN0)))
+		{
+			return;
+		}
+		if (sim_txDone == SIM_NEVER)
+		{
+			sim_uart_transmit(sim_get8(SIM_UDR0));
+		}
+		else
+		{
+			if (sim_udrFull)
+			{
+				sim_lost++;
+			}
+			sim_udr = sim_get8(SIM_UDR0);
+			sim_udrFull = 1;
+		}
+	}
+}
+
+static void sim_uart_refresh(uint8_t id){
+	if (id == SIM_UCSR0A)
+	{
+		uint8_t a = sim_get8(SIM_UCSR0A) & ((1<<U2X0) | (1<<MPCM0));
+		if (sim_rxCount)
+		{
+			a |= (1<<RXC0);
+		}
+		if (sim_txComplete)
+		{
+			a |= (1<<TXC0);
+		}
+		if (!sim_udrFull)
+		{
+			a |= (1<<UDRE0);
+		}
+		if (sim_rxOverrun)
+		{
+			a |= (1<<DOR0);
+		}
+		sim_set8(SIM_UCSR0A, a);
+	}
+	else if (id == SIM_UDR0)
+	{
+		//The firmware only reads UDR0 in the receive ISR
+		if (sim_vector() == SIM_VECT_USART_RX)
+		{
+			uint8_t c = sim_rxFifo[0];
+			if (sim_rxCount)
+			{
+				sim_rxFifo[0] = sim_rxFifo[1];
+				sim_rxCount--;
+			}
+			sim_rxOverrun = 0;
+			sim_set8(SIM_UDR0, c);
+		}
+		else if (!sim_udrWrite)
+		{
+			sim_udrWrite = 1;
+			sim_defer(1);
+		}
+	}
+}
+
+static sim_time_t sim_uart_next(void){
+	return sim_rxDone < sim_txDone ? sim_rxDone : sim_txDone;
+}
+
+static void sim_uart_event(void){
+	if (sim_txDone <= sim_now())
+	{
+		uint8_t c = sim_shift;
+		sim_txDone = SIM_NEVER;
+		if (sim_udrFull)
+		{
+			sim_udrFull = 0;
+			sim_uart_transmit(sim_udr);
+		}
+		else
+		{
+			sim_txComplete = 1;
+		}
+		if (!sim_uart_match())
+		{
+			sim_lost++;
+		}
+		else if (sim_config.receive)
+		{
+			sim_config.receive(c);
+		}
+	}
+	if (sim_rxDone <= sim_now())
+	{
+		uint8_t c = sim_hostBuffer[sim_hostTail++ % SIM_HOST_BUFFER];
+		if (!(sim_get8(SIM_UCSR0B) & (1<<RXEN0)) || !sim_uart_match())
+		{
+			sim_lost++;
+		}
+		else if (sim_rxCount < 2)
+		{
+			sim_rxFifo[sim_rxCount++] = c;
+		}
+		else
+		{
+			sim_rxOverrun = 1;
+		}
+		sim_rxDone = sim_hostHead != sim_hostTail ? sim_now() + (sim_time_t)(10e9 / sim_config.host_baud) : SIM_NEVER;
+	}
+}
+
+static uint8_t sim_uart_irq(uint8_t vector, uint8_t ack){
+	uint8_t b = sim_get8(SIM_UCSR0B);
+	switch (vector)
+	{
+		case SIM_VECT_USART_RX:
+		return (b & (1<<RXCIE0)) && sim_rxCount;
+
+		case SIM_VECT_USART_UDRE:
+		return (b & (1<<UDRIE0)) && !sim_udrFull;
+
+		case SIM_VECT_USART_TX:
+		if ((b & (1<<TXCIE0)) && sim_txComplete)
+		{
+			if (ack)
+			{
+				sim_txComplete = 0;
+			}
+			return 1;
+		}
+		return 0;
+
+		default:
+		return 0;
+	}
+}
+
+/*! \brief Send characters to the controller
+ *
+ *  Called by the host, the characters are queued behind the ones which are still on the line.
+ *  \param data Characters
+ *  \param length Number of characters
+ *  \return Time when the last character has arrived
+ */
+sim_time_t sim_uart_send(const char *data, uint16_t length){
+	sim_time_t frame = (sim_time_t)(10e9 / sim_config.host_baud);
+	if ((uint16_t)(sim_hostHead - sim_hostTail) + length > SIM_HOST_BUFFER)
+	{
+		sim_fail("host buffer overflow");
+	}
+	if (sim_rxDone == SIM_NEVER)
+	{
+		sim_rxDone = sim_now() + frame;
+	}
+	for (uint16_t i = 0; i < length; i++)
+	{
+		sim_hostBuffer[sim_hostHead++ % SIM_HOST_BUFFER] = data[i];
+	}
+	return sim_rxDone + (sim_time_t)((uint16_t)(sim_hostHead - sim_hostTail) - 1) * frame;
+}
+
+/*! \brief Number of characters lost on the line */
+uint32_t sim_uart_lost(void){
+	return sim_lost;
+}
+
+static const sim_peripheral_t sim_uart = {
+	sim_uart_sync, sim_uart_refresh, sim_uart_next, sim_uart_event, sim_uart_irq
+};
+
+/*! \brief Register the USART */
+void sim_uart_init(void){
+	sim_register(&sim_uart);
+}
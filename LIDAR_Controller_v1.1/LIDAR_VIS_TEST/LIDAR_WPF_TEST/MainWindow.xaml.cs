@@ -14,6 +14,7 @@ using System.IO.Ports;
 using System.Text.RegularExpressions;
 using HelixToolkit.Wpf;
 using System.Collections.Generic;
+using System.Threading;
 
 
 namespace LIDAR_Controller
@@ -50,6 +51,18 @@ namespace LIDAR_Controller
         /** @brief   The grid lines of the xy-plane. */
         GridLinesVisual3D gridLinesXY = new GridLinesVisual3D();
 
+
+        /** @brief   True if the LIDAR-Scanner sends binary scan records ("#0 1" or "#0 2"). */
+        volatile bool binaryMode = false;
+
+
+        /** @brief   The decoder for binary scan records. */
+        ScanRecordDecoder decoder = new ScanRecordDecoder();
+
+
+        /** @brief   The number of motor positions of the step mode of the LIDAR-Scanner ("#h x"). */
+        int positions = Measurement.FullSteps;
+
         /**********************************************************************************************//**
          * @fn  public MainWindow()
          *
@@ -79,7 +92,7 @@ namespace LIDAR_Controller
          *          1. Check if ComPort is open  
          *          2. Read line from buffer  
          *          3. Add the received line to textBox1  
-         *          4. Get relevant data from string using a regular expression  
+         *          4. Get relevant data from a point line using a regular expression  
          *          5. Parse data into integers  
          *          6. Set a point of the selected measurement based on the received data.  
          *          
@@ -99,6 +112,11 @@ namespace LIDAR_Controller
             {
                 //1
                 if (!ComPort.IsOpen) return;
+                if (binaryMode)
+                {
+                    BinaryReceiveHandler();
+                    return;
+                }
                 string ReceivedText = "";
                 //2
                 ReceivedText = ComPort.ReadLine();
@@ -108,22 +126,26 @@ namespace LIDAR_Controller
                     this.textBox1.AppendText(ReceivedText);
                     this.textBox1.ScrollToEnd();
                 }));
-                //4
+                //4 (only point lines, the frame markers of "#r" have numbers as well)
+                if (!ReceivedText.TrimStart().StartsWith("mpos:")) return;
                 string[] numbers = Regex.Split(ReceivedText, @"\D+");
-                //5
-                if (numbers.Length == 5)
+                //5 ("mpos: X sdeg: Y val: Z", " t: T" with timestamp and " id: U" with more than one unit follow)
+                if (numbers.Length >= 5 && numbers.Length <= 7)
                 {
                     int mpos = 0;
                     int spos = 0;
                     int value = 0;
-                    if (int.TryParse(numbers[1], out mpos) && int.TryParse(numbers[2], out spos) && int.TryParse(numbers[3],out value))
+                    if (int.TryParse(numbers[1], out mpos) && int.TryParse(numbers[2], out spos) && int.TryParse(numbers[3],out value)
+                        && MeasureList[selectedMeasure].isInside(mpos + 1, spos))
+                    {
                         //6
                         MeasureList[selectedMeasure].setDistanceData(mpos+1, spos, value);
-                    Dispatcher.BeginInvoke(new Action(() =>
-                    {
-                        MeasureList[selectedMeasure].setGeometryPoint3D(mpos+1 , spos);
+                        Dispatcher.BeginInvoke(new Action(() =>
+                        {
+                            MeasureList[selectedMeasure].setGeometryPoint3D(mpos+1 , spos);
 
-                    }));
+                        }));
+                    }
 
 
 
@@ -133,6 +155,50 @@ namespace LIDAR_Controller
             catch (Exception ex) { ExeptionHandler(ex); }
         }
 
+        /**********************************************************************************************//**
+         * @fn  private void BinaryReceiveHandler()
+         *
+         * @brief   Reads all received bytes in binary mode.
+         *          
+         *          1. Read all bytes from buffer  
+         *          2. Decode the scan records  
+         *          3. Add text outside of records to textBox1  
+         *          4. Set a point of the selected measurement for each record which fits into its grid.  
+         **************************************************************************************************/
+
+        private void BinaryReceiveHandler()
+        {
+            //1
+            byte[] buffer = new byte[ComPort.BytesToRead];
+            int length = ComPort.Read(buffer, 0, buffer.Length);
+            //2
+            List<ScanRecord> records = decoder.Feed(buffer, length);
+            //3
+            string ReceivedText = decoder.TakeText();
+            if (ReceivedText.Length > 0)
+            {
+                Dispatcher.BeginInvoke(new Action(() =>
+                {
+                    this.textBox1.AppendText(ReceivedText);
+                    this.textBox1.ScrollToEnd();
+                }));
+            }
+            //4
+            records.RemoveAll(r => !MeasureList[selectedMeasure].isInside(r.MPos + 1, r.SPos));
+            foreach (ScanRecord r in records)
+            {
+                MeasureList[selectedMeasure].setDistanceData(r.MPos + 1, r.SPos, r.Value);
+            }
+            if (records.Count > 0)
+            {
+                Dispatcher.BeginInvoke(new Action(() =>
+                {
+                    foreach (ScanRecord r in records)
+                        MeasureList[selectedMeasure].setGeometryPoint3D(r.MPos + 1, r.SPos);
+                }));
+            }
+        }
+
         /**********************************************************************************************//**
          * @fn  private void ExeptionHandler(Exception ex)
          *
@@ -178,7 +244,7 @@ namespace LIDAR_Controller
                 comboBox.Items.Add(ports);
             }
             //initial measurement
-            MeasureList.Add(new Measurement(new Vector3D(0, 0, 0.5), 0, 0));
+            MeasureList.Add(new Measurement(new Vector3D(0, 0, 0.5), 0, 0, positions));
 
             //add measurement to combobox2 and register a new event handler for "SelectionChangedEvent"
             comboBox2.Items.Add(MeasureList[selectedMeasure]);
@@ -311,6 +377,10 @@ namespace LIDAR_Controller
                     ComPort.DiscardOutBuffer();
 
                     textBox1.Clear();
+                    binaryMode = false;
+                    binaryChk.IsChecked = false;
+                    deltaChk.IsChecked = false;
+                    decoder.Reset();
 
                     button.Content = "Trennen";
                     label.Content = "Verbunden";
@@ -449,7 +519,7 @@ namespace LIDAR_Controller
         private void neuMessung_Click(object sender, RoutedEventArgs e)
         {
             //1.
-            Measurement mhelper = new Measurement(new Vector3D(), 0, 0);
+            Measurement mhelper = new Measurement(new Vector3D(), 0, 0, positions);
             MeasureList.Add(mhelper);
             //2.
             comboBox2.Items.Clear();
@@ -660,6 +730,11 @@ namespace LIDAR_Controller
             btn_kalibrieren.IsEnabled = b;
             posBtn.IsEnabled = b;
             btn_radar.IsEnabled = b;
+            binaryChk.IsEnabled = b;
+            deltaChk.IsEnabled = b;
+            halfChk.IsEnabled = b;
+            linkCombo.IsEnabled = b;
+            linkBtn.IsEnabled = b;
             txt_MPos.IsEnabled = b;
             txt_SPos.IsEnabled = b;
             //sendBtn.IsEnabled = b;
@@ -674,6 +749,189 @@ namespace LIDAR_Controller
         }
 
 
+        /**********************************************************************************************//**
+         * @fn  private void binaryChk_Click(object sender, RoutedEventArgs e)
+         *
+         * @brief   Event handler. Called by binaryChk and deltaChk for click events.
+         *          This function sends the "#0 x" (Output format) command to the LIDAR-Scanner 
+         *          and switches the receive handler between text lines and binary scan records.
+         *          The compressed format (deltaChk) is binary as well.
+         *
+         * @param   sender  Source of the event.
+         * @param   e       Routed event information.
+         **************************************************************************************************/
+
+        private void binaryChk_Click(object sender, RoutedEventArgs e)
+        {
+            bool delta = deltaChk.IsChecked == true;
+            bool binary = delta || binaryChk.IsChecked == true;
+            ComPort.WriteLine("#0");
+            ComPort.WriteLine(delta ? "2" : (binary ? "1" : "0"));
+            decoder.Reset();
+            binaryMode = binary;
+        }
+
+
+        /**********************************************************************************************//**
+         * @fn  private void halfChk_Click(object sender, RoutedEventArgs e)
+         *
+         * @brief   Event handler. Called by halfChk for click events.
+         *          This function sends the "#h x" (Step mode) command to the LIDAR-Scanner.
+         *          The half step mode has twice the motor positions, so the grid of the selected measurement
+         *          is sized again and new measurements get the same size.
+         *
+         * @param   sender  Source of the event.
+         * @param   e       Routed event information.
+         **************************************************************************************************/
+
+        private void halfChk_Click(object sender, RoutedEventArgs e)
+        {
+            bool half = halfChk.IsChecked == true;
+            ComPort.WriteLine("#h");
+            ComPort.WriteLine(half ? "1" : "0");
+            positions = half ? 2 * Measurement.FullSteps : Measurement.FullSteps;
+            if (MeasureList[selectedMeasure].maxMPos != positions)
+                MeasureList[selectedMeasure].setPositions(positions);
+        }
+
+
+        /**********************************************************************************************//**
+         * @fn  private void linkBtn_Click(object sender, RoutedEventArgs e)
+         *
+         * @brief   Event handler. Called by linkBtn for click events.
+         *          This function switches the baud rate of the LIDAR-Scanner and of ComPort with the
+         *          "#u x" (Baud rate) command. The receive handler is removed during the link test.
+         *
+         * @param   sender  Source of the event.
+         * @param   e       Routed event information.
+         **************************************************************************************************/
+
+        private void linkBtn_Click(object sender, RoutedEventArgs e)
+        {
+            ComPort.DataReceived -= ComPortReceiveHandler;
+            try
+            {
+                string result = LinkTest(linkCombo.SelectedIndex);
+                textBox1.AppendText(result + "\r\n");
+                textBox1.ScrollToEnd();
+            }
+            catch (Exception ex)
+            {
+                ExeptionHandler(ex);
+            }
+            finally
+            {
+                ComPort.DataReceived += ComPortReceiveHandler;
+                label.Content = "Verbunden (" + ComPort.BaudRate + " Baud)";
+            }
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private string LinkTest(int index)
+         *
+         * @brief   Switches the baud rate with the link test of the LIDAR-Scanner.
+         *          
+         *          1. Send "#u x" and wait for "Baud = y"  
+         *          2. Switch ComPort to y and send the test block (byte i is (i * 0x1D) ^ 0x55)  
+         *          3. Check the echo, confirm it with '!' or switch back to the old rate  
+         *          4. Read the result of the LIDAR-Scanner ("Link baud = ...")  
+         *          
+         *          The LIDAR-Scanner falls back to the old rate by itself if the confirmation is missing.
+         *
+         * @param   index   The index of the baud rate (0 = 56000, 1 = 250000, 2 = 500000, 3 = 1000000).
+         *
+         * @return  The result line of the LIDAR-Scanner.
+         **************************************************************************************************/
+
+        private string LinkTest(int index)
+        {
+            const int blockLength = 32;
+            int oldBaud = ComPort.BaudRate;
+            int oldTimeout = ComPort.ReadTimeout;
+            ComPort.ReadTimeout = 2000;
+            try
+            {
+                //1
+                ComPort.DiscardInBuffer();
+                ComPort.Write("#u " + index + "\r");
+                string line;
+                do
+                {
+                    line = ComPort.ReadLine().Trim();
+                    if (line.StartsWith("Unknown")) return line;
+                } while (!line.StartsWith("Baud = "));
+                int baud = int.Parse(line.Substring(7));
+
+                //2
+                Thread.Sleep(5);
+                ComPort.BaudRate = baud;
+                ComPort.DiscardInBuffer();
+                byte[] block = new byte[blockLength];
+                for (int i = 0; i < blockLength; i++)
+                    block[i] = (byte)((i * 0x1D) ^ 0x55);
+                ComPort.Write(block, 0, blockLength);
+
+                //3
+                bool echo = true;
+                ComPort.ReadTimeout = 500;
+                try
+                {
+                    for (int i = 0; i < blockLength; i++)
+                        echo &= ComPort.ReadByte() == block[i];
+                }
+                catch (TimeoutException)
+                {
+                    echo = false;
+                }
+                if (echo)
+                {
+                    ComPort.Write("!");
+                }
+                else
+                {
+                    ComPort.BaudRate = oldBaud;
+                    ComPort.DiscardInBuffer();
+                }
+
+                //4 (if the confirmation got lost, the result comes with the old rate)
+                ComPort.ReadTimeout = 2000;
+                try
+                {
+                    return ReadLinkResult();
+                }
+                catch (TimeoutException)
+                {
+                    if (ComPort.BaudRate == oldBaud) throw;
+                    ComPort.BaudRate = oldBaud;
+                    return ReadLinkResult();
+                }
+            }
+            finally
+            {
+                ComPort.ReadTimeout = oldTimeout;
+            }
+        }
+
+
+        /**********************************************************************************************//**
+         * @fn  private string ReadLinkResult()
+         *
+         * @brief   Reads lines until the result of the link test arrives.
+         *
+         * @return  The result line.
+         **************************************************************************************************/
+
+        private string ReadLinkResult()
+        {
+            string line;
+            do
+            {
+                line = ComPort.ReadLine().Trim();
+            } while (!line.StartsWith("Link baud"));
+            return line;
+        }
+
+
         /**********************************************************************************************//**
          * @fn  private void reverse_Click(object sender, RoutedEventArgs e)
          *
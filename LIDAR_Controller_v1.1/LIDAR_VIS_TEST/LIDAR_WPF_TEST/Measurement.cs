@@ -29,11 +29,18 @@ namespace LIDAR_Controller
     public class Measurement
     {
         /**********************************************************************************************//**
-         * @brief   The maximum motor position.
+         * @brief   The number of motor positions in the full step mode.
          *
          **************************************************************************************************/
 
-        public static int maxMPos = 200; //200 Steps 
+        public const int FullSteps = 200;
+
+        /**********************************************************************************************//**
+         * @brief   The maximum motor position, set by the step mode of the measurement.
+         *
+         **************************************************************************************************/
+
+        public int maxMPos = FullSteps; //200 full steps or 400 half steps
 
         /**********************************************************************************************//**
          * @brief   The maximum servo position.
@@ -68,7 +75,7 @@ namespace LIDAR_Controller
          *
          **************************************************************************************************/
 
-        public double[][] distanceData = new double[maxMPos+1][];
+        public double[][] distanceData;
 
         /**********************************************************************************************//**
          * @brief   The origin of the measurement.
@@ -165,9 +172,10 @@ namespace LIDAR_Controller
          * @param   linearOffset    The linear offset.
          * @param   rotaryOffsetX   The rotary offset around x.
          * @param   rotaryOffsetZ   The rotary offset around z.
+         * @param   positions       The number of motor positions per turn (FullSteps or 2 * FullSteps).
          **************************************************************************************************/
 
-        public Measurement(Vector3D linearOffset, double rotaryOffsetX, double rotaryOffsetZ)
+        public Measurement(Vector3D linearOffset, double rotaryOffsetX, double rotaryOffsetZ, int positions)
         {
             this.linearOffset = linearOffset;
             origin.X = linearOffset.X;
@@ -180,15 +188,47 @@ namespace LIDAR_Controller
             this.color = Color.FromArgb(150, (Byte)r.Next(0, 256), (Byte)r.Next(0, 256), (Byte)r.Next(0, 256));
             mId = id++;
 
-            for (int i = 0; i < maxMPos+1; i++)
+            setPositions(positions);
+        }
+
+        /**********************************************************************************************//**
+         * @fn  public void setPositions(int positions)
+         *
+         * @brief   Sizes the grid for the motor positions of the step mode.
+         *          The distance data is reset and the 3D structure is generated again.
+         *
+         * @param   positions   The number of motor positions per turn (FullSteps or 2 * FullSteps).
+         **************************************************************************************************/
+
+        public void setPositions(int positions)
+        {
+            maxMPos = positions;
+            distanceData = new double[maxMPos + 1][];
+            for (int i = 0; i < maxMPos + 1; i++)
             {
-                distanceData[i] = new double[maxSPos+1];
+                distanceData[i] = new double[maxSPos + 1];
                 for (int k = 0; k <= maxSPos; k++)
                 { setDistanceData(i, k, 10); }
             }
             makeGeometry3D();
         }
 
+        /**********************************************************************************************//**
+         * @fn  public bool isInside(int mpos, int spos)
+         *
+         * @brief   Checks a position against the grid, a point of another step mode does not fit.
+         *
+         * @param   mpos    The motor position.
+         * @param   spos    The servo position.
+         *
+         * @return  True if the position is in the grid.
+         **************************************************************************************************/
+
+        public bool isInside(int mpos, int spos)
+        {
+            return mpos >= 0 && mpos <= maxMPos && spos >= 0 && spos <= maxSPos;
+        }
+
         /**********************************************************************************************//**
          * @fn  public double getDistanceData(int mpos, int spos)
          *
@@ -0,0 +1,477 @@
+﻿/**********************************************************************************************//**
+ * @file    ScanRecordDecoder.cs
+ *
+ * @brief   Implements the decoder for binary scan records.
+ **************************************************************************************************/
+
+using System;
+using System.Collections.Generic;
+using System.Text;
+
+
+namespace LIDAR_Controller
+{
+    /**********************************************************************************************//**
+     * @class   ScanRecord
+     *
+     * @brief   A single point received from the LIDAR-Scanner.
+     **************************************************************************************************/
+
+    public class ScanRecord
+    {
+        /** @brief   The sequence number of the record, of the block for delta coded records. */
+        public int Sequence;
+
+        /** @brief   The motor position. */
+        public int MPos;
+
+        /** @brief   The servo position. */
+        public int SPos;
+
+        /** @brief   The distance value. */
+        public int Value;
+
+        /** @brief   The LIDAR-Lite unit which measured the value. */
+        public int Unit;
+
+        /** @brief   The time when the measure was started in us, -1 if the record has no timestamp ("#t 0"). */
+        public long Time = -1;
+    }
+
+    /**********************************************************************************************//**
+     * @class   ScanRecordDecoder
+     *
+     * @brief   Streaming decoder for the binary scan records of the LIDAR-Scanner ("#0 1").
+     *          
+     *          A record has 7 bytes: sync (0xA5), sequence, mpos, sdeg, value (low byte, high byte)
+     *          and a CRC-8 (polynomial 0x07, init 0) over sequence to value.
+     *          Bit 7 of sdeg holds bit 8 of mpos, the half step mode ("#h 1") has 400 motor positions.
+     *          Bits 12 and 13 of value hold the LIDAR-Lite unit, the distance is in the bits below.
+     *          A record with timestamp ("#t 1") has 11 bytes: sync (0xA6), sequence, mpos, sdeg,
+     *          value (low byte, high byte), time in us (4 bytes, low byte first) and the CRC-8 over sequence to time.
+     *          In the delta format ("#0 2") up to 8 records are sent as block: sync (0xA7), sequence,
+     *          header (number of records, bit 7 set for records with timestamp), the first record as keyframe
+     *          (mpos, sdeg, value low byte, value high byte, time 4 bytes low byte first if enabled),
+     *          for every further record the differences of mpos, sdeg and value to the record before
+     *          as zig-zag varints and the time since the record before as varint, and the CRC-8 over sequence
+     *          to the last record. A varint has 7 bits per byte, low bits first, bit 7 is set if more bytes follow.
+     *          The rotating mode ("#r") ends every revolution with a frame marker of 10 bytes: sync (0xA8), sequence,
+     *          revolution, points, missed points (2 bytes each, low byte first), correction at the index
+     *          (signed, 127 without index, -128 if lost) and the CRC-8 over sequence to correction.
+     *          It is added to the text as the line of the ASCII format.
+     *          Bytes outside of records (text answers of the scanner) are collected as text.
+     *          After a CRC error the decoder resynchronises on the next sync byte.
+     **************************************************************************************************/
+
+    public class ScanRecordDecoder
+    {
+        /** @brief   The first byte of every record. */
+        public const byte Sync = 0xA5;
+
+        /** @brief   The first byte of every record with timestamp. */
+        public const byte SyncTime = 0xA6;
+
+        /** @brief   The first byte of every block of delta coded records. */
+        public const byte SyncDelta = 0xA7;
+
+        /** @brief   The first byte of every frame marker of the rotating mode. */
+        public const byte SyncFrame = 0xA8;
+
+        /** @brief   The maximum number of records in a block. */
+        public const int DeltaPoints = 8;
+
+        /** @brief   The bit of sdeg which holds bit 8 of mpos. */
+        public const byte MPosHigh = 0x80;
+
+        /** @brief   The first bit of value which holds the unit. */
+        public const int UnitShift = 12;
+
+        /** @brief   The bits of value which hold the distance. */
+        public const int ValueMask = 0x0FFF;
+
+        /** @brief   The flag in the header of a block for records with timestamp. */
+        public const byte DeltaTime = 0x80;
+
+        /** @brief   The length of a record in bytes. */
+        public const int RecordLength = 7;
+
+        /** @brief   The length of a record with timestamp in bytes. */
+        public const int RecordTimeLength = 11;
+
+        /** @brief   The length of a frame marker in bytes. */
+        public const int FrameLength = 10;
+
+        /** @brief   The correction of a frame marker if the index was not passed. */
+        public const int FrameSyncNone = 127;
+
+        /** @brief   The correction of a frame marker if the index was not found where it was expected. */
+        public const int FrameSyncLost = -128;
+
+        /** @brief   The maximum length of a block including the CRC in bytes. */
+        public const int BlockLength = 3 + 8 + (DeltaPoints - 1) * 12 + 1;
+
+        /** @brief   The bytes of the record which is received at the moment. */
+        byte[] frame = new byte[BlockLength];
+
+        /** @brief   The number of bytes in frame. */
+        int count = 0;
+
+        /** @brief   The sequence number of the last valid record, -1 if there is none. */
+        int lastSequence = -1;
+
+        /** @brief   Bytes outside of records. */
+        StringBuilder text = new StringBuilder();
+
+        /** @brief   The number of records which failed the CRC check or had an invalid block header. */
+        public int CrcErrors { get; private set; }
+
+        /** @brief   The number of records which are missing according to the sequence numbers. */
+        public int LostRecords { get; private set; }
+
+        /**********************************************************************************************//**
+         * @fn  public static byte Crc8(byte[] data, int offset, int length)
+         *
+         * @brief   Calculates the CRC-8 (polynomial 0x07, init 0) like _crc8_ccitt_update of the avr-libc.
+         *
+         * @param   data    The data.
+         * @param   offset  The index of the first byte.
+         * @param   length  The number of bytes.
+         *
+         * @return  The CRC.
+         **************************************************************************************************/
+
+        public static byte Crc8(byte[] data, int offset, int length)
+        {
+            byte crc = 0;
+            for (int i = offset; i < offset + length; i++)
+            {
+                crc ^= data[i];
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    if ((crc & 0x80) != 0)
+                        crc = (byte)((crc << 1) ^ 0x07);
+                    else
+                        crc = (byte)(crc << 1);
+                }
+            }
+            return crc;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  public void Reset()
+         *
+         * @brief   Discards a partly received record and the statistics.
+         **************************************************************************************************/
+
+        public void Reset()
+        {
+            count = 0;
+            lastSequence = -1;
+            text.Clear();
+            CrcErrors = 0;
+            LostRecords = 0;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  public List<ScanRecord> Feed(byte[] data, int length)
+         *
+         * @brief   Decodes the received bytes.
+         *
+         * @param   data    The received bytes.
+         * @param   length  The number of valid bytes in data.
+         *
+         * @return  All records which were completed by data.
+         **************************************************************************************************/
+
+        public List<ScanRecord> Feed(byte[] data, int length)
+        {
+            List<ScanRecord> records = new List<ScanRecord>();
+            for (int i = 0; i < length; i++)
+            {
+                if (count == 0 && !IsSync(data[i]))
+                {
+                    text.Append((char)data[i]);
+                    continue;
+                }
+                frame[count++] = data[i];
+                int recordLength = Length(0);
+                if (recordLength > count) continue;
+
+                if (recordLength > 0 && Crc8(frame, 1, recordLength - 2) == frame[recordLength - 1])
+                {
+                    if (frame[0] == SyncDelta)
+                        DecodeBlock(records);
+                    else if (frame[0] == SyncFrame)
+                        DecodeFrame();
+                    else
+                        records.Add(Decode());
+                    count = 0;
+                }
+                else
+                {
+                    CrcErrors++;
+                    Resync();
+                }
+            }
+            return records;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  public string TakeText()
+         *
+         * @brief   Returns the bytes outside of records and clears them.
+         *
+         * @return  The text.
+         **************************************************************************************************/
+
+        public string TakeText()
+        {
+            string s = text.ToString();
+            text.Clear();
+            return s;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private static bool IsSync(byte b)
+         *
+         * @brief   Checks for the first byte of a record, block or frame marker.
+         *
+         * @param   b   The byte.
+         *
+         * @return  True if b is a sync byte.
+         **************************************************************************************************/
+
+        private static bool IsSync(byte b)
+        {
+            return b == Sync || b == SyncTime || b == SyncDelta || b == SyncFrame;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private int Length(int start)
+         *
+         * @brief   Returns the length of the record which starts at frame[start].
+         *          The length of a block depends on its varints, so it is only known when they are received.
+         *
+         * @param   start   The index of the sync byte in frame.
+         *
+         * @return  The length in bytes, more than the received bytes if the length is not known yet,
+         *          -1 if the block header is invalid.
+         **************************************************************************************************/
+
+        private int Length(int start)
+        {
+            if (frame[start] == Sync) return RecordLength;
+            if (frame[start] == SyncTime) return RecordTimeLength;
+            if (frame[start] == SyncFrame) return FrameLength;
+
+            int available = count - start;
+            if (available < 3) return available + 1;
+            int header = frame[start + 2];
+            int points = header & ~DeltaTime;
+            if (points == 0 || points > DeltaPoints) return -1;
+            bool time = (header & DeltaTime) != 0;
+
+            int length = 3 + (time ? 8 : 4);
+            int fields = (points - 1) * (time ? 4 : 3);
+            for (int f = 0; f < fields; f++)
+            {
+                do
+                {
+                    if (length >= BlockLength - 1) return -1;
+                    if (length >= available) return available + 1;
+                } while ((frame[start + length++] & 0x80) != 0);
+            }
+            return length + 1;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private ScanRecord Decode()
+         *
+         * @brief   Converts the valid record in frame and updates the sequence statistics.
+         *
+         * @return  The record.
+         **************************************************************************************************/
+
+        private ScanRecord Decode()
+        {
+            ScanRecord r = new ScanRecord();
+            r.Sequence = frame[1];
+            r.MPos = frame[2] | ((frame[3] & MPosHigh) << 1);
+            r.SPos = frame[3] & ~MPosHigh;
+            SetValue(r, frame[4] | (frame[5] << 8));
+            if (frame[0] == SyncTime)
+                r.Time = ReadTime(6);
+            CountSequence(r.Sequence);
+            return r;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private void DecodeBlock(List<ScanRecord> records)
+         *
+         * @brief   Converts the valid block of delta coded records in frame and updates the sequence statistics.
+         *          A lost block counts as one lost record, the number of records in it is unknown.
+         *          Only the keyframe carries bit 8 of mpos in sdeg, the differences are taken of the whole positions.
+         *          The differences of value include the unit, which is split off each record.
+         *
+         * @param   records The list the records are added to.
+         **************************************************************************************************/
+
+        private void DecodeBlock(List<ScanRecord> records)
+        {
+            int points = frame[2] & ~DeltaTime;
+            bool time = (frame[2] & DeltaTime) != 0;
+
+            ScanRecord r = new ScanRecord();
+            r.Sequence = frame[1];
+            r.MPos = frame[3] | ((frame[4] & MPosHigh) << 1);
+            r.SPos = frame[4] & ~MPosHigh;
+            int value = frame[5] | (frame[6] << 8);
+            SetValue(r, value);
+            int pos = 7;
+            if (time)
+            {
+                r.Time = ReadTime(pos);
+                pos += 4;
+            }
+            records.Add(r);
+
+            for (int p = 1; p < points; p++)
+            {
+                ScanRecord next = new ScanRecord();
+                next.Sequence = r.Sequence;
+                next.MPos = r.MPos + ZigZag(ReadVarint(ref pos));
+                next.SPos = r.SPos + ZigZag(ReadVarint(ref pos));
+                value += ZigZag(ReadVarint(ref pos));
+                SetValue(next, value);
+                if (time)
+                    next.Time = (r.Time + ReadVarint(ref pos)) & 0xFFFFFFFF;
+                records.Add(next);
+                r = next;
+            }
+            CountSequence(r.Sequence);
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private static void SetValue(ScanRecord r, int value)
+         *
+         * @brief   Splits the value of a record into the distance and the unit.
+         *
+         * @param   r       The record.
+         * @param   value   The value as sent.
+         **************************************************************************************************/
+
+        private static void SetValue(ScanRecord r, int value)
+        {
+            r.Value = value & ValueMask;
+            r.Unit = (value & 0xFFFF) >> UnitShift;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private void DecodeFrame()
+         *
+         * @brief   Converts the valid frame marker in frame to the line of the ASCII format
+         *          ("frame: r points: p missed: m sync: c") and updates the sequence statistics.
+         **************************************************************************************************/
+
+        private void DecodeFrame()
+        {
+            int revolution = frame[2] | (frame[3] << 8);
+            int points = frame[4] | (frame[5] << 8);
+            int missed = frame[6] | (frame[7] << 8);
+            int sync = (sbyte)frame[8];
+            string correction = sync == FrameSyncNone ? "none" : (sync == FrameSyncLost ? "lost" : sync.ToString());
+            text.Append("frame: " + revolution + " points: " + points + " missed: " + missed + " sync: " + correction + "\r\n");
+            CountSequence(frame[1]);
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private long ReadTime(int pos)
+         *
+         * @brief   Reads a time of 4 bytes, low byte first.
+         *
+         * @param   pos The index of the first byte in frame.
+         *
+         * @return  The time in us.
+         **************************************************************************************************/
+
+        private long ReadTime(int pos)
+        {
+            return frame[pos] | (frame[pos + 1] << 8) | (frame[pos + 2] << 16) | ((long)frame[pos + 3] << 24);
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private long ReadVarint(ref int pos)
+         *
+         * @brief   Reads a varint.
+         *
+         * @param [in,out]  pos The index of the first byte in frame, the index behind the varint on return.
+         *
+         * @return  The value.
+         **************************************************************************************************/
+
+        private long ReadVarint(ref int pos)
+        {
+            long v = 0;
+            int shift = 0;
+            byte b;
+            do
+            {
+                b = frame[pos++];
+                v |= (long)(b & 0x7F) << shift;
+                shift += 7;
+            } while ((b & 0x80) != 0);
+            return v;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private static int ZigZag(long v)
+         *
+         * @brief   Converts a zig-zag coded value (0, -1, 1, -2, ...) to the signed difference.
+         *
+         * @param   v   The coded value.
+         *
+         * @return  The difference.
+         **************************************************************************************************/
+
+        private static int ZigZag(long v)
+        {
+            return (int)(v >> 1) ^ -(int)(v & 1);
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private void CountSequence(int sequence)
+         *
+         * @brief   Updates the statistics of lost records with the sequence number of a valid record.
+         *
+         * @param   sequence    The sequence number.
+         **************************************************************************************************/
+
+        private void CountSequence(int sequence)
+        {
+            if (lastSequence >= 0)
+                LostRecords += (sequence - lastSequence - 1) & 0xFF;
+            lastSequence = sequence;
+        }
+
+        /**********************************************************************************************//**
+         * @fn  private void Resync()
+         *
+         * @brief   Drops the sync byte of an invalid record and continues at the next sync byte in frame.
+         *          A sync byte is only used if the record behind it is valid and not complete yet.
+         **************************************************************************************************/
+
+        private void Resync()
+        {
+            int start = 1;
+            while (start < count && (!IsSync(frame[start]) || Length(start) < 0 || count - start >= Length(start)))
+                start++;
+            if (start >= count)
+            {
+                count = 0;
+                return;
+            }
+            count -= start;
+            Array.Copy(frame, start, frame, 0, count);
+        }
+    }
+}